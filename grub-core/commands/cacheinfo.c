@@ -28,20 +28,32 @@ grub_rescue_cmd_info (struct grub_command *cmd __attribute__ ((unused)),
     int argc __attribute__ ((unused)),
     char *argv[] __attribute__ ((unused)))
 {
-  unsigned long hits, misses;
+  unsigned long hits, misses, evictions;
+  unsigned long ra_hits, ra_wasted;
+  grub_uint64_t ra_bytes, direct_bytes;
 
-  grub_disk_cache_get_performance (&hits, &misses);
+  grub_disk_cache_get_performance (&hits, &misses, &evictions);
+  grub_printf_ (N_("Disk cache size: %lu KiB\n"),
+		(unsigned long) (grub_disk_cache_get_size () >> 10));
   if (hits + misses)
     {
       unsigned long ratio = hits * 10000 / (hits + misses);
-      grub_printf ("(%lu.%lu%%)\n", ratio / 100, ratio % 100);
       grub_printf_ (N_("Disk cache statistics: hits = %lu (%lu.%02lu%%),"
-		     " misses = %lu\n"), ratio / 100, ratio % 100,
-		    hits, misses);
+		     " misses = %lu, evictions = %lu\n"),
+		    hits, ratio / 100, ratio % 100, misses, evictions);
     }
   else
     grub_printf ("%s\n", _("No disk cache statistics available\n"));    
 
+  grub_disk_readahead_get_performance (&ra_bytes, &ra_hits, &ra_wasted);
+  grub_printf_ (N_("Read-ahead: %llu KiB read, hits = %lu,"
+		   " evicted unused = %lu\n"),
+		(unsigned long long) (ra_bytes >> 10), ra_hits, ra_wasted);
+
+  grub_disk_direct_get_performance (&direct_bytes);
+  grub_printf_ (N_("Direct reads: %llu KiB\n"),
+		(unsigned long long) (direct_bytes >> 10));
+
  return 0;
 }
 
@@ -22,6 +22,12 @@
 #include <grub/dl.h>
 #include <grub/extcmd.h>
 #include <grub/i18n.h>
+#include <grub/command.h>
+#include <grub/time.h>
+
+#if (defined (GRUB_MACHINE_EMU) || defined (GRUB_UTIL)) && defined (__x86_64__)
+#include <grub/i386/cpuid.h>
+#endif
 
 #ifdef GRUB_UTIL
 #include <errno.h>
@@ -56,22 +62,16 @@ static inline int GF_PER_SECTOR (const struct grub_cryptodisk *dev)
 static grub_cryptodisk_t cryptodisk_list = NULL;
 static grub_uint8_t n = 0;
 
-static void
-gf_mul_x (grub_uint8_t *g)
-{
-  int over = 0, over2 = 0;
-  unsigned j;
-
-  for (j = 0; j < GRUB_CRYPTODISK_GF_BYTES; j++)
-    {
-      over2 = !!(g[j] & 0x80);
-      g[j] <<= 1;
-      g[j] |= over;
-      over = over2;
-    }
-  if (over)
-    g[0] ^= GF_POLYNOM;
-}
+/* Multiply the XTS tweak (LO, HI), a little-endian 128-bit number, by x.  */
+#define XTS_MUL_X(lo, hi)						\
+  do									\
+    {									\
+      grub_uint64_t carry_ = (grub_uint64_t) ((grub_int64_t) (hi) >> 63)	\
+			     & GF_POLYNOM;				\
+      (hi) = ((hi) << 1) | ((lo) >> 63);				\
+      (lo) = ((lo) << 1) ^ carry_;					\
+    }									\
+  while (0)
 
 
 static void
@@ -213,6 +213,421 @@ lrw_xor (const struct lrw_sector *sec,
 		   dev->lrw_precalc, sec->low_byte * GRUB_CRYPTODISK_GF_BYTES);
 }
 
+/* The number of bytes of a sector whose tweaks are computed at once by
+   the portable XTS code.  */
+#define XTS_CHUNK 256
+
+/* XTS with the generic ciphers.  IV is the encrypted tweak of the first
+   block.  The tweaks of a chunk of the sector are computed first, so that
+   the cipher is called once per chunk rather than once per block.  */
+static gcry_err_code_t
+xts_endecrypt (struct grub_cryptodisk *dev, grub_uint8_t *data,
+	       const grub_uint8_t *iv, int do_encrypt)
+{
+  grub_uint64_t tweaks[XTS_CHUNK / sizeof (grub_uint64_t)];
+  grub_uint64_t lo, hi;
+  grub_size_t sector_size = 1U << dev->log_sector_size;
+  grub_size_t off, chunk, j;
+  gcry_err_code_t err;
+
+  lo = grub_le_to_cpu64 (grub_get_unaligned64 (iv));
+  hi = grub_le_to_cpu64 (grub_get_unaligned64 (iv + 8));
+
+  for (off = 0; off < sector_size; off += chunk)
+    {
+      chunk = sector_size - off;
+      if (chunk > XTS_CHUNK)
+	chunk = XTS_CHUNK;
+
+      for (j = 0; j < chunk / sizeof (grub_uint64_t); j += 2)
+	{
+	  tweaks[j] = grub_cpu_to_le64 (lo);
+	  tweaks[j + 1] = grub_cpu_to_le64 (hi);
+	  XTS_MUL_X (lo, hi);
+	}
+
+      grub_crypto_xor (data + off, data + off, tweaks, chunk);
+      if (do_encrypt)
+	err = grub_crypto_ecb_encrypt (dev->cipher, data + off, data + off,
+				       chunk);
+      else
+	err = grub_crypto_ecb_decrypt (dev->cipher, data + off, data + off,
+				       chunk);
+      if (err)
+	return err;
+      grub_crypto_xor (data + off, data + off, tweaks, chunk);
+    }
+  return GPG_ERR_NO_ERROR;
+}
+
+#if (defined (GRUB_MACHINE_EMU) || defined (GRUB_UTIL)) \
+  && defined (__x86_64__) && GNUC_PREREQ (4, 9) && ! defined (__clang__)
+
+/* AES-NI versions of the XTS and CBC modes.  They work on the whole
+   sector in registers, four blocks at a time where the mode allows it,
+   instead of going through the cipher handle for every block.  */
+
+#define CRYPTODISK_AESNI 1
+
+typedef long long aesni_block __attribute__ ((vector_size (16)));
+typedef long long aesni_block_u __attribute__ ((vector_size (16), aligned (1),
+						 may_alias));
+typedef int aesni_v4si __attribute__ ((vector_size (16)));
+
+#define AESNI_MAX_ROUNDS 14
+
+struct grub_cryptodisk_aesni
+{
+  aesni_block enc[AESNI_MAX_ROUNDS + 1];
+  aesni_block dec[AESNI_MAX_ROUNDS + 1];
+  /* The key of the tweaks in XTS mode.  */
+  aesni_block tweak[AESNI_MAX_ROUNDS + 1];
+  int rounds;
+};
+
+#define AESNI_LOAD(p) (*(const aesni_block_u *) (p))
+#define AESNI_STORE(p, v) (*(aesni_block_u *) (p) = (v))
+
+/* K xor K shifted left by one, two and three words.  */
+#define AESNI_SHIFT_XOR(k)						\
+  ((k) ^ __builtin_ia32_pslldqi128 ((k), 32)				\
+   ^ __builtin_ia32_pslldqi128 ((k), 64)				\
+   ^ __builtin_ia32_pslldqi128 ((k), 96))
+
+#define AESNI_ASSIST(k, rcon, word)					\
+  ((aesni_block) __builtin_ia32_pshufd					\
+   ((aesni_v4si) __builtin_ia32_aeskeygenassist128 ((k), (rcon)), (word)))
+
+static int
+aesni_usable (void)
+{
+  static int usable = -1;
+
+  if (usable < 0)
+    {
+      grub_uint32_t eax, ebx, ecx, edx;
+
+      grub_cpuid_count (1, 0, &eax, &ebx, &ecx, &edx);
+      usable = !!(ecx & (1 << 25));
+    }
+  return usable;
+}
+
+static void __attribute__ ((target ("aes")))
+aesni_expand_128 (aesni_block *ks, const grub_uint8_t *key)
+{
+  aesni_block k = AESNI_LOAD (key);
+
+  ks[0] = k;
+#define AESNI_STEP_128(i, rcon)						\
+  k = AESNI_SHIFT_XOR (k) ^ AESNI_ASSIST (k, rcon, 0xff);		\
+  ks[i] = k
+  AESNI_STEP_128 (1, 0x01);
+  AESNI_STEP_128 (2, 0x02);
+  AESNI_STEP_128 (3, 0x04);
+  AESNI_STEP_128 (4, 0x08);
+  AESNI_STEP_128 (5, 0x10);
+  AESNI_STEP_128 (6, 0x20);
+  AESNI_STEP_128 (7, 0x40);
+  AESNI_STEP_128 (8, 0x80);
+  AESNI_STEP_128 (9, 0x1b);
+  AESNI_STEP_128 (10, 0x36);
+#undef AESNI_STEP_128
+}
+
+static void __attribute__ ((target ("aes")))
+aesni_expand_256 (aesni_block *ks, const grub_uint8_t *key)
+{
+  aesni_block k0 = AESNI_LOAD (key);
+  aesni_block k1 = AESNI_LOAD (key + 16);
+
+  ks[0] = k0;
+  ks[1] = k1;
+#define AESNI_STEP_256(i, rcon)						\
+  k0 = AESNI_SHIFT_XOR (k0) ^ AESNI_ASSIST (k1, rcon, 0xff);		\
+  ks[i] = k0;								\
+  if (i < 14)								\
+    {									\
+      k1 = AESNI_SHIFT_XOR (k1) ^ AESNI_ASSIST (k0, 0, 0xaa);		\
+      ks[i + 1] = k1;							\
+    }
+  AESNI_STEP_256 (2, 0x01);
+  AESNI_STEP_256 (4, 0x02);
+  AESNI_STEP_256 (6, 0x04);
+  AESNI_STEP_256 (8, 0x08);
+  AESNI_STEP_256 (10, 0x10);
+  AESNI_STEP_256 (12, 0x20);
+  AESNI_STEP_256 (14, 0x40);
+#undef AESNI_STEP_256
+}
+
+/* Expand KEY into KS.  Return the number of rounds, or 0 if the key size
+   isn't handled.  */
+static int
+aesni_expand (aesni_block *ks, const grub_uint8_t *key, grub_size_t keysize)
+{
+  switch (keysize)
+    {
+    case 16:
+      aesni_expand_128 (ks, key);
+      return 10;
+    case 32:
+      aesni_expand_256 (ks, key);
+      return 14;
+    default:
+      return 0;
+    }
+}
+
+static void __attribute__ ((target ("aes")))
+aesni_invert (aesni_block *dec, const aesni_block *enc, int rounds)
+{
+  int i;
+
+  dec[0] = enc[rounds];
+  for (i = 1; i < rounds; i++)
+    dec[i] = __builtin_ia32_aesimc128 (enc[rounds - i]);
+  dec[rounds] = enc[0];
+}
+
+/* Set up DEV->aesni for KEY if the CPU, the cipher and the mode allow it,
+   or free it otherwise.  The generic ciphers are still keyed, so failing
+   here only means that the slower code is used.  */
+static void
+aesni_setkey (grub_cryptodisk_t dev, const grub_uint8_t *key,
+	      grub_size_t real_keysize, grub_size_t keysize)
+{
+  struct grub_cryptodisk_aesni *ctx;
+
+  if (!aesni_usable ()
+      || grub_strncmp (dev->cipher->cipher->name, "AES", 3) != 0
+      || (dev->mode != GRUB_CRYPTODISK_MODE_XTS
+	  && dev->mode != GRUB_CRYPTODISK_MODE_CBC)
+      || (dev->mode == GRUB_CRYPTODISK_MODE_XTS
+	  && (!dev->secondary_cipher
+	      || grub_strncmp (dev->secondary_cipher->cipher->name,
+			       "AES", 3) != 0
+	      || keysize != 2 * real_keysize)))
+    goto fail;
+
+  ctx = dev->aesni;
+  if (!ctx)
+    {
+      ctx = grub_memalign (16, sizeof (*ctx));
+      if (!ctx)
+	{
+	  grub_errno = GRUB_ERR_NONE;
+	  return;
+	}
+      dev->aesni = ctx;
+    }
+
+  ctx->rounds = aesni_expand (ctx->enc, key, real_keysize);
+  if (!ctx->rounds)
+    goto fail;
+  if (dev->mode == GRUB_CRYPTODISK_MODE_XTS
+      && aesni_expand (ctx->tweak, key + real_keysize,
+		       real_keysize) != ctx->rounds)
+    goto fail;
+  aesni_invert (ctx->dec, ctx->enc, ctx->rounds);
+  return;
+
+ fail:
+  if (dev->aesni)
+    {
+      grub_memset (dev->aesni, 0, sizeof (*dev->aesni));
+      grub_free (dev->aesni);
+      dev->aesni = NULL;
+    }
+}
+
+/* Run the rounds of KS on the blocks B0 to B3 with OP and OPLAST, one of
+   the aesenc and aesdec pairs.  */
+#define AESNI_ROUNDS4(op, oplast, ks, rounds, b0, b1, b2, b3)		\
+  do									\
+    {									\
+      int r_;								\
+      b0 ^= (ks)[0]; b1 ^= (ks)[0]; b2 ^= (ks)[0]; b3 ^= (ks)[0];	\
+      for (r_ = 1; r_ < (rounds); r_++)					\
+	{								\
+	  b0 = op (b0, (ks)[r_]);					\
+	  b1 = op (b1, (ks)[r_]);					\
+	  b2 = op (b2, (ks)[r_]);					\
+	  b3 = op (b3, (ks)[r_]);					\
+	}								\
+      b0 = oplast (b0, (ks)[rounds]);					\
+      b1 = oplast (b1, (ks)[rounds]);					\
+      b2 = oplast (b2, (ks)[rounds]);					\
+      b3 = oplast (b3, (ks)[rounds]);					\
+    }									\
+  while (0)
+
+#define AESNI_ROUNDS1(op, oplast, ks, rounds, b)			\
+  do									\
+    {									\
+      int r_;								\
+      b ^= (ks)[0];							\
+      for (r_ = 1; r_ < (rounds); r_++)					\
+	b = op (b, (ks)[r_]);						\
+      b = oplast (b, (ks)[rounds]);					\
+    }									\
+  while (0)
+
+#define AESNI_ENC __builtin_ia32_aesenc128
+#define AESNI_ENCLAST __builtin_ia32_aesenclast128
+#define AESNI_DEC __builtin_ia32_aesdec128
+#define AESNI_DECLAST __builtin_ia32_aesdeclast128
+
+/* Run XTS over LEN bytes of DATA, starting with the encrypted tweak T.  */
+static void __attribute__ ((target ("aes")))
+aesni_xts_blocks (const struct grub_cryptodisk_aesni *ctx, grub_uint8_t *data,
+		  grub_size_t len, aesni_block t, int do_encrypt)
+{
+  int rounds = ctx->rounds;
+  grub_uint64_t lo = t[0], hi = t[1];
+
+  for (; len >= 64; len -= 64, data += 64)
+    {
+      aesni_block t0, t1, t2, t3, b0, b1, b2, b3;
+
+      t0 = (aesni_block) { lo, hi };
+      XTS_MUL_X (lo, hi);
+      t1 = (aesni_block) { lo, hi };
+      XTS_MUL_X (lo, hi);
+      t2 = (aesni_block) { lo, hi };
+      XTS_MUL_X (lo, hi);
+      t3 = (aesni_block) { lo, hi };
+      XTS_MUL_X (lo, hi);
+
+      b0 = AESNI_LOAD (data) ^ t0;
+      b1 = AESNI_LOAD (data + 16) ^ t1;
+      b2 = AESNI_LOAD (data + 32) ^ t2;
+      b3 = AESNI_LOAD (data + 48) ^ t3;
+      if (do_encrypt)
+	AESNI_ROUNDS4 (AESNI_ENC, AESNI_ENCLAST, ctx->enc, rounds,
+		       b0, b1, b2, b3);
+      else
+	AESNI_ROUNDS4 (AESNI_DEC, AESNI_DECLAST, ctx->dec, rounds,
+		       b0, b1, b2, b3);
+      AESNI_STORE (data, b0 ^ t0);
+      AESNI_STORE (data + 16, b1 ^ t1);
+      AESNI_STORE (data + 32, b2 ^ t2);
+      AESNI_STORE (data + 48, b3 ^ t3);
+    }
+
+  for (; len >= 16; len -= 16, data += 16)
+    {
+      aesni_block b;
+
+      t = (aesni_block) { lo, hi };
+      XTS_MUL_X (lo, hi);
+      b = AESNI_LOAD (data) ^ t;
+      if (do_encrypt)
+	AESNI_ROUNDS1 (AESNI_ENC, AESNI_ENCLAST, ctx->enc, rounds, b);
+      else
+	AESNI_ROUNDS1 (AESNI_DEC, AESNI_DECLAST, ctx->dec, rounds, b);
+      AESNI_STORE (data, b ^ t);
+    }
+}
+
+static void __attribute__ ((target ("aes")))
+aesni_xts (const struct grub_cryptodisk_aesni *ctx, grub_uint8_t *data,
+	   grub_size_t len, const grub_uint8_t *iv, int do_encrypt)
+{
+  aesni_block t = AESNI_LOAD (iv);
+
+  AESNI_ROUNDS1 (AESNI_ENC, AESNI_ENCLAST, ctx->tweak, ctx->rounds, t);
+  aesni_xts_blocks (ctx, data, len, t, do_encrypt);
+}
+
+/* Run XTS over the consecutive sectors in LEN bytes of DATA, the first
+   being SECTOR, with plain or plain64 IVs, i.e. the sector number masked
+   with IV_MASK.  The IVs need no other setup, so the tweaks of four
+   sectors are encrypted at once.  */
+static void __attribute__ ((target ("aes")))
+aesni_xts_plain (const struct grub_cryptodisk_aesni *ctx, grub_uint8_t *data,
+		 grub_size_t len, unsigned log_sector_size,
+		 grub_disk_addr_t sector, grub_uint64_t iv_mask, int do_encrypt)
+{
+  grub_size_t sector_size = (grub_size_t) 1 << log_sector_size;
+
+  while (len)
+    {
+      aesni_block t[4];
+      int k;
+
+      t[0] = (aesni_block) { sector & iv_mask, 0 };
+      t[1] = (aesni_block) { (sector + 1) & iv_mask, 0 };
+      t[2] = (aesni_block) { (sector + 2) & iv_mask, 0 };
+      t[3] = (aesni_block) { (sector + 3) & iv_mask, 0 };
+      AESNI_ROUNDS4 (AESNI_ENC, AESNI_ENCLAST, ctx->tweak, ctx->rounds,
+		     t[0], t[1], t[2], t[3]);
+
+      for (k = 0; k < 4 && len; k++)
+	{
+	  grub_size_t sz = len < sector_size ? len : sector_size;
+
+	  aesni_xts_blocks (ctx, data, sz, t[k], do_encrypt);
+	  data += sz;
+	  len -= sz;
+	  sector++;
+	}
+    }
+}
+
+static void __attribute__ ((target ("aes")))
+aesni_cbc_encrypt (const struct grub_cryptodisk_aesni *ctx,
+		   grub_uint8_t *data, grub_size_t len, const grub_uint8_t *iv)
+{
+  aesni_block b = AESNI_LOAD (iv);
+
+  for (; len >= 16; len -= 16, data += 16)
+    {
+      b ^= AESNI_LOAD (data);
+      AESNI_ROUNDS1 (AESNI_ENC, AESNI_ENCLAST, ctx->enc, ctx->rounds, b);
+      AESNI_STORE (data, b);
+    }
+}
+
+/* Unlike encryption, CBC decryption of the blocks is independent, so
+   four of them are interleaved.  */
+static void __attribute__ ((target ("aes")))
+aesni_cbc_decrypt (const struct grub_cryptodisk_aesni *ctx,
+		   grub_uint8_t *data, grub_size_t len, const grub_uint8_t *iv)
+{
+  int rounds = ctx->rounds;
+  aesni_block prev = AESNI_LOAD (iv);
+
+  for (; len >= 64; len -= 64, data += 64)
+    {
+      aesni_block c0, c1, c2, c3, b0, b1, b2, b3;
+
+      b0 = c0 = AESNI_LOAD (data);
+      b1 = c1 = AESNI_LOAD (data + 16);
+      b2 = c2 = AESNI_LOAD (data + 32);
+      b3 = c3 = AESNI_LOAD (data + 48);
+      AESNI_ROUNDS4 (AESNI_DEC, AESNI_DECLAST, ctx->dec, rounds,
+		     b0, b1, b2, b3);
+      AESNI_STORE (data, b0 ^ prev);
+      AESNI_STORE (data + 16, b1 ^ c0);
+      AESNI_STORE (data + 32, b2 ^ c1);
+      AESNI_STORE (data + 48, b3 ^ c2);
+      prev = c3;
+    }
+
+  for (; len >= 16; len -= 16, data += 16)
+    {
+      aesni_block c, b;
+
+      b = c = AESNI_LOAD (data);
+      AESNI_ROUNDS1 (AESNI_DEC, AESNI_DECLAST, ctx->dec, rounds, b);
+      AESNI_STORE (data, b ^ prev);
+      prev = c;
+    }
+}
+
+#endif
+
 static gcry_err_code_t
 grub_cryptodisk_endecrypt (struct grub_cryptodisk *dev,
 			   grub_uint8_t * data, grub_size_t len,
@@ -226,6 +641,20 @@ grub_cryptodisk_endecrypt (struct grub_cryptodisk *dev,
     return (do_encrypt ? grub_crypto_ecb_encrypt (dev->cipher, data, data, len)
 	    : grub_crypto_ecb_decrypt (dev->cipher, data, data, len));
 
+#ifdef CRYPTODISK_AESNI
+  /* Plain IVs are the sector number, so consecutive sectors can be done
+     in one go.  */
+  if (dev->aesni && dev->mode == GRUB_CRYPTODISK_MODE_XTS && !dev->rekey
+      && (dev->mode_iv == GRUB_CRYPTODISK_MODE_IV_PLAIN
+	  || dev->mode_iv == GRUB_CRYPTODISK_MODE_IV_PLAIN64))
+    {
+      aesni_xts_plain (dev->aesni, data, len, dev->log_sector_size, sector,
+		       dev->mode_iv == GRUB_CRYPTODISK_MODE_IV_PLAIN
+		       ? 0xffffffff : ~(grub_uint64_t) 0, do_encrypt);
+      return GPG_ERR_NO_ERROR;
+    }
+#endif
+
   for (i = 0; i < len; i += (1U << dev->log_sector_size))
     {
       grub_size_t sz = ((dev->cipher->cipher->blocksize
@@ -294,6 +723,20 @@ grub_cryptodisk_endecrypt (struct grub_cryptodisk *dev,
       switch (dev->mode)
 	{
 	case GRUB_CRYPTODISK_MODE_CBC:
+#ifdef CRYPTODISK_AESNI
+	  if (dev->aesni)
+	    {
+	      if (do_encrypt)
+		aesni_cbc_encrypt (dev->aesni, data + i,
+				   (1U << dev->log_sector_size),
+				   (grub_uint8_t *) iv);
+	      else
+		aesni_cbc_decrypt (dev->aesni, data + i,
+				   (1U << dev->log_sector_size),
+				   (grub_uint8_t *) iv);
+	      break;
+	    }
+#endif
 	  if (do_encrypt)
 	    err = grub_crypto_cbc_encrypt (dev->cipher, data + i, data + i,
 					   (1U << dev->log_sector_size), iv);
@@ -315,33 +758,21 @@ grub_cryptodisk_endecrypt (struct grub_cryptodisk *dev,
 	    return err;
 	  break;
 	case GRUB_CRYPTODISK_MODE_XTS:
-	  {
-	    unsigned j;
-	    err = grub_crypto_ecb_encrypt (dev->secondary_cipher, iv, iv,
-					   dev->cipher->cipher->blocksize);
-	    if (err)
-	      return err;
-	    
-	    for (j = 0; j < (1U << dev->log_sector_size);
-		 j += dev->cipher->cipher->blocksize)
-	      {
-		grub_crypto_xor (data + i + j, data + i + j, iv,
-				 dev->cipher->cipher->blocksize);
-		if (do_encrypt)
-		  err = grub_crypto_ecb_encrypt (dev->cipher, data + i + j, 
-						 data + i + j,
-						 dev->cipher->cipher->blocksize);
-		else
-		  err = grub_crypto_ecb_decrypt (dev->cipher, data + i + j, 
-						 data + i + j,
-						 dev->cipher->cipher->blocksize);
-		if (err)
-		  return err;
-		grub_crypto_xor (data + i + j, data + i + j, iv,
-				 dev->cipher->cipher->blocksize);
-		gf_mul_x ((grub_uint8_t *) iv);
-	      }
-	  }
+#ifdef CRYPTODISK_AESNI
+	  if (dev->aesni)
+	    {
+	      aesni_xts (dev->aesni, data + i, (1U << dev->log_sector_size),
+			 (grub_uint8_t *) iv, do_encrypt);
+	      break;
+	    }
+#endif
+	  err = grub_crypto_ecb_encrypt (dev->secondary_cipher, iv, iv,
+					 dev->cipher->cipher->blocksize);
+	  if (err)
+	    return err;
+	  err = xts_endecrypt (dev, data + i, (grub_uint8_t *) iv, do_encrypt);
+	  if (err)
+	    return err;
 	  break;
 	case GRUB_CRYPTODISK_MODE_LRW:
 	  {
@@ -444,6 +875,10 @@ grub_cryptodisk_setkey (grub_cryptodisk_t dev, grub_uint8_t *key, grub_size_t ke
 	  gf_mul_be (dev->lrw_precalc + i, idx, dev->lrw_key);
 	}
     }
+
+#ifdef CRYPTODISK_AESNI
+  aesni_setkey (dev, key, real_keysize, keysize);
+#endif
   return GPG_ERR_NO_ERROR;
 }
 
@@ -669,6 +1104,7 @@ cryptodisk_cleanup (void)
       grub_free (dev->cipher);
       grub_free (dev->secondary_cipher);
       grub_free (dev->essiv_cipher);
+      grub_free (dev->aesni);
       tmp = dev->next;
       grub_free (dev);
       dev = tmp;
@@ -779,9 +1215,134 @@ cryptodisk_close (grub_cryptodisk_t dev)
   grub_crypto_cipher_close (dev->cipher);
   grub_crypto_cipher_close (dev->secondary_cipher);
   grub_crypto_cipher_close (dev->essiv_cipher);
+  grub_free (dev->aesni);
   grub_free (dev);
 }
 
+/* The modes measured by cryptobench.  */
+static const struct
+{
+  const char *name;
+  grub_cryptodisk_mode_t mode;
+  grub_size_t keysize;
+} bench_modes[] =
+  {
+    { "aes-xts-plain64, 256-bit key", GRUB_CRYPTODISK_MODE_XTS, 32 },
+    { "aes-xts-plain64, 512-bit key", GRUB_CRYPTODISK_MODE_XTS, 64 },
+    { "aes-cbc-plain64, 128-bit key", GRUB_CRYPTODISK_MODE_CBC, 16 },
+    { "aes-cbc-plain64, 256-bit key", GRUB_CRYPTODISK_MODE_CBC, 32 },
+  };
+
+/* Decrypt SIZE bytes of BUF with DEV and return the speed in MiB/s.  */
+static unsigned long
+bench_decrypt (grub_cryptodisk_t dev, grub_uint8_t *buf, grub_size_t size)
+{
+  grub_uint64_t start, elapsed;
+
+  start = grub_get_time_ms ();
+  grub_cryptodisk_decrypt (dev, buf, size, 0);
+  elapsed = grub_get_time_ms () - start;
+  if (elapsed == 0)
+    elapsed = 1;
+  return (unsigned long) (((grub_uint64_t) size * 1000 / elapsed) >> 20);
+}
+
+static grub_err_t
+grub_cmd_cryptobench (grub_command_t cmd __attribute__ ((unused)),
+		      int argc, char **args)
+{
+  const gcry_cipher_spec_t *aes;
+  grub_uint8_t key[64];
+  grub_uint8_t *buf, *ref = NULL;
+  grub_size_t size = 16 << 20;
+  unsigned i;
+
+  if (argc > 0)
+    {
+      char *ptr;
+
+      size = grub_strtoul (args[0], &ptr, 0) << 20;
+      if (grub_errno)
+	return grub_errno;
+      if (*ptr || !size)
+	return grub_error (GRUB_ERR_BAD_ARGUMENT, N_("invalid size"));
+    }
+
+  aes = grub_crypto_lookup_cipher_by_name ("aes");
+  if (!aes)
+    return grub_error (GRUB_ERR_FILE_NOT_FOUND, N_("unknown cipher `%s'"),
+		       "aes");
+
+  buf = grub_malloc (size);
+  if (!buf)
+    return grub_errno;
+#ifdef CRYPTODISK_AESNI
+  ref = grub_malloc (size);
+  if (!ref)
+    {
+      grub_free (buf);
+      return grub_errno;
+    }
+#endif
+
+  for (i = 0; i < sizeof (key); i++)
+    key[i] = i * 7 + 1;
+
+  for (i = 0; i < ARRAY_SIZE (bench_modes); i++)
+    {
+      struct grub_cryptodisk *dev;
+      struct grub_cryptodisk_aesni *aesni;
+      grub_size_t j;
+
+      for (j = 0; j < size; j++)
+	buf[j] = j * 13 + (j >> 9);
+
+      dev = grub_zalloc (sizeof (*dev));
+      if (!dev)
+	break;
+      dev->mode = bench_modes[i].mode;
+      dev->mode_iv = GRUB_CRYPTODISK_MODE_IV_PLAIN64;
+      dev->log_sector_size = GRUB_DISK_SECTOR_BITS;
+      dev->cipher = grub_crypto_cipher_open (aes);
+      if (dev->mode == GRUB_CRYPTODISK_MODE_XTS)
+	dev->secondary_cipher = grub_crypto_cipher_open (aes);
+      if (!dev->cipher
+	  || (dev->mode == GRUB_CRYPTODISK_MODE_XTS && !dev->secondary_cipher)
+	  || grub_cryptodisk_setkey (dev, key, bench_modes[i].keysize))
+	{
+	  cryptodisk_close (dev);
+	  if (!grub_errno)
+	    grub_error (GRUB_ERR_BAD_ARGUMENT, N_("cannot set key"));
+	  break;
+	}
+
+      if (ref)
+	grub_memcpy (ref, buf, size);
+
+      /* Hide the AES-NI keys to measure the generic cipher.  */
+      aesni = dev->aesni;
+      dev->aesni = NULL;
+      grub_printf ("%s: generic %lu MiB/s", bench_modes[i].name,
+		   bench_decrypt (dev, buf, size));
+      dev->aesni = aesni;
+
+      if (aesni)
+	{
+	  unsigned long speed;
+
+	  speed = bench_decrypt (dev, ref, size);
+	  grub_printf (", AES-NI %lu MiB/s%s", speed,
+		       grub_memcmp (buf, ref, size) == 0 ? "" : " (MISMATCH)");
+	}
+      grub_printf ("\n");
+      cryptodisk_close (dev);
+    }
+
+  grub_free (ref);
+  grub_free (buf);
+  return grub_errno;
+}
+
 static grub_err_t
 grub_cryptodisk_scan_device_real (const char *name, grub_disk_t source)
 {
@@ -966,6 +1527,7 @@ static struct grub_disk_dev grub_cryptodisk_dev = {
 };
 
 static grub_extcmd_t cmd;
+static grub_command_t cmd_bench;
 
 GRUB_MOD_INIT (cryptodisk)
 {
@@ -973,10 +1535,15 @@ GRUB_MOD_INIT (cryptodisk)
   cmd = grub_register_extcmd ("cryptomount", grub_cmd_cryptomount, 0,
 			      N_("SOURCE|-u UUID|-a|-b"),
 			      N_("Mount a crypto device."), options);
+  cmd_bench = grub_register_command ("cryptobench", grub_cmd_cryptobench,
+				     N_("[SIZE_MIB]"),
+				     N_("Measure the speed of the AES disk"
+					" encryption modes."));
 }
 
 GRUB_MOD_FINI (cryptodisk)
 {
   grub_disk_dev_unregister (&grub_cryptodisk_dev);
+  grub_unregister_command (cmd_bench);
   cryptodisk_cleanup ();
 }
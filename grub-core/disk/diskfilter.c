@@ -24,8 +24,9 @@
 #include <grub/misc.h>
 #include <grub/diskfilter.h>
 #include <grub/partition.h>
-#ifdef GRUB_UTIL
+#include <grub/command.h>
 #include <grub/i18n.h>
+#ifdef GRUB_UTIL
 #include <grub/util/misc.h>
 #endif
 
@@ -483,9 +484,13 @@ grub_diskfilter_read_node (const struct grub_diskfilter_node *node,
   if (node->pv)
     {
       if (node->pv->disk)
-	return grub_disk_read (node->pv->disk, sector + node->start
-			       + node->pv->start_sector,
-			       0, size << GRUB_DISK_SECTOR_BITS, buf);
+	{
+	  node->pv->read_requests++;
+	  node->pv->read_bytes += size << GRUB_DISK_SECTOR_BITS;
+	  return grub_disk_read (node->pv->disk, sector + node->start
+				 + node->pv->start_sector,
+				 0, size << GRUB_DISK_SECTOR_BITS, buf);
+	}
       else
 	return grub_error (GRUB_ERR_UNKNOWN_DEVICE,
 			   N_("physical volume %s not found"), node->pv->name);
@@ -496,9 +501,99 @@ grub_diskfilter_read_node (const struct grub_diskfilter_node *node,
   return grub_error (GRUB_ERR_UNKNOWN_DEVICE, "unknown node '%s'", node->name);
 }
 
+/* The stripe units of a read, gathered by read_segment_real instead of
+   being read one after the other.  */
+struct read_plan
+{
+  struct read_plan_unit
+  {
+    const struct grub_diskfilter_node *node;
+    grub_disk_addr_t sector;
+    grub_size_t size;
+    char *buf;
+  } *units;
+  unsigned count;
+  unsigned max;
+  /* Set if a unit couldn't be planned.  */
+  int failed;
+};
+
+/* Read SIZE sectors at SECTOR of NODE into BUF, or only add them to PLAN
+   if there is one.  Planning always succeeds as far as the caller can
+   tell, so that it goes on with the next stripe unit.  */
 static grub_err_t
-read_segment (struct grub_diskfilter_segment *seg, grub_disk_addr_t sector,
-	      grub_size_t size, char *buf)
+read_node (struct read_plan *plan, const struct grub_diskfilter_node *node,
+	   grub_disk_addr_t sector, grub_size_t size, char *buf)
+{
+  struct read_plan_unit *unit;
+
+  if (! plan)
+    return grub_diskfilter_read_node (node, sector, size, buf);
+
+  if (plan->failed)
+    return GRUB_ERR_NONE;
+
+  if (! node->pv || ! node->pv->disk || plan->count == plan->max)
+    {
+      plan->failed = 1;
+      return GRUB_ERR_NONE;
+    }
+
+  unit = &plan->units[plan->count++];
+  unit->node = node;
+  unit->sector = sector + node->start + node->pv->start_sector;
+  unit->size = size;
+  unit->buf = buf;
+  return GRUB_ERR_NONE;
+}
+
+/* Read the units of PLAN with one vectored request per member, so that
+   the units which follow each other on a member are read at once.  */
+static grub_err_t
+read_plan_run (struct read_plan *plan)
+{
+  struct grub_disk_read_vec *vec;
+  unsigned i, j, n;
+  grub_err_t err = GRUB_ERR_NONE;
+
+  vec = grub_malloc (plan->count * sizeof (*vec));
+  if (! vec)
+    return grub_errno;
+
+  for (i = 0; i < plan->count && ! err; i++)
+    {
+      struct grub_diskfilter_pv *pv;
+
+      if (! plan->units[i].node)
+	continue;
+
+      pv = plan->units[i].node->pv;
+      n = 0;
+      for (j = i; j < plan->count; j++)
+	{
+	  if (! plan->units[j].node || plan->units[j].node->pv != pv)
+	    continue;
+	  vec[n].sector = plan->units[j].sector;
+	  vec[n].offset = 0;
+	  vec[n].size = plan->units[j].size << GRUB_DISK_SECTOR_BITS;
+	  vec[n].buf = plan->units[j].buf;
+	  pv->read_bytes += vec[n].size;
+	  plan->units[j].node = NULL;
+	  n++;
+	}
+
+      pv->read_requests++;
+      err = grub_disk_read_vec (pv->disk, vec, n);
+    }
+
+  grub_free (vec);
+  return err;
+}
+
+static grub_err_t
+read_segment_real (struct grub_diskfilter_segment *seg,
+		   grub_disk_addr_t sector, grub_size_t size, char *buf,
+		   struct read_plan *plan)
 {
   grub_err_t err;
   switch (seg->type)
@@ -564,11 +659,9 @@ read_segment (struct grub_diskfilter_segment *seg, grub_disk_addr_t sector,
 			|| grub_errno == GRUB_ERR_UNKNOWN_DEVICE)
 		      grub_errno = GRUB_ERR_NONE;
 
-		    err = grub_diskfilter_read_node (&seg->nodes[k],
-						     read_sector
-						     + j * far_ofs + b,
-						     read_size,
-						     buf);
+		    err = read_node (plan, &seg->nodes[k],
+				     read_sector + j * far_ofs + b,
+				     read_size, buf);
 		    if (! err)
 		      break;
 		    else if (err != GRUB_ERR_READ_ERROR
@@ -669,10 +762,8 @@ read_segment (struct grub_diskfilter_segment *seg, grub_disk_addr_t sector,
 		|| grub_errno == GRUB_ERR_UNKNOWN_DEVICE)
 	      grub_errno = GRUB_ERR_NONE;
 
-	    err = grub_diskfilter_read_node (&seg->nodes[disknr],
-					     read_sector + b,
-					     read_size,
-					     buf);
+	    err = read_node (plan, &seg->nodes[disknr],
+			     read_sector + b, read_size, buf);
 
 	    if ((err) && (err != GRUB_ERR_READ_ERROR
 			  && err != GRUB_ERR_UNKNOWN_DEVICE))
@@ -771,6 +862,38 @@ read_segment (struct grub_diskfilter_segment *seg, grub_disk_addr_t sector,
     }
 }
 
+/* Read SIZE sectors at SECTOR of SEG into BUF.  Reads spanning several
+   stripe units are first planned and issued per member.  If that fails,
+   for instance because a member is missing or broken, the units are read
+   one at a time, which recovers from the redundancy if there is any.  */
+static grub_err_t
+read_segment (struct grub_diskfilter_segment *seg, grub_disk_addr_t sector,
+	      grub_size_t size, char *buf)
+{
+  if (seg->node_count > 1 && seg->stripe_size && size > seg->stripe_size)
+    {
+      struct read_plan plan;
+      grub_err_t err;
+
+      plan.count = 0;
+      plan.failed = 0;
+      plan.max = grub_divmod64 (size, seg->stripe_size, 0) + 2;
+      plan.units = grub_malloc (plan.max * sizeof (plan.units[0]));
+      if (plan.units)
+	{
+	  err = read_segment_real (seg, sector, size, buf, &plan);
+	  if (! err && ! plan.failed)
+	    err = read_plan_run (&plan);
+	  grub_free (plan.units);
+	  if (! err && ! plan.failed)
+	    return GRUB_ERR_NONE;
+	}
+      grub_errno = GRUB_ERR_NONE;
+    }
+
+  return read_segment_real (seg, sector, size, buf, NULL);
+}
+
 static grub_err_t
 read_lv (struct grub_diskfilter_lv *lv, grub_disk_addr_t sector,
 	 grub_size_t size, char *buf)
@@ -1183,6 +1306,27 @@ grub_diskfilter_get_pv_from_disk (grub_disk_t disk,
 }
 #endif
 
+static grub_err_t
+grub_cmd_diskfilterinfo (grub_command_t cmd __attribute__ ((unused)),
+			 int argc __attribute__ ((unused)),
+			 char **args __attribute__ ((unused)))
+{
+  struct grub_diskfilter_vg *vg;
+  struct grub_diskfilter_pv *pv;
+
+  for (vg = array_list; vg; vg = vg->next)
+    {
+      grub_printf ("%s:\n", vg->name ? : "(unnamed)");
+      for (pv = vg->pvs; pv; pv = pv->next)
+	grub_printf_ (N_("  %s: %lu requests, %llu KiB read\n"),
+		      pv->name ? : (pv->disk ? pv->disk->name : "(missing)"),
+		      pv->read_requests,
+		      (unsigned long long) (pv->read_bytes >> 10));
+    }
+
+  return GRUB_ERR_NONE;
+}
+
 static struct grub_disk_dev grub_diskfilter_dev =
   {
     .name = "diskfilter",
@@ -1200,13 +1344,19 @@ static struct grub_disk_dev grub_diskfilter_dev =
   };
 
 
+static grub_command_t cmd_info;
+
 GRUB_MOD_INIT(diskfilter)
 {
   grub_disk_dev_register (&grub_diskfilter_dev);
+  cmd_info = grub_register_command ("diskfilterinfo", grub_cmd_diskfilterinfo,
+				    0, N_("Show the reads done on the members"
+					  " of RAID arrays and LVM volumes."));
 }
 
 GRUB_MOD_FINI(diskfilter)
 {
+  grub_unregister_command (cmd_info);
   grub_disk_dev_unregister (&grub_diskfilter_dev);
   free_array ();
 }
@@ -46,6 +46,7 @@ grub_memdisk_open (const char *name, grub_disk_t disk)
       return grub_error (GRUB_ERR_UNKNOWN_DEVICE, "not a memdisk");
 
   disk->total_sectors = memdisk_size / GRUB_DISK_SECTOR_SIZE;
+  disk->nocache = 1;
   disk->id = (unsigned long) "mdsk";
 
   return GRUB_ERR_NONE;
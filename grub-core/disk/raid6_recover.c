@@ -24,6 +24,7 @@
 #include <grub/misc.h>
 #include <grub/diskfilter.h>
 #include <grub/crypto.h>
+#include <grub/gf256.h>
 
 GRUB_MOD_LICENSE ("GPLv3+");
 
@@ -33,18 +34,6 @@ static grub_uint8_t powx[255 * 2];
 static int powx_inv[256];
 static const grub_uint8_t poly = 0x1d;
 
-static void
-grub_raid_block_mulx (int mul, char *buf, int size)
-{
-  int i;
-  grub_uint8_t *p;
-
-  p = (grub_uint8_t *) buf;
-  for (i = 0; i < size; i++, p++)
-    if (*p)
-      *p = powx[mul + powx_inv[*p]];
-}
-
 static void
 grub_raid6_init_table (void)
 {
@@ -70,6 +59,7 @@ grub_raid6_recover (struct grub_diskfilter_segment *array, int disknr, int p,
   int i, q, pos;
   int bad1 = -1, bad2 = -1;
   char *pbuf = 0, *qbuf = 0;
+  struct grub_gf256_mul_table t;
 
   size <<= GRUB_DISK_SECTOR_BITS;
   pbuf = grub_zalloc (size);
@@ -103,8 +93,9 @@ grub_raid6_recover (struct grub_diskfilter_segment *array, int disknr, int p,
 					   size >> GRUB_DISK_SECTOR_BITS, buf))
             {
               grub_crypto_xor (pbuf, pbuf, buf, size);
-              grub_raid_block_mulx (c, buf, size);
-              grub_crypto_xor (qbuf, qbuf, buf, size);
+              grub_gf256_mul_prepare (&t, powx[c]);
+              grub_gf256_mul ((grub_uint8_t *) qbuf, (grub_uint8_t *) buf,
+			      size, &t, 1);
             }
           else
             {
@@ -142,8 +133,8 @@ grub_raid6_recover (struct grub_diskfilter_segment *array, int disknr, int p,
         goto quit;
 
       grub_crypto_xor (buf, buf, qbuf, size);
-      grub_raid_block_mulx (255 - bad1, buf,
-                           size);
+      grub_gf256_mul_prepare (&t, powx[255 - bad1]);
+      grub_gf256_mul ((grub_uint8_t *) buf, (grub_uint8_t *) buf, size, &t, 0);
     }
   else
     {
@@ -163,13 +154,14 @@ grub_raid6_recover (struct grub_diskfilter_segment *array, int disknr, int p,
       grub_crypto_xor (qbuf, qbuf, buf, size);
 
       c = (255 - bad1 + (255 - powx_inv[(powx[bad2 - bad1 + 255] ^ 1)])) % 255;
-      grub_raid_block_mulx (c, qbuf, size);
+      grub_gf256_mul_prepare (&t, powx[c]);
+      grub_gf256_mul ((grub_uint8_t *) buf, (grub_uint8_t *) qbuf,
+		      size, &t, 0);
 
       c = (bad2 + c) % 255;
-      grub_raid_block_mulx (c, pbuf, size);
-
-      grub_crypto_xor (pbuf, pbuf, qbuf, size);
-      grub_memcpy (buf, pbuf, size);
+      grub_gf256_mul_prepare (&t, powx[c]);
+      grub_gf256_mul ((grub_uint8_t *) buf, (grub_uint8_t *) pbuf,
+		      size, &t, 1);
     }
 
 quit:
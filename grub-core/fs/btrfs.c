@@ -65,7 +65,10 @@ struct grub_btrfs_superblock
   grub_uint64_t chunk_tree;
   grub_uint8_t dummy2[0x20];
   grub_uint64_t root_dir_objectid;
-  grub_uint8_t dummy3[0x41];
+  grub_uint64_t num_devices;
+  grub_uint32_t sectorsize;
+  grub_uint32_t nodesize;
+  grub_uint8_t dummy3[0x31];
   struct grub_btrfs_device this_device;
   char label[0x100];
   grub_uint8_t dummy4[0x100];
@@ -76,7 +79,8 @@ struct btrfs_header
 {
   grub_btrfs_checksum_t checksum;
   grub_btrfs_uuid_t uuid;
-  grub_uint8_t dummy[0x30];
+  grub_uint64_t bytenr;
+  grub_uint8_t dummy[0x28];
   grub_uint32_t nitems;
   grub_uint8_t level;
 } __attribute__ ((packed));
@@ -87,6 +91,37 @@ struct grub_btrfs_device_desc
   grub_uint64_t id;
 };
 
+/* The largest supported tree node.  */
+#define GRUB_BTRFS_MAX_NODESIZE 0x10000
+
+/* The number of tree nodes, chunk items and extents cached per mount.  */
+#define GRUB_BTRFS_NODE_CACHE_SIZE 32
+#define GRUB_BTRFS_CHUNK_CACHE_SIZE 16
+#define GRUB_BTRFS_EXTENT_CACHE_SIZE 16
+
+struct grub_btrfs_node_cache
+{
+  grub_disk_addr_t addr;
+  grub_uint8_t *node;
+  unsigned long last_use;
+};
+
+struct grub_btrfs_chunk_cache
+{
+  grub_uint64_t start;
+  struct grub_btrfs_chunk_item *chunk;
+};
+
+struct grub_btrfs_extent_cache
+{
+  grub_uint64_t start;
+  grub_uint64_t end;
+  grub_uint64_t ino;
+  grub_uint64_t tree;
+  grub_size_t size;
+  struct grub_btrfs_extent_data *extent;
+};
+
 struct grub_btrfs_data
 {
   struct grub_btrfs_superblock sblock;
@@ -97,13 +132,17 @@ struct grub_btrfs_data
   unsigned n_devices_attached;
   unsigned n_devices_allocated;
 
-  /* Cached extent data.  */
-  grub_uint64_t extstart;
-  grub_uint64_t extend;
-  grub_uint64_t extino;
-  grub_uint64_t exttree;
-  grub_size_t extsize;
-  struct grub_btrfs_extent_data *extent;
+  /* Tree nodes, least recently used first to go.  */
+  struct grub_btrfs_node_cache nodes[GRUB_BTRFS_NODE_CACHE_SIZE];
+  unsigned long node_use;
+
+  /* Chunk items read from the chunk tree, replaced in turn.  */
+  struct grub_btrfs_chunk_cache chunks[GRUB_BTRFS_CHUNK_CACHE_SIZE];
+  unsigned next_chunk;
+
+  /* Consecutive extents of one inode.  */
+  struct grub_btrfs_extent_cache extents[GRUB_BTRFS_EXTENT_CACHE_SIZE];
+  unsigned n_extents;
 };
 
 enum
@@ -330,6 +369,64 @@ save_ref (struct grub_btrfs_leaf_descriptor *desc,
   return GRUB_ERR_NONE;
 }
 
+/* Return in *NODE the tree node at ADDR, reading it unless it's cached.
+   The node is only valid until the next call.  */
+static grub_err_t
+grub_btrfs_read_node (struct grub_btrfs_data *data, grub_disk_addr_t addr,
+		      grub_uint8_t **node, int recursion_depth)
+{
+  grub_uint32_t nodesize = grub_le_to_cpu32 (data->sblock.nodesize);
+  struct grub_btrfs_node_cache *victim;
+  struct btrfs_header *head;
+  grub_size_t itemsize;
+  grub_uint8_t *buf;
+  grub_err_t err;
+  unsigned i;
+
+  for (i = 0; i < ARRAY_SIZE (data->nodes); i++)
+    if (data->nodes[i].node && data->nodes[i].addr == addr)
+      {
+	data->nodes[i].last_use = ++data->node_use;
+	*node = data->nodes[i].node;
+	return GRUB_ERR_NONE;
+      }
+
+  buf = grub_malloc (nodesize);
+  if (!buf)
+    return grub_errno;
+  err = grub_btrfs_read_logical (data, addr, buf, nodesize, recursion_depth);
+  if (err)
+    {
+      grub_free (buf);
+      return err;
+    }
+
+  /* Make sure the node is where it's expected and that its items fit,
+     so that they can be accessed in memory.  */
+  head = (struct btrfs_header *) buf;
+  itemsize = head->level ? sizeof (struct grub_btrfs_internal_node)
+    : sizeof (struct grub_btrfs_leaf_node);
+  if (grub_le_to_cpu64 (head->bytenr) != addr
+      || grub_le_to_cpu32 (head->nitems) > (nodesize - sizeof (*head)) / itemsize)
+    {
+      grub_free (buf);
+      return grub_error (GRUB_ERR_BAD_FS, "invalid tree node at 0x%"
+			 PRIxGRUB_UINT64_T, addr);
+    }
+
+  /* Reading may have used other entries, so only pick one now.  */
+  victim = &data->nodes[0];
+  for (i = 1; i < ARRAY_SIZE (data->nodes); i++)
+    if (data->nodes[i].last_use < victim->last_use)
+      victim = &data->nodes[i];
+  grub_free (victim->node);
+  victim->addr = addr;
+  victim->node = buf;
+  victim->last_use = ++data->node_use;
+  *node = buf;
+  return GRUB_ERR_NONE;
+}
+
 static int
 next (struct grub_btrfs_data *data,
       struct grub_btrfs_leaf_descriptor *desc,
@@ -337,7 +434,8 @@ next (struct grub_btrfs_data *data,
       struct grub_btrfs_key *key_out)
 {
   grub_err_t err;
-  struct grub_btrfs_leaf_node leaf;
+  grub_uint8_t *node;
+  struct grub_btrfs_leaf_node *leaf;
 
   for (; desc->depth > 0; desc->depth--)
     {
@@ -350,36 +448,35 @@ next (struct grub_btrfs_data *data,
     return 0;
   while (!desc->data[desc->depth - 1].leaf)
     {
-      struct grub_btrfs_internal_node node;
-      struct btrfs_header head;
-
-      err = grub_btrfs_read_logical (data, desc->data[desc->depth - 1].iter
-				     * sizeof (node)
-				     + sizeof (struct btrfs_header)
-				     + desc->data[desc->depth - 1].addr,
-				     &node, sizeof (node), 0);
+      struct grub_btrfs_internal_node *inode;
+      struct btrfs_header *head;
+      grub_disk_addr_t addr;
+
+      err = grub_btrfs_read_node (data, desc->data[desc->depth - 1].addr,
+				  &node, 0);
       if (err)
 	return -err;
+      inode = (struct grub_btrfs_internal_node *)
+	(node + sizeof (struct btrfs_header));
+      addr = grub_le_to_cpu64 (inode[desc->data[desc->depth - 1].iter].addr);
 
-      err = grub_btrfs_read_logical (data, grub_le_to_cpu64 (node.addr),
-				     &head, sizeof (head), 0);
+      err = grub_btrfs_read_node (data, addr, &node, 0);
       if (err)
 	return -err;
+      head = (struct btrfs_header *) node;
 
-      save_ref (desc, grub_le_to_cpu64 (node.addr), 0,
-		grub_le_to_cpu32 (head.nitems), !head.level);
+      save_ref (desc, addr, 0, grub_le_to_cpu32 (head->nitems), !head->level);
     }
-  err = grub_btrfs_read_logical (data, desc->data[desc->depth - 1].iter
-				 * sizeof (leaf)
-				 + sizeof (struct btrfs_header)
-				 + desc->data[desc->depth - 1].addr, &leaf,
-				 sizeof (leaf), 0);
+  err = grub_btrfs_read_node (data, desc->data[desc->depth - 1].addr,
+			      &node, 0);
   if (err)
     return -err;
-  *outsize = grub_le_to_cpu32 (leaf.size);
+  leaf = (struct grub_btrfs_leaf_node *) (node + sizeof (struct btrfs_header))
+    + desc->data[desc->depth - 1].iter;
+  *outsize = grub_le_to_cpu32 (leaf->size);
   *outaddr = desc->data[desc->depth - 1].addr + sizeof (struct btrfs_header)
-    + grub_le_to_cpu32 (leaf.offset);
-  *key_out = leaf.key;
+    + grub_le_to_cpu32 (leaf->offset);
+  *key_out = leaf->key;
   return 1;
 }
 
@@ -417,122 +514,111 @@ lower_bound (struct grub_btrfs_data *data,
   while (1)
     {
       grub_err_t err;
-      struct btrfs_header head;
+      grub_uint8_t *node;
+      struct btrfs_header *head;
 
     reiter:
       depth++;
-      /* FIXME: preread few nodes into buffer. */
-      err = grub_btrfs_read_logical (data, addr, &head, sizeof (head),
-				     recursion_depth + 1);
+      err = grub_btrfs_read_node (data, addr, &node, recursion_depth + 1);
       if (err)
 	return err;
-      addr += sizeof (head);
-      if (head.level)
+      head = (struct btrfs_header *) node;
+      if (head->level)
 	{
 	  unsigned i;
-	  struct grub_btrfs_internal_node node, node_last;
-	  int have_last = 0;
-	  grub_memset (&node_last, 0, sizeof (node_last));
-	  for (i = 0; i < grub_le_to_cpu32 (head.nitems); i++)
-	    {
-	      err = grub_btrfs_read_logical (data, addr + i * sizeof (node),
-					     &node, sizeof (node),
-					     recursion_depth + 1);
-	      if (err)
-		return err;
+	  struct grub_btrfs_internal_node *inode, *node_last = NULL;
 
+	  inode = (struct grub_btrfs_internal_node *) (head + 1);
+	  for (i = 0; i < grub_le_to_cpu32 (head->nitems); i++)
+	    {
 	      grub_dprintf ("btrfs",
 			    "internal node (depth %d) %" PRIxGRUB_UINT64_T
 			    " %x %" PRIxGRUB_UINT64_T "\n", depth,
-			    node.key.object_id, node.key.type,
-			    node.key.offset);
+			    inode[i].key.object_id, inode[i].key.type,
+			    inode[i].key.offset);
 
-	      if (key_cmp (&node.key, key_in) == 0)
+	      if (key_cmp (&inode[i].key, key_in) == 0)
 		{
 		  err = GRUB_ERR_NONE;
 		  if (desc)
-		    err = save_ref (desc, addr - sizeof (head), i,
-				    grub_le_to_cpu32 (head.nitems), 0);
+		    err = save_ref (desc, addr, i,
+				    grub_le_to_cpu32 (head->nitems), 0);
 		  if (err)
 		    return err;
-		  addr = grub_le_to_cpu64 (node.addr);
+		  addr = grub_le_to_cpu64 (inode[i].addr);
 		  goto reiter;
 		}
-	      if (key_cmp (&node.key, key_in) > 0)
+	      if (key_cmp (&inode[i].key, key_in) > 0)
 		break;
-	      node_last = node;
-	      have_last = 1;
+	      node_last = &inode[i];
 	    }
-	  if (have_last)
+	  if (node_last)
 	    {
 	      err = GRUB_ERR_NONE;
 	      if (desc)
-		err = save_ref (desc, addr - sizeof (head), i - 1,
-				grub_le_to_cpu32 (head.nitems), 0);
+		err = save_ref (desc, addr, i - 1,
+				grub_le_to_cpu32 (head->nitems), 0);
 	      if (err)
 		return err;
-	      addr = grub_le_to_cpu64 (node_last.addr);
+	      addr = grub_le_to_cpu64 (node_last->addr);
 	      goto reiter;
 	    }
 	  *outsize = 0;
 	  *outaddr = 0;
 	  grub_memset (key_out, 0, sizeof (*key_out));
 	  if (desc)
-	    return save_ref (desc, addr - sizeof (head), -1,
-			     grub_le_to_cpu32 (head.nitems), 0);
+	    return save_ref (desc, addr, -1,
+			     grub_le_to_cpu32 (head->nitems), 0);
 	  return GRUB_ERR_NONE;
 	}
       {
 	unsigned i;
-	struct grub_btrfs_leaf_node leaf, leaf_last;
-	int have_last = 0;
-	for (i = 0; i < grub_le_to_cpu32 (head.nitems); i++)
-	  {
-	    err = grub_btrfs_read_logical (data, addr + i * sizeof (leaf),
-					   &leaf, sizeof (leaf),
-					   recursion_depth + 1);
-	    if (err)
-	      return err;
+	struct grub_btrfs_leaf_node *leaf, *leaf_last = NULL;
 
+	leaf = (struct grub_btrfs_leaf_node *) (head + 1);
+	for (i = 0; i < grub_le_to_cpu32 (head->nitems); i++)
+	  {
 	    grub_dprintf ("btrfs",
 			  "leaf (depth %d) %" PRIxGRUB_UINT64_T
 			  " %x %" PRIxGRUB_UINT64_T "\n", depth,
-			  leaf.key.object_id, leaf.key.type, leaf.key.offset);
+			  leaf[i].key.object_id, leaf[i].key.type,
+			  leaf[i].key.offset);
 
-	    if (key_cmp (&leaf.key, key_in) == 0)
+	    if (key_cmp (&leaf[i].key, key_in) == 0)
 	      {
-		grub_memcpy (key_out, &leaf.key, sizeof (*key_out));
-		*outsize = grub_le_to_cpu32 (leaf.size);
-		*outaddr = addr + grub_le_to_cpu32 (leaf.offset);
+		grub_memcpy (key_out, &leaf[i].key, sizeof (*key_out));
+		*outsize = grub_le_to_cpu32 (leaf[i].size);
+		*outaddr = addr + sizeof (*head)
+		  + grub_le_to_cpu32 (leaf[i].offset);
 		if (desc)
-		  return save_ref (desc, addr - sizeof (head), i,
-				   grub_le_to_cpu32 (head.nitems), 1);
+		  return save_ref (desc, addr, i,
+				   grub_le_to_cpu32 (head->nitems), 1);
 		return GRUB_ERR_NONE;
 	      }
 
-	    if (key_cmp (&leaf.key, key_in) > 0)
+	    if (key_cmp (&leaf[i].key, key_in) > 0)
 	      break;
 
-	    have_last = 1;
-	    leaf_last = leaf;
+	    leaf_last = &leaf[i];
 	  }
 
-	if (have_last)
+	if (leaf_last)
 	  {
-	    grub_memcpy (key_out, &leaf_last.key, sizeof (*key_out));
-	    *outsize = grub_le_to_cpu32 (leaf_last.size);
-	    *outaddr = addr + grub_le_to_cpu32 (leaf_last.offset);
+	    grub_memcpy (key_out, &leaf_last->key, sizeof (*key_out));
+	    *outsize = grub_le_to_cpu32 (leaf_last->size);
+	    *outaddr = addr + sizeof (*head)
+	      + grub_le_to_cpu32 (leaf_last->offset);
 	    if (desc)
-	      return save_ref (desc, addr - sizeof (head), i - 1,
-			       grub_le_to_cpu32 (head.nitems), 1);
+	      return save_ref (desc, addr, i - 1,
+			       grub_le_to_cpu32 (head->nitems), 1);
 	    return GRUB_ERR_NONE;
 	  }
 	*outsize = 0;
 	*outaddr = 0;
 	grub_memset (key_out, 0, sizeof (*key_out));
 	if (desc)
-	  return save_ref (desc, addr - sizeof (head), -1,
-			   grub_le_to_cpu32 (head.nitems), 1);
+	  return save_ref (desc, addr, -1,
+			   grub_le_to_cpu32 (head->nitems), 1);
 	return GRUB_ERR_NONE;
       }
     }
@@ -615,19 +701,56 @@ find_device (struct grub_btrfs_data *data, grub_uint64_t id, int do_rescan)
   return dev_found;
 }
 
+/* Copy SIZE bytes at ADDR to BUF if they are within a cached tree node,
+   as is usually the case for items just found.  */
+static int
+grub_btrfs_read_cached (struct grub_btrfs_data *data, grub_disk_addr_t addr,
+			void *buf, grub_size_t size)
+{
+  grub_uint32_t nodesize = grub_le_to_cpu32 (data->sblock.nodesize);
+  unsigned i;
+
+  for (i = 0; i < ARRAY_SIZE (data->nodes); i++)
+    if (data->nodes[i].node && data->nodes[i].addr <= addr
+	&& addr - data->nodes[i].addr <= nodesize
+	&& size <= nodesize - (addr - data->nodes[i].addr))
+      {
+	grub_memcpy (buf, data->nodes[i].node + (addr - data->nodes[i].addr),
+		     size);
+	return 1;
+      }
+  return 0;
+}
+
+static struct grub_btrfs_chunk_cache *
+find_cached_chunk (struct grub_btrfs_data *data, grub_disk_addr_t addr)
+{
+  unsigned i;
+
+  for (i = 0; i < ARRAY_SIZE (data->chunks); i++)
+    if (data->chunks[i].chunk && data->chunks[i].start <= addr
+	&& addr - data->chunks[i].start
+	< grub_le_to_cpu64 (data->chunks[i].chunk->size))
+      return &data->chunks[i];
+  return NULL;
+}
+
 static grub_err_t
 grub_btrfs_read_logical (struct grub_btrfs_data *data, grub_disk_addr_t addr,
 			 void *buf, grub_size_t size, int recursion_depth)
 {
+  if (grub_btrfs_read_cached (data, addr, buf, size))
+    return GRUB_ERR_NONE;
+
   while (size > 0)
     {
+      struct grub_btrfs_chunk_cache *cached;
       grub_uint8_t *ptr;
       struct grub_btrfs_key *key;
       struct grub_btrfs_chunk_item *chunk;
       grub_uint64_t csize;
       grub_err_t err = 0;
       struct grub_btrfs_key key_out;
-      int challoc = 0;
       grub_device_t dev;
       struct grub_btrfs_key key_in;
       grub_size_t chsize;
@@ -657,6 +780,15 @@ grub_btrfs_read_logical (struct grub_btrfs_data *data, grub_disk_addr_t addr,
 	    * grub_le_to_cpu16 (chunk->nstripes);
 	}
 
+      cached = find_cached_chunk (data, addr);
+      if (cached)
+	{
+	  key_out.offset = grub_cpu_to_le64 (cached->start);
+	  key = &key_out;
+	  chunk = cached->chunk;
+	  goto chunk_found;
+	}
+
       key_in.object_id = grub_cpu_to_le64_compile_time (GRUB_BTRFS_OBJECT_ID_CHUNK);
       key_in.type = GRUB_BTRFS_ITEM_TYPE_CHUNK;
       key_in.offset = grub_cpu_to_le64 (addr);
@@ -667,7 +799,8 @@ grub_btrfs_read_logical (struct grub_btrfs_data *data, grub_disk_addr_t addr,
 	return err;
       key = &key_out;
       if (key->type != GRUB_BTRFS_ITEM_TYPE_CHUNK
-	  || !(grub_le_to_cpu64 (key->offset) <= addr))
+	  || !(grub_le_to_cpu64 (key->offset) <= addr)
+	  || chsize < sizeof (*chunk))
 	return grub_error (GRUB_ERR_BAD_FS,
 			   "couldn't find the chunk descriptor");
 
@@ -675,7 +808,6 @@ grub_btrfs_read_logical (struct grub_btrfs_data *data, grub_disk_addr_t addr,
       if (!chunk)
 	return grub_errno;
 
-      challoc = 1;
       err = grub_btrfs_read_logical (data, chaddr, chunk, chsize,
 				     recursion_depth);
       if (err)
@@ -684,6 +816,12 @@ grub_btrfs_read_logical (struct grub_btrfs_data *data, grub_disk_addr_t addr,
 	  return err;
 	}
 
+      /* Keep the chunk item for the next addresses in it.  */
+      cached = &data->chunks[data->next_chunk++ % ARRAY_SIZE (data->chunks)];
+      grub_free (cached->chunk);
+      cached->start = grub_le_to_cpu64 (key->offset);
+      cached->chunk = chunk;
+
     chunk_found:
       {
 	grub_uint64_t stripen;
@@ -833,8 +971,6 @@ grub_btrfs_read_logical (struct grub_btrfs_data *data, grub_disk_addr_t addr,
       size -= csize;
       buf = (grub_uint8_t *) buf + csize;
       addr += csize;
-      if (challoc)
-	grub_free (chunk);
     }
   return GRUB_ERR_NONE;
 }
@@ -862,6 +998,14 @@ grub_btrfs_mount (grub_device_t dev)
       return NULL;
     }
 
+  if (grub_le_to_cpu32 (data->sblock.nodesize) < sizeof (struct btrfs_header)
+      || grub_le_to_cpu32 (data->sblock.nodesize) > GRUB_BTRFS_MAX_NODESIZE)
+    {
+      grub_error (GRUB_ERR_BAD_FS, "unsupported node size");
+      grub_free (data);
+      return NULL;
+    }
+
   data->n_devices_allocated = 16;
   data->devices_attached = grub_malloc (sizeof (data->devices_attached[0])
 					* data->n_devices_allocated);
@@ -877,6 +1021,16 @@ grub_btrfs_mount (grub_device_t dev)
   return data;
 }
 
+static void
+free_extents (struct grub_btrfs_data *data)
+{
+  unsigned i;
+
+  for (i = 0; i < data->n_extents; i++)
+    grub_free (data->extents[i].extent);
+  data->n_extents = 0;
+}
+
 static void
 grub_btrfs_unmount (struct grub_btrfs_data *data)
 {
@@ -885,7 +1039,11 @@ grub_btrfs_unmount (struct grub_btrfs_data *data)
   for (i = 1; i < data->n_devices_attached; i++)
     grub_device_close (data->devices_attached[i].dev);
   grub_free (data->devices_attached);
-  grub_free (data->extent);
+  for (i = 0; i < ARRAY_SIZE (data->nodes); i++)
+    grub_free (data->nodes[i].node);
+  for (i = 0; i < ARRAY_SIZE (data->chunks); i++)
+    grub_free (data->chunks[i].chunk);
+  free_extents (data);
   grub_free (data);
 }
 
@@ -998,6 +1156,106 @@ grub_btrfs_lzo_decompress(char *ibuf, grub_size_t isize, grub_off_t off,
   return ret;
 }
 
+/* Add the extent item at ELEMADDR with key KEY to the cached ones.  */
+static grub_err_t
+add_extent (struct grub_btrfs_data *data, grub_uint64_t ino,
+	    grub_uint64_t tree, const struct grub_btrfs_key *key,
+	    grub_disk_addr_t elemaddr, grub_size_t elemsize)
+{
+  struct grub_btrfs_extent_cache *ext = &data->extents[data->n_extents];
+  grub_err_t err;
+
+  if ((grub_ssize_t) elemsize < ((char *) &ext->extent->inl
+				 - (char *) ext->extent))
+    return grub_error (GRUB_ERR_BAD_FS, "extent descriptor is too short");
+
+  ext->extent = grub_malloc (elemsize);
+  if (!ext->extent)
+    return grub_errno;
+
+  err = grub_btrfs_read_logical (data, elemaddr, ext->extent, elemsize, 0);
+  if (err)
+    {
+      grub_free (ext->extent);
+      return err;
+    }
+
+  ext->start = grub_le_to_cpu64 (key->offset);
+  ext->size = elemsize;
+  ext->ino = ino;
+  ext->tree = tree;
+  ext->end = ext->start + grub_le_to_cpu64 (ext->extent->size);
+  if (ext->extent->type == GRUB_BTRFS_EXTENT_REGULAR
+      && (char *) ext->extent + elemsize
+      >= (char *) &ext->extent->filled + sizeof (ext->extent->filled))
+    ext->end = ext->start + grub_le_to_cpu64 (ext->extent->filled);
+
+  grub_dprintf ("btrfs", "regular extent 0x%" PRIxGRUB_UINT64_T "+0x%"
+		PRIxGRUB_UINT64_T "\n",
+		grub_le_to_cpu64 (key->offset),
+		grub_le_to_cpu64 (ext->extent->size));
+  data->n_extents++;
+  return GRUB_ERR_NONE;
+}
+
+/* Find the extent of inode INO holding POS and cache it along with the
+   extents following it, which sequential reads need next.  */
+static struct grub_btrfs_extent_cache *
+cache_extents (struct grub_btrfs_data *data, grub_uint64_t ino,
+	       grub_uint64_t tree, grub_off_t pos)
+{
+  struct grub_btrfs_key key_in, key_out;
+  struct grub_btrfs_leaf_descriptor desc;
+  grub_disk_addr_t elemaddr;
+  grub_size_t elemsize;
+  grub_err_t err;
+
+  free_extents (data);
+
+  key_in.object_id = ino;
+  key_in.type = GRUB_BTRFS_ITEM_TYPE_EXTENT_ITEM;
+  key_in.offset = grub_cpu_to_le64 (pos);
+  err = lower_bound (data, &key_in, &key_out, tree,
+		     &elemaddr, &elemsize, &desc, 0);
+  if (err)
+    {
+      free_iterator (&desc);
+      return NULL;
+    }
+  if (key_out.object_id != ino
+      || key_out.type != GRUB_BTRFS_ITEM_TYPE_EXTENT_ITEM)
+    {
+      free_iterator (&desc);
+      grub_error (GRUB_ERR_BAD_FS, "extent not found");
+      return NULL;
+    }
+  err = add_extent (data, ino, tree, &key_out, elemaddr, elemsize);
+  if (err)
+    {
+      free_iterator (&desc);
+      return NULL;
+    }
+  if (data->extents[0].end <= pos)
+    {
+      free_iterator (&desc);
+      grub_error (GRUB_ERR_BAD_FS, "extent not found");
+      return NULL;
+    }
+
+  /* Whatever goes wrong with the following ones is reported if they are
+     actually needed.  */
+  while (data->n_extents < ARRAY_SIZE (data->extents)
+	 && next (data, &desc, &elemaddr, &elemsize, &key_out) > 0
+	 && key_out.object_id == ino
+	 && key_out.type == GRUB_BTRFS_ITEM_TYPE_EXTENT_ITEM
+	 && add_extent (data, ino, tree, &key_out, elemaddr, elemsize)
+	 == GRUB_ERR_NONE);
+  grub_errno = GRUB_ERR_NONE;
+
+  free_iterator (&desc);
+  return &data->extents[0];
+}
+
 static grub_ssize_t
 grub_btrfs_extent_read (struct grub_btrfs_data *data,
 			grub_uint64_t ino, grub_uint64_t tree,
@@ -1006,137 +1264,96 @@ grub_btrfs_extent_read (struct grub_btrfs_data *data,
   grub_off_t pos = pos0;
   while (len)
     {
+      struct grub_btrfs_extent_cache *ext = NULL;
       grub_size_t csize;
       grub_err_t err;
       grub_off_t extoff;
-      if (!data->extent || data->extstart > pos || data->extino != ino
-	  || data->exttree != tree || data->extend <= pos)
+      unsigned i;
+
+      for (i = 0; i < data->n_extents; i++)
+	if (data->extents[i].ino == ino && data->extents[i].tree == tree
+	    && data->extents[i].start <= pos && pos < data->extents[i].end)
+	  {
+	    ext = &data->extents[i];
+	    break;
+	  }
+      if (!ext)
 	{
-	  struct grub_btrfs_key key_in, key_out;
-	  grub_disk_addr_t elemaddr;
-	  grub_size_t elemsize;
-
-	  grub_free (data->extent);
-	  key_in.object_id = ino;
-	  key_in.type = GRUB_BTRFS_ITEM_TYPE_EXTENT_ITEM;
-	  key_in.offset = grub_cpu_to_le64 (pos);
-	  err = lower_bound (data, &key_in, &key_out, tree,
-			     &elemaddr, &elemsize, NULL, 0);
-	  if (err)
+	  ext = cache_extents (data, ino, tree, pos);
+	  if (!ext)
 	    return -1;
-	  if (key_out.object_id != ino
-	      || key_out.type != GRUB_BTRFS_ITEM_TYPE_EXTENT_ITEM)
-	    {
-	      grub_error (GRUB_ERR_BAD_FS, "extent not found");
-	      return -1;
-	    }
-	  if ((grub_ssize_t) elemsize < ((char *) &data->extent->inl
-					 - (char *) data->extent))
-	    {
-	      grub_error (GRUB_ERR_BAD_FS, "extent descriptor is too short");
-	      return -1;
-	    }
-	  data->extstart = grub_le_to_cpu64 (key_out.offset);
-	  data->extsize = elemsize;
-	  data->extent = grub_malloc (elemsize);
-	  data->extino = ino;
-	  data->exttree = tree;
-	  if (!data->extent)
-	    return grub_errno;
-
-	  err = grub_btrfs_read_logical (data, elemaddr, data->extent,
-					 elemsize, 0);
-	  if (err)
-	    return err;
-
-	  data->extend = data->extstart + grub_le_to_cpu64 (data->extent->size);
-	  if (data->extent->type == GRUB_BTRFS_EXTENT_REGULAR
-	      && (char *) &data->extent + elemsize
-	      >= (char *) &data->extent->filled + sizeof (data->extent->filled))
-	    data->extend =
-	      data->extstart + grub_le_to_cpu64 (data->extent->filled);
-
-	  grub_dprintf ("btrfs", "regular extent 0x%" PRIxGRUB_UINT64_T "+0x%"
-			PRIxGRUB_UINT64_T "\n",
-			grub_le_to_cpu64 (key_out.offset),
-			grub_le_to_cpu64 (data->extent->size));
-	  if (data->extend <= pos)
-	    {
-	      grub_error (GRUB_ERR_BAD_FS, "extent not found");
-	      return -1;
-	    }
 	}
-      csize = data->extend - pos;
-      extoff = pos - data->extstart;
+      csize = ext->end - pos;
+      extoff = pos - ext->start;
       if (csize > len)
 	csize = len;
 
-      if (data->extent->encryption)
+      if (ext->extent->encryption)
 	{
 	  grub_error (GRUB_ERR_NOT_IMPLEMENTED_YET,
 		      "encryption not supported");
 	  return -1;
 	}
 
-      if (data->extent->compression != GRUB_BTRFS_COMPRESSION_NONE
-	  && data->extent->compression != GRUB_BTRFS_COMPRESSION_ZLIB
-	  && data->extent->compression != GRUB_BTRFS_COMPRESSION_LZO)
+      if (ext->extent->compression != GRUB_BTRFS_COMPRESSION_NONE
+	  && ext->extent->compression != GRUB_BTRFS_COMPRESSION_ZLIB
+	  && ext->extent->compression != GRUB_BTRFS_COMPRESSION_LZO)
 	{
 	  grub_error (GRUB_ERR_NOT_IMPLEMENTED_YET,
 		      "compression type 0x%x not supported",
-		      data->extent->compression);
+		      ext->extent->compression);
 	  return -1;
 	}
 
-      if (data->extent->encoding)
+      if (ext->extent->encoding)
 	{
 	  grub_error (GRUB_ERR_NOT_IMPLEMENTED_YET, "encoding not supported");
 	  return -1;
 	}
 
-      switch (data->extent->type)
+      switch (ext->extent->type)
 	{
 	case GRUB_BTRFS_EXTENT_INLINE:
-	  if (data->extent->compression == GRUB_BTRFS_COMPRESSION_ZLIB)
+	  if (ext->extent->compression == GRUB_BTRFS_COMPRESSION_ZLIB)
 	    {
-	      if (grub_zlib_decompress (data->extent->inl, data->extsize -
-					((grub_uint8_t *) data->extent->inl
-					 - (grub_uint8_t *) data->extent),
+	      if (grub_zlib_decompress (ext->extent->inl, ext->size -
+					((grub_uint8_t *) ext->extent->inl
+					 - (grub_uint8_t *) ext->extent),
 					extoff, buf, csize)
 		  != (grub_ssize_t) csize)
 		return -1;
 	    }
-	  else if (data->extent->compression == GRUB_BTRFS_COMPRESSION_LZO)
+	  else if (ext->extent->compression == GRUB_BTRFS_COMPRESSION_LZO)
 	    {
-	      if (grub_btrfs_lzo_decompress(data->extent->inl, data->extsize -
-					   ((grub_uint8_t *) data->extent->inl
-					    - (grub_uint8_t *) data->extent),
+	      if (grub_btrfs_lzo_decompress(ext->extent->inl, ext->size -
+					   ((grub_uint8_t *) ext->extent->inl
+					    - (grub_uint8_t *) ext->extent),
 					   extoff, buf, csize)
 		  != (grub_ssize_t) csize)
 		return -1;
 	    }
 	  else
-	    grub_memcpy (buf, data->extent->inl + extoff, csize);
+	    grub_memcpy (buf, ext->extent->inl + extoff, csize);
 	  break;
 	case GRUB_BTRFS_EXTENT_REGULAR:
-	  if (!data->extent->laddr)
+	  if (!ext->extent->laddr)
 	    {
 	      grub_memset (buf, 0, csize);
 	      break;
 	    }
 
-	  if (data->extent->compression != GRUB_BTRFS_COMPRESSION_NONE)
+	  if (ext->extent->compression != GRUB_BTRFS_COMPRESSION_NONE)
 	    {
 	      char *tmp;
 	      grub_uint64_t zsize;
 	      grub_ssize_t ret;
 
-	      zsize = grub_le_to_cpu64 (data->extent->compressed_size);
+	      zsize = grub_le_to_cpu64 (ext->extent->compressed_size);
 	      tmp = grub_malloc (zsize);
 	      if (!tmp)
 		return -1;
 	      err = grub_btrfs_read_logical (data,
-					     grub_le_to_cpu64 (data->extent->laddr),
+					     grub_le_to_cpu64 (ext->extent->laddr),
 					     tmp, zsize, 0);
 	      if (err)
 		{
@@ -1144,13 +1361,13 @@ grub_btrfs_extent_read (struct grub_btrfs_data *data,
 		  return -1;
 		}
 
-	      if (data->extent->compression == GRUB_BTRFS_COMPRESSION_ZLIB)
+	      if (ext->extent->compression == GRUB_BTRFS_COMPRESSION_ZLIB)
 		ret = grub_zlib_decompress (tmp, zsize, extoff
-				    + grub_le_to_cpu64 (data->extent->offset),
+				    + grub_le_to_cpu64 (ext->extent->offset),
 				    buf, csize);
-	      else if (data->extent->compression == GRUB_BTRFS_COMPRESSION_LZO)
+	      else if (ext->extent->compression == GRUB_BTRFS_COMPRESSION_LZO)
 		ret = grub_btrfs_lzo_decompress (tmp, zsize, extoff
-				    + grub_le_to_cpu64 (data->extent->offset),
+				    + grub_le_to_cpu64 (ext->extent->offset),
 				    buf, csize);
 	      else
 		ret = -1;
@@ -1163,15 +1380,15 @@ grub_btrfs_extent_read (struct grub_btrfs_data *data,
 	      break;
 	    }
 	  err = grub_btrfs_read_logical (data,
-					 grub_le_to_cpu64 (data->extent->laddr)
-					 + grub_le_to_cpu64 (data->extent->offset)
+					 grub_le_to_cpu64 (ext->extent->laddr)
+					 + grub_le_to_cpu64 (ext->extent->offset)
 					 + extoff, buf, csize, 0);
 	  if (err)
 	    return -1;
 	  break;
 	default:
 	  grub_error (GRUB_ERR_NOT_IMPLEMENTED_YET,
-		      "unsupported extent type 0x%x", data->extent->type);
+		      "unsupported extent type 0x%x", ext->extent->type);
 	  return -1;
 	}
       buf += csize;
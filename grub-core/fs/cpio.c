@@ -129,6 +129,47 @@ struct grub_cpio_data
 
 static grub_dl_t my_mod;
 
+/* The headers of an archive, so that opening a file or listing a
+   directory doesn't need to read all headers before it.  Archives are
+   mounted again for every open, so the indexes of the last few are
+   kept.  */
+#define INDEX_ARCHIVES	4
+#define INDEX_NONE	((grub_size_t) -1)
+
+struct index_entry
+{
+  char *name;
+  /* Where grub_cpio_find_file reads the entry from.  */
+  grub_off_t hofs;
+  grub_int32_t mtime;
+  grub_uint32_t mode;
+  /* Set for symlinks that handle_symlink follows.  */
+  int link;
+  /* The next entry with the same hash, in archive order.  */
+  grub_size_t next;
+};
+
+struct grub_cpio_index
+{
+  struct grub_cpio_index *next;
+  /* One for the list of indexes and one for every directory listing
+     going through it, since the hooks may open files and thereby drop
+     the index from the list.  */
+  unsigned refs;
+  struct grub_disk_key key;
+  struct index_entry *entries;
+  grub_size_t nentries;
+  grub_size_t *hash;
+  grub_size_t hash_size;
+  /* Set if the header at END couldn't be read.  */
+  int truncated;
+  grub_off_t end;
+};
+
+/* The most recently used index comes first.  */
+static struct grub_cpio_index *indexes;
+static grub_uint64_t index_last_time;
+
 static inline void
 canonicalize (char *name)
 {
@@ -422,6 +463,222 @@ fail:
   return 0;
 }
 
+static grub_size_t
+index_hash (const char *name, grub_size_t len)
+{
+  grub_uint32_t hash = 2166136261U;
+
+  while (len--)
+    hash = (hash ^ (grub_uint8_t) *name++) * 16777619U;
+
+  return hash;
+}
+
+static void
+index_free (struct grub_cpio_index *index)
+{
+  grub_size_t i;
+
+  for (i = 0; i < index->nentries; i++)
+    grub_free (index->entries[i].name);
+  grub_free (index->entries);
+  grub_free (index->hash);
+  grub_free (index);
+}
+
+static void
+index_unref (struct grub_cpio_index *index)
+{
+  if (--index->refs == 0)
+    index_free (index);
+}
+
+static void
+index_flush (void)
+{
+  while (indexes)
+    {
+      struct grub_cpio_index *index = indexes;
+      indexes = index->next;
+      index_unref (index);
+    }
+}
+
+/* Read all headers of the archive.  */
+static struct grub_cpio_index *
+index_build (struct grub_cpio_data *data)
+{
+  struct grub_cpio_index *index;
+  grub_size_t alloc = 0, i;
+
+  index = grub_zalloc (sizeof (*index));
+  if (!index)
+    return NULL;
+
+  data->hofs = 0;
+  while (1)
+    {
+      struct index_entry *e;
+      grub_off_t hofs = data->hofs;
+      grub_disk_addr_t ofs;
+      grub_int32_t mtime;
+      grub_uint32_t mode;
+      grub_size_t linksize;
+      char *name;
+
+      if (grub_cpio_find_file (data, &name, &mtime, &ofs, &mode))
+	{
+	  /* Keep the entries before it, the error is raised again when
+	     a lookup gets this far.  */
+	  grub_errno = GRUB_ERR_NONE;
+	  index->truncated = 1;
+	  index->end = hofs;
+	  break;
+	}
+
+      if (!ofs)
+	break;
+
+      if (index->nentries == alloc)
+	{
+	  struct index_entry *n;
+
+	  alloc = alloc ? 2 * alloc : 64;
+	  n = grub_realloc (index->entries, alloc * sizeof (index->entries[0]));
+	  if (!n)
+	    {
+	      grub_free (name);
+	      index_free (index);
+	      return NULL;
+	    }
+	  index->entries = n;
+	}
+
+#ifdef MODE_USTAR
+      linksize = grub_strlen (data->linkname);
+#else
+      linksize = data->size;
+#endif
+      e = &index->entries[index->nentries++];
+      e->name = name;
+      e->hofs = hofs;
+      e->mtime = mtime;
+      e->mode = mode;
+      e->link = (mode & ATTR_TYPE) == ATTR_LNK && linksize != 0;
+      data->hofs = ofs;
+    }
+
+  for (index->hash_size = 16; index->hash_size < index->nentries;
+       index->hash_size <<= 1);
+  index->hash = grub_malloc (index->hash_size * sizeof (index->hash[0]));
+  if (!index->hash)
+    {
+      index_free (index);
+      return NULL;
+    }
+  for (i = 0; i < index->hash_size; i++)
+    index->hash[i] = INDEX_NONE;
+
+  /* Chain the entries in archive order.  */
+  for (i = index->nentries; i-- > 0; )
+    {
+      struct index_entry *e = &index->entries[i];
+      grub_size_t h = index_hash (e->name, grub_strlen (e->name))
+	& (index->hash_size - 1);
+
+      e->next = index->hash[h];
+      index->hash[h] = i;
+    }
+
+  return index;
+}
+
+static struct grub_cpio_index *
+index_get (struct grub_cpio_data *data)
+{
+  struct grub_cpio_index **p, *index;
+  struct grub_disk_key key;
+  unsigned n;
+
+  if (grub_disk_cache_expired (&index_last_time))
+    index_flush ();
+  grub_disk_get_key (data->disk, &key);
+
+  for (p = &indexes; *p; p = &(*p)->next)
+    {
+      index = *p;
+      if (grub_disk_key_equal (&index->key, &key))
+	{
+	  *p = index->next;
+	  index->next = indexes;
+	  indexes = index;
+	  return index;
+	}
+    }
+
+  index = index_build (data);
+  if (!index)
+    return NULL;
+  index->key = key;
+  index->refs = 1;
+  index->next = indexes;
+  indexes = index;
+
+  for (n = 1, p = &indexes->next; *p; p = &(*p)->next, n++)
+    if (n == INDEX_ARCHIVES)
+      {
+	index_unref (*p);
+	*p = NULL;
+	break;
+      }
+
+  return index;
+}
+
+/* Raise the error that stopped reading the headers of INDEX.  */
+static grub_err_t
+index_error (struct grub_cpio_data *data, struct grub_cpio_index *index)
+{
+  grub_disk_addr_t ofs;
+  char *name;
+
+  data->hofs = index->end;
+  if (grub_cpio_find_file (data, &name, NULL, &ofs, NULL))
+    return grub_errno;
+  if (ofs)
+    grub_free (name);
+  return grub_error (GRUB_ERR_BAD_FS, "invalid archive");
+}
+
+/* Find the first entry that opening NAME stops at: either NAME itself
+   or a symlink to one of its parent directories.  */
+static grub_size_t
+index_lookup (struct grub_cpio_index *index, const char *name)
+{
+  grub_size_t best = INDEX_NONE, len = grub_strlen (name), k, i;
+
+  for (k = 0; k <= len; k++)
+    {
+      if (k != len && name[k] != '/')
+	continue;
+
+      for (i = index->hash[index_hash (name, k) & (index->hash_size - 1)];
+	   i != INDEX_NONE && i < best; i = index->entries[i].next)
+	{
+	  struct index_entry *e = &index->entries[i];
+
+	  if (grub_memcmp (e->name, name, k) == 0 && e->name[k] == 0
+	      && (k == len || e->link))
+	    {
+	      best = i;
+	      break;
+	    }
+	}
+    }
+
+  return best;
+}
+
 static grub_err_t
 handle_symlink (struct grub_cpio_data *data,
 		const char *fn, char **name,
@@ -517,9 +774,9 @@ grub_cpio_dir (grub_device_t device, const char *path_in,
 			    const struct grub_dirhook_info *info))
 {
   struct grub_cpio_data *data;
-  grub_disk_addr_t ofs;
+  struct grub_cpio_index *index = NULL;
   char *prev, *name, *path, *ptr;
-  grub_size_t len;
+  grub_size_t len, i;
   int symlinknest = 0;
 
   path = grub_strdup (path_in + 1);
@@ -540,25 +797,26 @@ grub_cpio_dir (grub_device_t device, const char *path_in,
       return grub_errno;
     }
 
+  index = index_get (data);
+  if (!index)
+    goto fail;
+  index->refs++;
+
   len = grub_strlen (path);
-  data->hofs = 0;
-  while (1)
+  for (i = 0; i < index->nentries; i++)
     {
-      grub_int32_t mtime;
-      grub_uint32_t mode;
+      struct index_entry *e = &index->entries[i];
       grub_err_t err;
 
-      if (grub_cpio_find_file (data, &name, &mtime, &ofs, &mode))
-	goto fail;
-
-      if (!ofs)
-	break;
-
-      if (grub_memcmp (path, name, len) == 0
-	  && (name[len] == 0 || name[len] == '/' || len == 0))
+      if (grub_memcmp (path, e->name, len) == 0
+	  && (e->name[len] == 0 || e->name[len] == '/' || len == 0))
 	{
 	  char *p, *n;
 
+	  name = grub_strdup (e->name);
+	  if (!name)
+	    goto fail;
+
 	  n = name + len;
 	  while (*n == '/')
 	    n++;
@@ -571,8 +829,8 @@ grub_cpio_dir (grub_device_t device, const char *path_in,
 	    {
 	      struct grub_dirhook_info info;
 	      grub_memset (&info, 0, sizeof (info));
-	      info.dir = (p != NULL) || ((mode & ATTR_TYPE) == ATTR_DIR);
-	      info.mtime = mtime;
+	      info.dir = (p != NULL) || ((e->mode & ATTR_TYPE) == ATTR_DIR);
+	      info.mtime = e->mtime;
 	      info.mtimeset = 1;
 
 	      if (hook (n, &info))
@@ -586,7 +844,23 @@ grub_cpio_dir (grub_device_t device, const char *path_in,
 	  else
 	    {
 	      int restart = 0;
-	      err = handle_symlink (data, name, &path, mode, &restart);
+
+	      err = GRUB_ERR_NONE;
+	      /* Other entries are left alone by handle_symlink.  */
+	      if (e->link)
+		{
+		  grub_disk_addr_t ofs;
+		  char *fn;
+
+		  data->hofs = e->hofs;
+		  err = grub_cpio_find_file (data, &fn, NULL, &ofs, NULL);
+		  if (!err)
+		    {
+		      grub_free (fn);
+		      err = handle_symlink (data, name, &path, e->mode,
+					    &restart);
+		    }
+		}
 	      grub_free (name);
 	      if (err)
 		goto fail;
@@ -599,17 +873,20 @@ grub_cpio_dir (grub_device_t device, const char *path_in,
 				  N_("too deep nesting of symlinks"));
 		      goto fail;
 		    }
-		  ofs = 0;
+		  /* Start over.  */
+		  i = INDEX_NONE;
 		}
 	    }
 	}
-      else
-	grub_free (name);
-      data->hofs = ofs;
     }
 
+  if (index->truncated)
+    index_error (data, index);
+
 fail:
 
+  if (index)
+    index_unref (index);
   grub_free (path);
   grub_free (prev);
 #ifdef MODE_USTAR
@@ -626,6 +903,7 @@ static grub_err_t
 grub_cpio_open (grub_file_t file, const char *name_in)
 {
   struct grub_cpio_data *data;
+  struct grub_cpio_index *index;
   grub_disk_addr_t ofs;
   char *fn;
   char *name = grub_strdup (name_in + 1);
@@ -645,21 +923,31 @@ grub_cpio_open (grub_file_t file, const char *name_in)
       return grub_errno;
     }
 
-  data->hofs = 0;
+  index = index_get (data);
+  if (!index)
+    goto fail;
+
   while (1)
     {
       grub_uint32_t mode;
       int restart;
-      
-      if (grub_cpio_find_file (data, &fn, NULL, &ofs, &mode))
-	goto fail;
+      grub_size_t i;
 
-      if (!ofs)
+      i = index_lookup (index, name);
+      if (i == INDEX_NONE)
 	{
-	  grub_error (GRUB_ERR_FILE_NOT_FOUND, N_("file `%s' not found"), name_in);
+	  if (index->truncated)
+	    index_error (data, index);
+	  else
+	    grub_error (GRUB_ERR_FILE_NOT_FOUND, N_("file `%s' not found"),
+			name_in);
 	  break;
 	}
 
+      data->hofs = index->entries[i].hofs;
+      if (grub_cpio_find_file (data, &fn, NULL, &ofs, &mode))
+	goto fail;
+
       if (handle_symlink (data, fn, &name, mode, &restart))
 	{
 	  grub_free (fn);
@@ -668,18 +956,23 @@ grub_cpio_open (grub_file_t file, const char *name_in)
 
       if (restart)
 	{
-	  ofs = 0;
+	  grub_free (fn);
 	  if (++symlinknest == 8)
 	    {
 	      grub_error (GRUB_ERR_SYMLINK_LOOP,
 			  N_("too deep nesting of symlinks"));
 	      goto fail;
 	    }
-	  goto no_match;
+	  continue;
 	}
 
       if (grub_strcmp (name, fn) != 0)
-	goto no_match;
+	{
+	  grub_free (fn);
+	  grub_error (GRUB_ERR_FILE_NOT_FOUND, N_("file `%s' not found"),
+		      name_in);
+	  break;
+	}
 
       file->data = data;
       file->size = data->size;
@@ -687,11 +980,6 @@ grub_cpio_open (grub_file_t file, const char *name_in)
       grub_free (name);
 
       return GRUB_ERR_NONE;
-
-    no_match:
-
-      grub_free (fn);
-      data->hofs = ofs;
     }
 
 fail:
@@ -781,4 +1069,5 @@ GRUB_MOD_FINI (cpio)
 #endif
 {
   grub_fs_unregister (&grub_cpio_fs);
+  index_flush ();
 }
@@ -392,50 +392,6 @@ grub_ext2_read_block (grub_fshelp_node_t node, grub_disk_addr_t fileblock)
   unsigned int blksz = EXT2_BLOCK_SIZE (data);
   int log2_blksz = LOG2_EXT2_BLOCK_SIZE (data);
 
-  if (inode->flags & grub_cpu_to_le32_compile_time (EXT4_EXTENTS_FLAG))
-    {
-      GRUB_PROPERLY_ALIGNED_ARRAY (buf, EXT2_BLOCK_SIZE(data));
-      struct grub_ext4_extent_header *leaf;
-      struct grub_ext4_extent *ext;
-      int i;
-
-      leaf = grub_ext4_find_leaf (data, buf,
-                                  (struct grub_ext4_extent_header *) inode->blocks.dir_blocks,
-                                  fileblock);
-      if (! leaf)
-        {
-          grub_error (GRUB_ERR_BAD_FS, "invalid extent");
-          return -1;
-        }
-
-      ext = (struct grub_ext4_extent *) (leaf + 1);
-      for (i = 0; i < grub_le_to_cpu16 (leaf->entries); i++)
-        {
-          if (fileblock < grub_le_to_cpu32 (ext[i].block))
-            break;
-        }
-
-      if (--i >= 0)
-        {
-          fileblock -= grub_le_to_cpu32 (ext[i].block);
-          if (fileblock >= grub_le_to_cpu16 (ext[i].len))
-            return 0;
-          else
-            {
-              grub_disk_addr_t start;
-
-              start = grub_le_to_cpu16 (ext[i].start_hi);
-              start = (start << 32) + grub_le_to_cpu32 (ext[i].start);
-
-              return fileblock + start;
-            }
-        }
-      else
-        {
-          grub_error (GRUB_ERR_BAD_FS, "something wrong with extent");
-          return -1;
-        }
-    }
   /* Direct blocks.  */
   if (fileblock < INDIRECT_BLOCKS)
     blknr = grub_le_to_cpu32 (inode->blocks.dir_blocks[fileblock]);
@@ -519,6 +475,78 @@ grub_ext2_read_block (grub_fshelp_node_t node, grub_disk_addr_t fileblock)
   return blknr;
 }
 
+/* Translate FILEBLOCK of NODE to a disk block and set *COUNT to the
+   number of blocks of the same extent starting with it.  A hole
+   (block 0) extends up to the next extent.  Block mapped files are
+   handled one block at a time.  */
+static grub_disk_addr_t
+grub_ext2_read_extent (grub_fshelp_node_t node, grub_disk_addr_t fileblock,
+		       grub_disk_addr_t *count)
+{
+  struct grub_ext2_data *data = node->data;
+  struct grub_ext2_inode *inode = &node->inode;
+
+  *count = 1;
+
+  if (inode->flags & grub_cpu_to_le32_compile_time (EXT4_EXTENTS_FLAG))
+    {
+      GRUB_PROPERLY_ALIGNED_ARRAY (buf, EXT2_BLOCK_SIZE(data));
+      struct grub_ext4_extent_header *leaf;
+      struct grub_ext4_extent *ext;
+      int i, entries;
+
+      leaf = grub_ext4_find_leaf (data, buf,
+                                  (struct grub_ext4_extent_header *) inode->blocks.dir_blocks,
+                                  fileblock);
+      if (! leaf)
+        {
+          grub_error (GRUB_ERR_BAD_FS, "invalid extent");
+          return -1;
+        }
+
+      ext = (struct grub_ext4_extent *) (leaf + 1);
+      entries = grub_le_to_cpu16 (leaf->entries);
+      for (i = 0; i < entries; i++)
+        {
+          if (fileblock < grub_le_to_cpu32 (ext[i].block))
+            break;
+        }
+
+      if (--i >= 0)
+        {
+          grub_disk_addr_t off = fileblock - grub_le_to_cpu32 (ext[i].block);
+
+          if (off >= grub_le_to_cpu16 (ext[i].len))
+            {
+              /* The hole ends where the next extent in this leaf starts.
+                 If this is the last one, the next leaf may begin right
+                 after FILEBLOCK.  */
+              if (i + 1 < entries)
+                *count = grub_le_to_cpu32 (ext[i + 1].block) - fileblock;
+              return 0;
+            }
+          else
+            {
+              grub_disk_addr_t start;
+
+              start = grub_le_to_cpu16 (ext[i].start_hi);
+              start = (start << 32) + grub_le_to_cpu32 (ext[i].start);
+
+              *count = grub_le_to_cpu16 (ext[i].len) - off;
+              return off + start;
+            }
+        }
+      else
+        {
+          grub_error (GRUB_ERR_BAD_FS, "something wrong with extent");
+          return -1;
+        }
+    }
+
+  return grub_ext2_read_block (node, fileblock);
+}
+
+
 /* Read LEN bytes from the file described by DATA starting with byte
    POS.  Return the amount of read bytes in READ.  */
 static grub_ssize_t
@@ -527,8 +555,8 @@ grub_ext2_read_file (grub_fshelp_node_t node,
 					unsigned offset, unsigned length),
 		     grub_off_t pos, grub_size_t len, char *buf)
 {
-  return grub_fshelp_read_file (node->data->disk, node, read_hook,
-				pos, len, buf, grub_ext2_read_block,
+  return grub_fshelp_read_file_extents (node->data->disk, node, read_hook,
+					pos, len, buf, grub_ext2_read_extent,
 				grub_cpu_to_le32 (node->inode.size)
 				| (((grub_off_t) grub_cpu_to_le32 (node->inode.size_high)) << 32),
 				LOG2_EXT2_BLOCK_SIZE (node->data), 0);
@@ -785,6 +813,34 @@ grub_ext2_iterate_dir (grub_fshelp_node_t dir,
   return 0;
 }
 
+static grub_uint64_t
+grub_ext2_node_id (grub_fshelp_node_t node)
+{
+  return node->ino;
+}
+
+static grub_fshelp_node_t
+grub_ext2_get_node (grub_fshelp_node_t dir, grub_uint64_t id)
+{
+  struct grub_fshelp_node *node;
+
+  node = grub_malloc (sizeof (struct grub_fshelp_node));
+  if (! node)
+    return 0;
+
+  node->data = dir->data;
+  node->ino = id;
+  node->inode_read = 0;
+
+  return node;
+}
+
+static const struct grub_fshelp_cache_ops grub_ext2_cache_ops =
+  {
+    .node_id = grub_ext2_node_id,
+    .get_node = grub_ext2_get_node
+  };
+
 /* Open a file named NAME and initialize FILE.  */
 static grub_err_t
 grub_ext2_open (struct grub_file *file, const char *name)
@@ -802,9 +858,10 @@ grub_ext2_open (struct grub_file *file, const char *name)
       goto fail;
     }
 
-  err = grub_fshelp_find_file (name, &data->diropen, &fdiro,
-			       grub_ext2_iterate_dir,
-			       grub_ext2_read_symlink, GRUB_FSHELP_REG);
+  err = grub_fshelp_find_file_cached (name, &data->diropen, &fdiro,
+				      grub_ext2_iterate_dir,
+				      grub_ext2_read_symlink, GRUB_FSHELP_REG,
+				      data->disk, &grub_ext2_cache_ops);
   if (err)
     goto fail;
 
@@ -898,8 +955,9 @@ grub_ext2_dir (grub_device_t device, const char *path,
   if (! data)
     goto fail;
 
-  grub_fshelp_find_file (path, &data->diropen, &fdiro, grub_ext2_iterate_dir,
-			 grub_ext2_read_symlink, GRUB_FSHELP_DIR);
+  grub_fshelp_find_file_cached (path, &data->diropen, &fdiro,
+				grub_ext2_iterate_dir, grub_ext2_read_symlink,
+				GRUB_FSHELP_DIR, data->disk, &grub_ext2_cache_ops);
   if (grub_errno)
     goto fail;
 
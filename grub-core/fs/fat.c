@@ -173,6 +173,19 @@ typedef struct grub_fat_dir_entry grub_fat_dir_node_t;
 
 #endif
 
+/* A run of consecutive clusters of a file: logical cluster LOGICAL and the
+   following LENGTH - 1 ones are stored from cluster CLUSTER on.  */
+struct grub_fat_run
+{
+  grub_uint32_t logical;
+  grub_uint32_t cluster;
+  grub_uint32_t length;
+};
+
+/* The size of the window of the FAT kept in memory.  */
+#define GRUB_FAT_CACHE_BITS	12
+#define GRUB_FAT_CACHE_SIZE	(1 << GRUB_FAT_CACHE_BITS)
+
 struct grub_fat_data
 {
   int logical_sector_bits;
@@ -199,6 +212,18 @@ struct grub_fat_data
   grub_uint32_t cur_cluster_num;
   grub_uint32_t cur_cluster;
 
+  /* The runs of the cluster chain of the file followed so far, up to
+     CUR_CLUSTER_NUM, and whether its end was reached.  */
+  struct grub_fat_run *runs;
+  unsigned num_runs;
+  unsigned alloc_runs;
+  int chain_end;
+
+  /* The part of the FAT starting at byte FAT_CACHE_BLOCK
+     << GRUB_FAT_CACHE_BITS, or ~0U if none.  */
+  grub_uint32_t fat_cache_block;
+  grub_uint8_t fat_cache[GRUB_FAT_CACHE_SIZE];
+
   grub_uint32_t uuid;
 };
 
@@ -442,6 +467,11 @@ grub_fat_mount (grub_disk_t disk)
   /* Start from the root directory.  */
   data->file_cluster = data->root_cluster;
   data->cur_cluster_num = ~0U;
+  data->runs = 0;
+  data->num_runs = 0;
+  data->alloc_runs = 0;
+  data->chain_end = 0;
+  data->fat_cache_block = ~0U;
   data->attr = GRUB_FAT_ATTR_DIRECTORY;
   return data;
 
@@ -452,6 +482,158 @@ grub_fat_mount (grub_disk_t disk)
   return 0;
 }
 
+static void
+grub_fat_free (struct grub_fat_data *data)
+{
+  if (data)
+    grub_free (data->runs);
+  grub_free (data);
+}
+
+/* Read the FAT entry of CLUSTER into *NEXT.  Entries are taken from a
+   window of the FAT kept in DATA, so that following a chain doesn't go
+   through the disk layer for every cluster.  */
+static grub_err_t
+grub_fat_next_cluster (grub_disk_t disk, struct grub_fat_data *data,
+		       grub_uint32_t cluster, grub_uint32_t *next)
+{
+  grub_uint32_t fat_offset, block, start;
+  grub_uint64_t fat_bytes;
+  unsigned entry_size = (data->fat_size + 7) >> 3;
+  grub_uint32_t next_cluster = 0;
+
+  /* Don't leave *NEXT unset on errors.  */
+  *next = 0;
+
+  switch (data->fat_size)
+    {
+    case 32:
+      fat_offset = cluster << 2;
+      break;
+    case 16:
+      fat_offset = cluster << 1;
+      break;
+    default:
+      /* case 12: */
+      fat_offset = cluster + (cluster >> 1);
+      break;
+    }
+
+  block = fat_offset >> GRUB_FAT_CACHE_BITS;
+  start = block << GRUB_FAT_CACHE_BITS;
+  fat_bytes = (grub_uint64_t) data->sectors_per_fat << GRUB_DISK_SECTOR_BITS;
+
+  if (fat_offset + entry_size <= start + GRUB_FAT_CACHE_SIZE
+      && fat_offset + entry_size <= fat_bytes)
+    {
+      if (block != data->fat_cache_block)
+	{
+	  grub_size_t size = GRUB_FAT_CACHE_SIZE;
+
+	  if (start + size > fat_bytes)
+	    size = fat_bytes - start;
+	  data->fat_cache_block = ~0U;
+	  if (grub_disk_read (disk, data->fat_sector, start, size,
+			      data->fat_cache))
+	    return grub_errno;
+	  data->fat_cache_block = block;
+	}
+      grub_memcpy (&next_cluster, data->fat_cache + fat_offset - start,
+		   entry_size);
+    }
+  /* An entry straddling the window, or outside of the FAT.  */
+  else if (grub_disk_read (disk, data->fat_sector, fat_offset, entry_size,
+			   (char *) &next_cluster))
+    return grub_errno;
+
+  next_cluster = grub_le_to_cpu32 (next_cluster);
+  switch (data->fat_size)
+    {
+    case 16:
+      next_cluster &= 0xFFFF;
+      break;
+    case 12:
+      if (cluster & 1)
+	next_cluster >>= 4;
+
+      next_cluster &= 0x0FFF;
+      break;
+    }
+
+  grub_dprintf ("fat", "fat_size=%d, next_cluster=%u\n",
+		data->fat_size, next_cluster);
+
+  *next = next_cluster;
+  return GRUB_ERR_NONE;
+}
+
+/* Follow the cluster chain of the file for one more cluster, recording it
+   in the runs.  Set CHAIN_END when the end of the chain is reached.  */
+static grub_err_t
+grub_fat_follow_chain (grub_disk_t disk, struct grub_fat_data *data)
+{
+  grub_uint32_t next_cluster;
+  struct grub_fat_run *run;
+
+  if (grub_fat_next_cluster (disk, data, data->cur_cluster, &next_cluster))
+    return grub_errno;
+
+  /* Check the end.  */
+  if (next_cluster >= data->cluster_eof_mark)
+    {
+      data->chain_end = 1;
+      return GRUB_ERR_NONE;
+    }
+
+  if (next_cluster < 2 || next_cluster >= data->num_clusters)
+    return grub_error (GRUB_ERR_BAD_FS, "invalid cluster %u", next_cluster);
+
+  run = &data->runs[data->num_runs - 1];
+  if (next_cluster != data->cur_cluster + 1)
+    {
+      if (data->num_runs == data->alloc_runs)
+	{
+	  struct grub_fat_run *runs;
+
+	  runs = grub_realloc (data->runs, 2 * data->alloc_runs
+			       * sizeof (data->runs[0]));
+	  if (! runs)
+	    return grub_errno;
+	  data->runs = runs;
+	  data->alloc_runs *= 2;
+	}
+      run = &data->runs[data->num_runs++];
+      run->logical = data->cur_cluster_num + 1;
+      run->cluster = next_cluster;
+      run->length = 0;
+    }
+  run->length++;
+
+  data->cur_cluster = next_cluster;
+  data->cur_cluster_num++;
+  return GRUB_ERR_NONE;
+}
+
+/* Return the run holding LOGICAL_CLUSTER, which must have been reached
+   already.  */
+static struct grub_fat_run *
+grub_fat_find_run (struct grub_fat_data *data, grub_uint32_t logical_cluster)
+{
+  unsigned lo = 0, hi = data->num_runs - 1;
+
+  while (lo < hi)
+    {
+      unsigned mid = (lo + hi + 1) / 2;
+
+      if (data->runs[mid].logical <= logical_cluster)
+	lo = mid;
+      else
+	hi = mid - 1;
+    }
+
+  return &data->runs[lo];
+}
+
 static grub_ssize_t
 grub_fat_read_data (grub_disk_t disk, struct grub_fat_data *data,
 		    void NESTED_FUNC_ATTR (*read_hook) (grub_disk_addr_t sector,
@@ -459,7 +641,7 @@ grub_fat_read_data (grub_disk_t disk, struct grub_fat_data *data,
 		    grub_off_t offset, grub_size_t len, char *buf)
 {
   grub_size_t size;
-  grub_uint32_t logical_cluster;
+  grub_uint32_t logical_cluster, last_cluster;
   unsigned logical_cluster_bits;
   grub_ssize_t ret = 0;
   unsigned long sector;
@@ -480,84 +662,59 @@ grub_fat_read_data (grub_disk_t disk, struct grub_fat_data *data,
     }
 #endif
 
+  if (! len)
+    return 0;
+
   /* Calculate the logical cluster number and offset.  */
   logical_cluster_bits = (data->cluster_bits
 			  + GRUB_DISK_SECTOR_BITS);
   logical_cluster = offset >> logical_cluster_bits;
+  last_cluster = (offset + len - 1) >> logical_cluster_bits;
   offset &= (1ULL << logical_cluster_bits) - 1;
 
-  if (logical_cluster < data->cur_cluster_num)
+  if (data->num_runs == 0)
     {
+      if (! data->runs)
+	{
+	  data->runs = grub_malloc (8 * sizeof (data->runs[0]));
+	  if (! data->runs)
+	    return -1;
+	  data->alloc_runs = 8;
+	}
+      data->runs[0].logical = 0;
+      data->runs[0].cluster = data->file_cluster;
+      data->runs[0].length = 1;
+      data->num_runs = 1;
       data->cur_cluster_num = 0;
       data->cur_cluster = data->file_cluster;
+      data->chain_end = 0;
     }
 
   while (len)
     {
-      while (logical_cluster > data->cur_cluster_num)
-	{
-	  /* Find next cluster.  */
-	  grub_uint32_t next_cluster;
-	  unsigned long fat_offset;
-
-	  switch (data->fat_size)
-	    {
-	    case 32:
-	      fat_offset = data->cur_cluster << 2;
-	      break;
-	    case 16:
-	      fat_offset = data->cur_cluster << 1;
-	      break;
-	    default:
-	      /* case 12: */
-	      fat_offset = data->cur_cluster + (data->cur_cluster >> 1);
-	      break;
-	    }
-
-	  /* Read the FAT.  */
-	  if (grub_disk_read (disk, data->fat_sector, fat_offset,
-			      (data->fat_size + 7) >> 3,
-			      (char *) &next_cluster))
-	    return -1;
-
-	  next_cluster = grub_le_to_cpu32 (next_cluster);
-	  switch (data->fat_size)
-	    {
-	    case 16:
-	      next_cluster &= 0xFFFF;
-	      break;
-	    case 12:
-	      if (data->cur_cluster & 1)
-		next_cluster >>= 4;
-
-	      next_cluster &= 0x0FFF;
-	      break;
-	    }
-
-	  grub_dprintf ("fat", "fat_size=%d, next_cluster=%u\n",
-			data->fat_size, next_cluster);
-
-	  /* Check the end.  */
-	  if (next_cluster >= data->cluster_eof_mark)
-	    return ret;
-
-	  if (next_cluster < 2 || next_cluster >= data->num_clusters)
-	    {
-	      grub_error (GRUB_ERR_BAD_FS, "invalid cluster %u",
-			  next_cluster);
-	      return -1;
-	    }
-
-	  data->cur_cluster = next_cluster;
-	  data->cur_cluster_num++;
-	}
-
-      /* Read the data here.  */
+      struct grub_fat_run *run;
+      grub_uint32_t count;
+
+      /* Follow the chain up to LOGICAL_CLUSTER, and then for as long as
+	 it stays contiguous, up to the last cluster needed.  */
+      while (! data->chain_end && data->cur_cluster_num < last_cluster
+	     && (data->cur_cluster_num < logical_cluster
+		 || data->runs[data->num_runs - 1].logical <= logical_cluster))
+	if (grub_fat_follow_chain (disk, data))
+	  return -1;
+
+      if (logical_cluster > data->cur_cluster_num)
+	return ret;
+
+      /* Read the data here, as much as is contiguous on disk.  */
+      run = grub_fat_find_run (data, logical_cluster);
+      count = run->logical + run->length - logical_cluster;
       sector = (data->cluster_sector
-		+ ((data->cur_cluster - 2)
+		+ ((run->cluster - 2 + logical_cluster - run->logical)
 		   << data->cluster_bits));
-      size = (1 << logical_cluster_bits) - offset;
-      if (size > len)
+      if (((grub_uint64_t) count << logical_cluster_bits) - offset < len)
+	size = ((grub_uint64_t) count << logical_cluster_bits) - offset;
+      else
 	size = len;
 
       disk->read_hook = read_hook;
@@ -569,8 +726,8 @@ grub_fat_read_data (grub_disk_t disk, struct grub_fat_data *data,
       len -= size;
       buf += size;
       ret += size;
-      logical_cluster++;
-      offset = 0;
+      logical_cluster += (offset + size) >> logical_cluster_bits;
+      offset = (offset + size) & ((1ULL << logical_cluster_bits) - 1);
     }
 
   return ret;
@@ -924,6 +1081,7 @@ grub_fat_find_dir (grub_disk_t disk, struct grub_fat_data *data,
 				| grub_le_to_cpu16 (ctxt.dir.first_cluster_low));
 #endif
 	  data->cur_cluster_num = ~0U;
+	  data->num_runs = 0;
 
 	  if (call_hook)
 	    hook (ctxt.filename, &info);
@@ -983,7 +1141,7 @@ grub_fat_dir (grub_device_t device, const char *path,
  fail:
 
   grub_free (dirname);
-  grub_free (data);
+  grub_fat_free (data);
 
   grub_dl_unref (my_mod);
 
@@ -1023,7 +1181,7 @@ grub_fat_open (grub_file_t file, const char *name)
 
  fail:
 
-  grub_free (data);
+  grub_fat_free (data);
 
   grub_dl_unref (my_mod);
 
@@ -1040,7 +1198,7 @@ grub_fat_read (grub_file_t file, char *buf, grub_size_t len)
 static grub_err_t
 grub_fat_close (grub_file_t file)
 {
-  grub_free (file->data);
+  grub_fat_free (file->data);
 
   grub_dl_unref (my_mod);
 
@@ -1086,7 +1244,7 @@ grub_fat_label (grub_device_t device, char **label)
 				* GRUB_MAX_UTF8_PER_UTF16 + 1);
 	  if (!*label)
 	    {
-	      grub_free (data);
+	      grub_fat_free (data);
 	      return grub_errno;
 	    }
 	  chc = dir.type_specific.volume_label.character_count;
@@ -1098,7 +1256,7 @@ grub_fat_label (grub_device_t device, char **label)
 	}
     }
 
-  grub_free (data);
+  grub_fat_free (data);
   return grub_errno;
 }
 
@@ -1143,7 +1301,7 @@ grub_fat_label (grub_device_t device, char **label)
 
   grub_dl_unref (my_mod);
 
-  grub_free (data);
+  grub_fat_free (data);
 
   return grub_errno;
 }
@@ -1173,7 +1331,7 @@ grub_fat_uuid (grub_device_t device, char **uuid)
 
   grub_dl_unref (my_mod);
 
-  grub_free (data);
+  grub_fat_free (data);
 
   return grub_errno;
 }
@@ -24,9 +24,376 @@
 #include <grub/fshelp.h>
 #include <grub/dl.h>
 #include <grub/i18n.h>
+#include <grub/command.h>
 
 GRUB_MOD_LICENSE ("GPLv3+");
 
+/* The path lookup cache.  The first lookup in a directory reads all of
+   its entries into a hash table keyed by the directory and the name, so
+   later lookups in it don't need to iterate over the directory and
+   names that aren't there are known to be missing.  Directories with
+   too many entries only remember the names looked up in them, including
+   the missing ones.  The cache is dropped when grub_disk_cache_expired
+   says so.  */
+#define GRUB_FSHELP_CACHE_DIRS		64
+#define GRUB_FSHELP_CACHE_ENTRIES	8192
+#define GRUB_FSHELP_CACHE_DIR_ENTRIES	(GRUB_FSHELP_CACHE_ENTRIES / 2)
+#define GRUB_FSHELP_CACHE_HASH		1024
+
+struct grub_fshelp_cache_dir
+{
+  struct grub_fshelp_cache_dir *next;
+
+  /* The filesystem and the directory on it.  */
+  struct grub_disk_key key;
+  const struct grub_fshelp_cache_ops *ops;
+  grub_uint64_t id;
+
+  struct grub_fshelp_cache_entry *entries;
+  unsigned nentries;
+  grub_uint32_t seed;
+
+  /* Set when all entries of the directory are cached.  */
+  int complete;
+  /* Set when the directory has too many entries to cache all of them.  */
+  int large;
+};
+
+struct grub_fshelp_cache_entry
+{
+  /* The hash chain.  */
+  struct grub_fshelp_cache_entry *next;
+  struct grub_fshelp_cache_entry **prev;
+  /* The entries of the same directory.  */
+  struct grub_fshelp_cache_entry *dir_next;
+  struct grub_fshelp_cache_dir *dir;
+  grub_uint32_t hash;
+  /* The position in the directory.  */
+  unsigned order;
+  /* GRUB_FSHELP_UNKNOWN if there is no such file.  */
+  int type;
+  grub_uint64_t id;
+  char name[0];
+};
+
+static struct grub_fshelp_cache_dir *cache_dirs;
+static struct grub_fshelp_cache_entry *cache_hash[GRUB_FSHELP_CACHE_HASH];
+static unsigned cache_ndirs, cache_nentries;
+static grub_uint32_t cache_seed;
+static grub_uint64_t cache_last_time;
+static unsigned long cache_lookups, cache_hits, cache_negative, cache_scans;
+
+/* Hash NAME case-insensitively so that case-insensitive matches end up
+   in the same chain.  */
+static grub_uint32_t
+cache_hash_name (const char *name)
+{
+  grub_uint32_t hash = 2166136261U;
+
+  for (; *name; name++)
+    hash = (hash ^ grub_tolower (*name)) * 16777619U;
+
+  return hash;
+}
+
+static inline struct grub_fshelp_cache_entry **
+cache_chain (struct grub_fshelp_cache_dir *dir, grub_uint32_t hash)
+{
+  return &cache_hash[(hash ^ dir->seed) % GRUB_FSHELP_CACHE_HASH];
+}
+
+static void
+cache_dir_clear (struct grub_fshelp_cache_dir *dir)
+{
+  struct grub_fshelp_cache_entry *e, *next;
+
+  for (e = dir->entries; e; e = next)
+    {
+      next = e->dir_next;
+      *e->prev = e->next;
+      if (e->next)
+	e->next->prev = e->prev;
+      grub_free (e);
+    }
+
+  cache_nentries -= dir->nentries;
+  dir->entries = 0;
+  dir->nentries = 0;
+  dir->complete = 0;
+}
+
+/* Free the least recently used directory other than KEEP.  Return 0 if
+   there is none.  */
+static int
+cache_evict (struct grub_fshelp_cache_dir *keep)
+{
+  struct grub_fshelp_cache_dir **p, **last = 0;
+
+  for (p = &cache_dirs; *p; p = &(*p)->next)
+    if (*p != keep)
+      last = p;
+
+  if (! last)
+    return 0;
+
+  {
+    struct grub_fshelp_cache_dir *dir = *last;
+
+    *last = dir->next;
+    cache_dir_clear (dir);
+    grub_free (dir);
+    cache_ndirs--;
+  }
+
+  return 1;
+}
+
+static void
+cache_flush (void)
+{
+  while (cache_evict (0));
+}
+
+/* Find the cache of the directory DIR, creating it if needed, and make
+   it the most recently used one.  */
+static struct grub_fshelp_cache_dir *
+cache_get_dir (grub_disk_t disk, const struct grub_fshelp_cache_ops *ops,
+	       grub_fshelp_node_t dir)
+{
+  struct grub_fshelp_cache_dir **p, *d;
+  struct grub_disk_key key;
+  grub_uint64_t id;
+
+  grub_disk_get_key (disk, &key);
+  id = ops->node_id (dir);
+
+  for (p = &cache_dirs; *p; p = &(*p)->next)
+    {
+      d = *p;
+      if (d->id == id && d->ops == ops && grub_disk_key_equal (&d->key, &key))
+	{
+	  *p = d->next;
+	  d->next = cache_dirs;
+	  cache_dirs = d;
+	  return d;
+	}
+    }
+
+  if (cache_ndirs >= GRUB_FSHELP_CACHE_DIRS)
+    cache_evict (0);
+
+  d = grub_zalloc (sizeof (*d));
+  if (! d)
+    {
+      grub_errno = GRUB_ERR_NONE;
+      return 0;
+    }
+
+  d->key = key;
+  d->ops = ops;
+  d->id = id;
+  d->seed = (cache_seed++) * 0x9e3779b9U;
+  d->next = cache_dirs;
+  cache_dirs = d;
+  cache_ndirs++;
+
+  return d;
+}
+
+/* Add an entry for NAME to DIR.  Return 0 if that wasn't possible.  */
+static int
+cache_add (struct grub_fshelp_cache_dir *dir, const char *name, int type,
+	   grub_uint64_t id)
+{
+  struct grub_fshelp_cache_entry *e, **chain;
+  grub_size_t len = grub_strlen (name);
+
+  if (dir->nentries >= GRUB_FSHELP_CACHE_DIR_ENTRIES)
+    return 0;
+
+  while (cache_nentries >= GRUB_FSHELP_CACHE_ENTRIES)
+    if (! cache_evict (dir))
+      return 0;
+
+  e = grub_malloc (sizeof (*e) + len + 1);
+  if (! e)
+    {
+      grub_errno = GRUB_ERR_NONE;
+      return 0;
+    }
+
+  grub_memcpy (e->name, name, len + 1);
+  e->hash = cache_hash_name (name);
+  e->order = dir->nentries;
+  e->type = type;
+  e->id = id;
+  e->dir = dir;
+  e->dir_next = dir->entries;
+  dir->entries = e;
+  dir->nentries++;
+  cache_nentries++;
+
+  chain = cache_chain (dir, e->hash);
+  e->next = *chain;
+  e->prev = chain;
+  if (e->next)
+    e->next->prev = &e->next;
+  *chain = e;
+
+  return 1;
+}
+
+/* Find the entry for NAME in DIR.  If several match, which can happen
+   on case-insensitive filesystems, use the first one in the directory
+   like an iteration over it would.  */
+static struct grub_fshelp_cache_entry *
+cache_find (struct grub_fshelp_cache_dir *dir, const char *name)
+{
+  struct grub_fshelp_cache_entry *e, *found = 0;
+  grub_uint32_t hash = cache_hash_name (name);
+
+  for (e = *cache_chain (dir, hash); e; e = e->next)
+    {
+      if (e->dir != dir || e->hash != hash
+	  || (found && found->order < e->order))
+	continue;
+
+      if (grub_strcmp (e->name, name) == 0
+	  || ((e->type & GRUB_FSHELP_CASE_INSENSITIVE)
+	      && grub_strcasecmp (e->name, name) == 0))
+	found = e;
+    }
+
+  return found;
+}
+
+/* Look NAME up in the directory DIR.  Return 1 and set *NODE and *TYPE
+   if it was found and 0 otherwise.  */
+static int
+cache_lookup (grub_disk_t disk, const struct grub_fshelp_cache_ops *ops,
+	      int (*iterate_dir) (grub_fshelp_node_t dir,
+				  int NESTED_FUNC_ATTR (*hook)
+				  (const char *filename,
+				   enum grub_fshelp_filetype filetype,
+				   grub_fshelp_node_t node)),
+	      grub_fshelp_node_t dir, const char *name,
+	      grub_fshelp_node_t *node, enum grub_fshelp_filetype *type)
+{
+  struct grub_fshelp_cache_dir *d;
+  struct grub_fshelp_cache_entry *e;
+  grub_fshelp_node_t found = 0;
+  int foundtype = GRUB_FSHELP_UNKNOWN;
+  int indexing;
+
+  auto int NESTED_FUNC_ATTR scan (const char *filename,
+				  enum grub_fshelp_filetype filetype,
+				  grub_fshelp_node_t fnode);
+
+  int NESTED_FUNC_ATTR scan (const char *filename,
+			     enum grub_fshelp_filetype filetype,
+			     grub_fshelp_node_t fnode)
+    {
+      int match;
+
+      if (filetype == GRUB_FSHELP_UNKNOWN)
+	{
+	  grub_free (fnode);
+	  return 0;
+	}
+
+      match = (! found
+	       && (grub_strcmp (name, filename) == 0
+		   || ((filetype & GRUB_FSHELP_CASE_INSENSITIVE)
+		       && grub_strcasecmp (name, filename) == 0)));
+
+      if (indexing && ! cache_add (d, filename, filetype, ops->node_id (fnode)))
+	{
+	  /* Only remember the result of this lookup.  */
+	  cache_dir_clear (d);
+	  d->large = 1;
+	  indexing = 0;
+	}
+
+      if (match)
+	{
+	  found = fnode;
+	  foundtype = filetype;
+	}
+      else
+	grub_free (fnode);
+
+      /* Go on reading the directory only while it's indexed.  */
+      return found && ! indexing;
+    }
+
+  if (grub_disk_cache_expired (&cache_last_time))
+    cache_flush ();
+
+  cache_lookups++;
+
+  d = cache_get_dir (disk, ops, dir);
+  if (d)
+    {
+      e = cache_find (d, name);
+      if (! e && d->complete)
+	{
+	  cache_negative++;
+	  return 0;
+	}
+      if (e && e->type == GRUB_FSHELP_UNKNOWN)
+	{
+	  cache_negative++;
+	  return 0;
+	}
+      if (e)
+	{
+	  *node = ops->get_node (dir, e->id);
+	  if (! *node)
+	    return 0;
+	  *type = e->type & ~GRUB_FSHELP_CASE_INSENSITIVE;
+	  cache_hits++;
+	  return 1;
+	}
+    }
+
+  cache_scans++;
+  indexing = d && ! d->large;
+
+  iterate_dir (dir, scan);
+  if (grub_errno)
+    {
+      if (d)
+	cache_dir_clear (d);
+      grub_free (found);
+      return 0;
+    }
+
+  if (indexing)
+    d->complete = 1;
+  else if (d)
+    cache_add (d, name, found ? foundtype : GRUB_FSHELP_UNKNOWN,
+	       found ? ops->node_id (found) : 0);
+
+  if (! found)
+    return 0;
+
+  *node = found;
+  *type = foundtype & ~GRUB_FSHELP_CASE_INSENSITIVE;
+  return 1;
+}
+
+void
+grub_fshelp_cache_get_performance (unsigned long *lookups,
+				   unsigned long *hits,
+				   unsigned long *negative,
+				   unsigned long *scans)
+{
+  *lookups = cache_lookups;
+  *hits = cache_hits;
+  *negative = cache_negative;
+  *scans = cache_scans;
+}
+
 /* Lookup the node PATH.  The node ROOTNODE describes the root of the
    directory tree.  The node found is returned in FOUNDNODE, which is
    either a ROOTNODE or a new malloc'ed node.  ITERATE_DIR is used to
@@ -35,17 +402,20 @@ GRUB_MOD_LICENSE ("GPLv3+");
    EXPECTTYPE is the type node that is expected by the called, an
    error is generated if the node is not of the expected type.  Make
    sure you use the NESTED_FUNC_ATTR macro for HOOK, this is required
-   because GCC has a nasty bug when using regparm=3.  */
-grub_err_t
-grub_fshelp_find_file (const char *path, grub_fshelp_node_t rootnode,
-		       grub_fshelp_node_t *foundnode,
-		       int (*iterate_dir) (grub_fshelp_node_t dir,
-					   int NESTED_FUNC_ATTR (*hook)
-					   (const char *filename,
-					    enum grub_fshelp_filetype filetype,
-					    grub_fshelp_node_t node)),
-		       char *(*read_symlink) (grub_fshelp_node_t node),
-		       enum grub_fshelp_filetype expecttype)
+   because GCC has a nasty bug when using regparm=3.  If OPS is set,
+   the path lookup cache is used for the filesystem on DISK.  */
+static grub_err_t
+grub_fshelp_find_file_real (const char *path, grub_fshelp_node_t rootnode,
+			    grub_fshelp_node_t *foundnode,
+			    int (*iterate_dir) (grub_fshelp_node_t dir,
+						int NESTED_FUNC_ATTR (*hook)
+						(const char *filename,
+						 enum grub_fshelp_filetype filetype,
+						 grub_fshelp_node_t node)),
+			    char *(*read_symlink) (grub_fshelp_node_t node),
+			    enum grub_fshelp_filetype expecttype,
+			    grub_disk_t disk,
+			    const struct grub_fshelp_cache_ops *ops)
 {
   grub_err_t err;
   enum grub_fshelp_filetype foundtype = GRUB_FSHELP_DIR;
@@ -134,7 +504,20 @@ grub_fshelp_find_file (const char *path, grub_fshelp_node_t rootnode,
 	    }
 
 	  /* Iterate over the directory.  */
-	  found = iterate_dir (currnode, iterate);
+	  if (ops)
+	    {
+	      grub_fshelp_node_t node;
+
+	      found = cache_lookup (disk, ops, iterate_dir, currnode, name,
+				    &node, &type);
+	      if (found)
+		{
+		  oldnode = currnode;
+		  currnode = node;
+		}
+	    }
+	  else
+	    found = iterate_dir (currnode, iterate);
 	  if (! found)
 	    {
 	      free_node (currnode);
@@ -225,24 +608,84 @@ grub_fshelp_find_file (const char *path, grub_fshelp_node_t rootnode,
   return 0;
 }
 
-/* Read LEN bytes from the file NODE on disk DISK into the buffer BUF,
-   beginning with the block POS.  READ_HOOK should be set before
-   reading a block from the file.  GET_BLOCK is used to translate file
-   blocks to disk blocks.  The file is FILESIZE bytes big and the
-   blocks have a size of LOG2BLOCKSIZE (in log2).  */
-grub_ssize_t
-grub_fshelp_read_file (grub_disk_t disk, grub_fshelp_node_t node,
+grub_err_t
+grub_fshelp_find_file (const char *path, grub_fshelp_node_t rootnode,
+		       grub_fshelp_node_t *foundnode,
+		       int (*iterate_dir) (grub_fshelp_node_t dir,
+					   int NESTED_FUNC_ATTR (*hook)
+					   (const char *filename,
+					    enum grub_fshelp_filetype filetype,
+					    grub_fshelp_node_t node)),
+		       char *(*read_symlink) (grub_fshelp_node_t node),
+		       enum grub_fshelp_filetype expecttype)
+{
+  return grub_fshelp_find_file_real (path, rootnode, foundnode, iterate_dir,
+				     read_symlink, expecttype, 0, 0);
+}
+
+grub_err_t
+grub_fshelp_find_file_cached (const char *path, grub_fshelp_node_t rootnode,
+			      grub_fshelp_node_t *foundnode,
+			      int (*iterate_dir) (grub_fshelp_node_t dir,
+						  int NESTED_FUNC_ATTR (*hook)
+						  (const char *filename,
+						   enum grub_fshelp_filetype filetype,
+						   grub_fshelp_node_t node)),
+			      char *(*read_symlink) (grub_fshelp_node_t node),
+			      enum grub_fshelp_filetype expecttype,
+			      grub_disk_t disk,
+			      const struct grub_fshelp_cache_ops *ops)
+{
+  return grub_fshelp_find_file_real (path, rootnode, foundnode, iterate_dir,
+				     read_symlink, expecttype, disk, ops);
+}
+
+/* The number of disk ranges grub_fshelp_read_file submits at once.  */
+#define GRUB_FSHELP_READ_VEC	32
+
+static grub_err_t
+grub_fshelp_flush_vec (grub_disk_t disk,
 		       void NESTED_FUNC_ATTR (*read_hook) (grub_disk_addr_t sector,
-                                                           unsigned offset,
-                                                           unsigned length),
-		       grub_off_t pos, grub_size_t len, char *buf,
-		       grub_disk_addr_t (*get_block) (grub_fshelp_node_t node,
-                                                      grub_disk_addr_t block),
-		       grub_off_t filesize, int log2blocksize,
-		       grub_disk_addr_t blocks_start)
+							   unsigned offset,
+							   unsigned length),
+		       struct grub_disk_read_vec *vec, unsigned *nvec)
+{
+  if (! *nvec)
+    return GRUB_ERR_NONE;
+
+  disk->read_hook = read_hook;
+  grub_disk_read_vec (disk, vec, *nvec);
+  disk->read_hook = 0;
+  *nvec = 0;
+
+  return grub_errno;
+}
+
+/* Read LEN bytes from the file NODE on disk DISK into the buffer BUF.
+   Blocks are translated with GET_EXTENT if it is set and with GET_BLOCK
+   otherwise.  */
+static grub_ssize_t
+grub_fshelp_read_file_real (grub_disk_t disk, grub_fshelp_node_t node,
+			    void NESTED_FUNC_ATTR (*read_hook) (grub_disk_addr_t sector,
+								unsigned offset,
+								unsigned length),
+			    grub_off_t pos, grub_size_t len, char *buf,
+			    grub_disk_addr_t (*get_block) (grub_fshelp_node_t node,
+							   grub_disk_addr_t block),
+			    grub_disk_addr_t (*get_extent) (grub_fshelp_node_t node,
+							    grub_disk_addr_t block,
+							    grub_disk_addr_t *count),
+			    grub_off_t filesize, int log2blocksize,
+			    grub_disk_addr_t blocks_start)
 {
   grub_disk_addr_t i, blockcnt;
   int blocksize = 1 << (log2blocksize + GRUB_DISK_SECTOR_BITS);
+  struct grub_disk_read_vec vec[GRUB_FSHELP_READ_VEC];
+  unsigned nvec = 0, maxvec;
+  grub_disk_addr_t ext_start = 0, ext_block = 0, ext_count = 0;
+
+  /* Keep the read hook calls in file order.  */
+  maxvec = read_hook ? 1 : GRUB_FSHELP_READ_VEC;
 
   /* Adjust LEN so it we can't read past the end of the file.  */
   if (pos + len > filesize)
@@ -258,9 +701,26 @@ grub_fshelp_read_file (grub_disk_t disk, grub_fshelp_node_t node,
 
       int skipfirst = 0;
 
-      blknr = get_block (node, i);
-      if (grub_errno)
-	return -1;
+      if (get_extent)
+	{
+	  /* Only ask for the next extent when this one is used up.  */
+	  if (i - ext_block >= ext_count)
+	    {
+	      ext_start = get_extent (node, i, &ext_count);
+	      if (grub_errno)
+		return -1;
+	      if (! ext_count)
+		ext_count = 1;
+	      ext_block = i;
+	    }
+	  blknr = ext_start ? ext_start + (i - ext_block) : 0;
+	}
+      else
+	{
+	  blknr = get_block (node, i);
+	  if (grub_errno)
+	    return -1;
+	}
 
       blknr = blknr << log2blocksize;
 
@@ -285,13 +745,29 @@ grub_fshelp_read_file (grub_disk_t disk, grub_fshelp_node_t node,
 	 is zero filled instead.  */
       if (blknr)
 	{
-	  disk->read_hook = read_hook;
-
-	  grub_disk_read (disk, blknr + blocks_start, skipfirst,
-			  blockend, buf);
-	  disk->read_hook = 0;
-	  if (grub_errno)
-	    return -1;
+	  struct grub_disk_read_vec *last = nvec ? vec + nvec - 1 : 0;
+
+	  /* Extend the previous range if this block follows it on disk
+	     and in the buffer.  */
+	  if (last && ! skipfirst
+	      && (char *) last->buf + last->size == buf
+	      && ! ((last->offset + last->size) & (GRUB_DISK_SECTOR_SIZE - 1))
+	      && (last->sector + ((last->offset + last->size)
+				  >> GRUB_DISK_SECTOR_BITS)
+		  == blknr + blocks_start))
+	    last->size += blockend;
+	  else
+	    {
+	      if (nvec == maxvec
+		  && grub_fshelp_flush_vec (disk, read_hook, vec, &nvec))
+		return -1;
+
+	      vec[nvec].sector = blknr + blocks_start;
+	      vec[nvec].offset = skipfirst;
+	      vec[nvec].size = blockend;
+	      vec[nvec].buf = buf;
+	      nvec++;
+	    }
 	}
       else
 	grub_memset (buf, 0, blockend);
@@ -299,9 +775,55 @@ grub_fshelp_read_file (grub_disk_t disk, grub_fshelp_node_t node,
       buf += blocksize - skipfirst;
     }
 
+  if (grub_fshelp_flush_vec (disk, read_hook, vec, &nvec))
+    return -1;
+
   return len;
 }
 
+/* Read LEN bytes from the file NODE on disk DISK into the buffer BUF,
+   beginning with the block POS.  READ_HOOK should be set before
+   reading a block from the file.  GET_BLOCK is used to translate file
+   blocks to disk blocks.  The file is FILESIZE bytes big and the
+   blocks have a size of LOG2BLOCKSIZE (in log2).  */
+grub_ssize_t
+grub_fshelp_read_file (grub_disk_t disk, grub_fshelp_node_t node,
+		       void NESTED_FUNC_ATTR (*read_hook) (grub_disk_addr_t sector,
+                                                           unsigned offset,
+                                                           unsigned length),
+		       grub_off_t pos, grub_size_t len, char *buf,
+		       grub_disk_addr_t (*get_block) (grub_fshelp_node_t node,
+                                                      grub_disk_addr_t block),
+		       grub_off_t filesize, int log2blocksize,
+		       grub_disk_addr_t blocks_start)
+{
+  return grub_fshelp_read_file_real (disk, node, read_hook, pos, len, buf,
+				     get_block, 0, filesize, log2blocksize,
+				     blocks_start);
+}
+
+/* Like grub_fshelp_read_file, but GET_EXTENT translates the file block
+   BLOCK to a disk block and sets *COUNT to the number of file blocks
+   from BLOCK on that follow it on disk, so that it is called once per
+   extent rather than once per block.  A disk block of 0 means that the
+   COUNT blocks are a hole.  */
+grub_ssize_t
+grub_fshelp_read_file_extents (grub_disk_t disk, grub_fshelp_node_t node,
+			       void NESTED_FUNC_ATTR (*read_hook) (grub_disk_addr_t sector,
+								   unsigned offset,
+								   unsigned length),
+			       grub_off_t pos, grub_size_t len, char *buf,
+			       grub_disk_addr_t (*get_extent) (grub_fshelp_node_t node,
+							       grub_disk_addr_t block,
+							       grub_disk_addr_t *count),
+			       grub_off_t filesize, int log2blocksize,
+			       grub_disk_addr_t blocks_start)
+{
+  return grub_fshelp_read_file_real (disk, node, read_hook, pos, len, buf,
+				     0, get_extent, filesize, log2blocksize,
+				     blocks_start);
+}
+
 unsigned int
 grub_fshelp_log2blksize (unsigned int blksize, unsigned int *pow)
 {
@@ -322,3 +844,41 @@ grub_fshelp_log2blksize (unsigned int blksize, unsigned int *pow)
 
   return GRUB_ERR_NONE;
 }
+
+static grub_err_t
+grub_cmd_lookupinfo (grub_command_t cmd __attribute__ ((unused)),
+		     int argc __attribute__ ((unused)),
+		     char **args __attribute__ ((unused)))
+{
+  grub_printf_ (N_("Path lookup cache: %u directories, %u entries\n"),
+		cache_ndirs, cache_nentries);
+  if (cache_lookups)
+    {
+      unsigned long ratio;
+
+      ratio = (cache_hits + cache_negative) * 10000 / cache_lookups;
+      grub_printf_ (N_("Lookups = %lu, hits = %lu, negative hits = %lu"
+		       " (%lu.%02lu%%), directory scans = %lu\n"),
+		    cache_lookups, cache_hits, cache_negative,
+		    ratio / 100, ratio % 100, cache_scans);
+    }
+  else
+    grub_printf ("%s\n", _("No path lookup statistics available"));
+
+  return GRUB_ERR_NONE;
+}
+
+static grub_command_t cmd_lookupinfo;
+
+GRUB_MOD_INIT(fshelp)
+{
+  cmd_lookupinfo = grub_register_command ("lookupinfo", grub_cmd_lookupinfo,
+					  0, N_("Show path lookup cache"
+						" statistics."));
+}
+
+GRUB_MOD_FINI(fshelp)
+{
+  grub_unregister_command (cmd_lookupinfo);
+  cache_flush ();
+}
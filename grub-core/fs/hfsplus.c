@@ -270,12 +270,13 @@ grub_hfsplus_btree_recptr (struct grub_hfsplus_btree *btree,
 }
 
 
-/* Find the extent that points to FILEBLOCK.  If it is not in one of
-   the 8 extents described by EXTENT, return -1.  In that case set
-   FILEBLOCK to the next block.  */
+/* Find the extent that points to FILEBLOCK and set *COUNT to the
+   number of blocks left in it.  If it is not in one of the 8 extents
+   described by EXTENT, return -1.  In that case set FILEBLOCK to the
+   next block.  */
 static grub_disk_addr_t
 grub_hfsplus_find_block (struct grub_hfsplus_extent *extent,
-			 grub_disk_addr_t *fileblock)
+			 grub_disk_addr_t *fileblock, grub_disk_addr_t *count)
 {
   int i;
   grub_disk_addr_t blksleft = *fileblock;
@@ -284,7 +285,10 @@ grub_hfsplus_find_block (struct grub_hfsplus_extent *extent,
   for (i = 0; i < 8; i++)
     {
       if (blksleft < grub_be_to_cpu32 (extent[i].count))
-	return grub_be_to_cpu32 (extent[i].start) + blksleft;
+	{
+	  *count = grub_be_to_cpu32 (extent[i].count) - blksleft;
+	  return grub_be_to_cpu32 (extent[i].start) + blksleft;
+	}
       blksleft -= grub_be_to_cpu32 (extent[i].count);
     }
 
@@ -304,9 +308,11 @@ static int grub_hfsplus_cmp_extkey (struct grub_hfsplus_key *keya,
 				    struct grub_hfsplus_key_internal *keyb);
 
 /* Search for the block FILEBLOCK inside the file NODE.  Return the
-   blocknumber of this block on disk.  */
+   blocknumber of this block on disk and set *COUNT to the number of
+   blocks of its extent from FILEBLOCK on.  */
 static grub_disk_addr_t
-grub_hfsplus_read_block (grub_fshelp_node_t node, grub_disk_addr_t fileblock)
+grub_hfsplus_read_extent (grub_fshelp_node_t node, grub_disk_addr_t fileblock,
+			  grub_disk_addr_t *count)
 {
   struct grub_hfsplus_btnode *nnode = 0;
   grub_disk_addr_t blksleft = fileblock;
@@ -320,7 +326,7 @@ grub_hfsplus_read_block (grub_fshelp_node_t node, grub_disk_addr_t fileblock)
       grub_off_t ptr;
 
       /* Try to find this block in the current set of extents.  */
-      blk = grub_hfsplus_find_block (extents, &blksleft);
+      blk = grub_hfsplus_find_block (extents, &blksleft, count);
 
       /* The previous iteration of this loop allocated memory.  The
 	 code above used this memory, it can be freed now.  */
@@ -379,11 +385,11 @@ grub_hfsplus_read_file (grub_fshelp_node_t node,
 					   unsigned offset, unsigned length),
 			grub_off_t pos, grub_size_t len, char *buf)
 {
-  return grub_fshelp_read_file (node->data->disk, node, read_hook,
-				pos, len, buf, grub_hfsplus_read_block,
-				node->size,
-				node->data->log2blksize - GRUB_DISK_SECTOR_BITS,
-				node->data->embedded_offset);
+  return grub_fshelp_read_file_extents (node->data->disk, node, read_hook,
+					pos, len, buf, grub_hfsplus_read_extent,
+					node->size,
+					node->data->log2blksize - GRUB_DISK_SECTOR_BITS,
+					node->data->embedded_offset);
 }
 
 static struct grub_hfsplus_data *
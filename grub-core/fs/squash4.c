@@ -216,6 +216,127 @@ struct grub_fshelp_node
   } stack[1];
 };
 
+/* Decompressed metadata chunks and fragment and data blocks, keyed by
+   their position on disk, so that reading the inodes, directories and
+   small files packed into the same block doesn't decompress it again
+   every time.  The filesystem is mounted again for every open, so the
+   cache is shared by all mounts.  */
+#define SQUASH_CACHE_SIZE	(2 << 20)
+
+struct squash_cache_entry
+{
+  struct squash_cache_entry *next;
+  struct grub_disk_key key;
+  grub_uint64_t offset;
+  /* The number of bytes decompressed and allocated.  */
+  grub_size_t size;
+  grub_size_t alloc;
+  char *buf;
+};
+
+/* The most recently used entry comes first.  */
+static struct squash_cache_entry *squash_cache;
+static grub_size_t squash_cache_used;
+static grub_uint64_t squash_cache_last_time;
+
+static void
+squash_cache_free (struct squash_cache_entry *e)
+{
+  squash_cache_used -= e->alloc;
+  grub_free (e->buf);
+  grub_free (e);
+}
+
+static void
+squash_cache_flush (void)
+{
+  while (squash_cache)
+    {
+      struct squash_cache_entry *e = squash_cache;
+      squash_cache = e->next;
+      squash_cache_free (e);
+    }
+}
+
+/* Return the block of at most MAXSIZE bytes compressed into the CSIZE
+   bytes at OFFSET, decompressing it if it isn't cached.  The entry
+   stays valid until the next call.  */
+static struct squash_cache_entry *
+squash_cache_get (struct grub_squash_data *data, grub_uint64_t offset,
+		  grub_size_t csize, grub_size_t maxsize)
+{
+  struct squash_cache_entry **p, *e;
+  struct grub_disk_key key;
+  grub_ssize_t size;
+  char *tmp;
+
+  if (grub_disk_cache_expired (&squash_cache_last_time))
+    squash_cache_flush ();
+  grub_disk_get_key (data->disk, &key);
+
+  for (p = &squash_cache; *p; p = &(*p)->next)
+    {
+      e = *p;
+      if (e->offset == offset && e->alloc == maxsize
+	  && grub_disk_key_equal (&e->key, &key))
+	{
+	  *p = e->next;
+	  e->next = squash_cache;
+	  squash_cache = e;
+	  return e;
+	}
+    }
+
+  tmp = grub_malloc (csize);
+  if (!tmp)
+    return NULL;
+  if (grub_disk_read (data->disk, offset >> GRUB_DISK_SECTOR_BITS,
+		      offset & (GRUB_DISK_SECTOR_SIZE - 1), csize, tmp))
+    {
+      grub_free (tmp);
+      return NULL;
+    }
+
+  e = grub_zalloc (sizeof (*e));
+  if (e)
+    e->buf = grub_zalloc (maxsize);
+  if (!e || !e->buf)
+    {
+      grub_free (e);
+      grub_free (tmp);
+      return NULL;
+    }
+
+  size = data->decompress (tmp, csize, 0, e->buf, maxsize, data);
+  grub_free (tmp);
+  if (size < 0)
+    {
+      grub_free (e->buf);
+      grub_free (e);
+      return NULL;
+    }
+
+  e->key = key;
+  e->offset = offset;
+  e->size = size;
+  e->alloc = maxsize;
+  e->next = squash_cache;
+  squash_cache = e;
+  squash_cache_used += maxsize;
+
+  /* Drop the least recently used entries.  */
+  while (squash_cache_used > SQUASH_CACHE_SIZE)
+    {
+      for (p = &squash_cache; (*p)->next; p = &(*p)->next);
+      if (*p == e)
+	break;
+      squash_cache_free (*p);
+      *p = NULL;
+    }
+
+  return e;
+}
+
 static grub_err_t
 read_chunk (struct grub_squash_data *data, void *buf, grub_size_t len,
 	    grub_uint64_t chunk_start, grub_off_t offset)
@@ -254,29 +375,14 @@ read_chunk (struct grub_squash_data *data, void *buf, grub_size_t len,
 	}
       else
 	{
-	  char *tmp;
+	  struct squash_cache_entry *e;
 	  grub_size_t bsize = grub_le_to_cpu16 (d) & ~SQUASH_CHUNK_FLAGS; 
-	  grub_disk_addr_t a = chunk_start + 2;
-	  tmp = grub_malloc (bsize);
-	  if (!tmp)
-	    return grub_errno;
-	  /* FIXME: buffer uncompressed data.  */
-	  err = grub_disk_read (data->disk, (a >> GRUB_DISK_SECTOR_BITS),
-				a & (GRUB_DISK_SECTOR_SIZE - 1),
-				bsize, tmp);
-	  if (err)
-	    {
-	      grub_free (tmp);
-	      return err;
-	    }
 
-	  if (data->decompress (tmp, bsize, offset,
-				buf, csize, data) < 0)
-	    {
-	      grub_free (tmp);
-	      return grub_errno;
-	    }
-	  grub_free (tmp);
+	  e = squash_cache_get (data, chunk_start + 2, bsize,
+				SQUASH_CHUNK_SIZE);
+	  if (!e)
+	    return grub_errno;
+	  grub_memcpy (buf, e->buf + offset, csize);
 	}
       len -= csize;
       offset += csize;
@@ -314,6 +420,10 @@ lzo_decompress (char *inbuf, grub_size_t insize, grub_off_t off,
       grub_free (udata);
       return -1;
     }
+  if (off > usize)
+    off = usize;
+  if (len > usize - off)
+    len = usize - off;
   grub_memcpy (outbuf, udata + off, len);
   grub_free (udata);
   return len;
@@ -821,10 +931,34 @@ direct_read (struct grub_squash_data *data,
       if (curread > len)
 	curread = len;
       if (!(ino->block_sizes[i]
-	    & grub_cpu_to_le32_compile_time (SQUASH_BLOCK_UNCOMPRESSED)))
+	    & grub_cpu_to_le32_compile_time (SQUASH_BLOCK_UNCOMPRESSED))
+	  && (boff || curread < data->blksz))
+	{
+	  struct squash_cache_entry *e;
+	  grub_size_t csize;
+
+	  /* Keep partly read blocks so that a sequential reader doesn't
+	     decompress them once per call.  */
+	  csize = grub_le_to_cpu32 (ino->block_sizes[i]) & ~SQUASH_BLOCK_FLAGS;
+	  e = squash_cache_get (data, ino->cumulated_block_sizes[i] + a,
+				csize, data->blksz);
+	  if (!e)
+	    return -1;
+	  if (e->size < boff + curread)
+	    {
+	      grub_error (GRUB_ERR_BAD_FS, "incorrect compressed chunk");
+	      return -1;
+	    }
+	  grub_memcpy (buf, e->buf + boff, curread);
+	  err = GRUB_ERR_NONE;
+	}
+      else if (!(ino->block_sizes[i]
+		 & grub_cpu_to_le32_compile_time (SQUASH_BLOCK_UNCOMPRESSED)))
 	{
 	  char *block;
 	  grub_size_t csize;
+
+	  /* Whole blocks are decompressed straight into BUF.  */
 	  csize = grub_le_to_cpu32 (ino->block_sizes[i]) & ~SQUASH_BLOCK_FLAGS;
 	  block = grub_malloc (csize);
 	  if (!block)
@@ -906,32 +1040,20 @@ grub_squash_read_data (struct grub_squash_data *data,
   else
     b = grub_le_to_cpu32 (ino->ino.file.offset) + off;
   
-  /* FIXME: cache uncompressed chunks.  */
   if (compressed)
     {
-      char *block;
-      block = grub_malloc (grub_le_to_cpu32 (frag.size));
-      if (!block)
+      struct squash_cache_entry *e;
+
+      e = squash_cache_get (data, a, grub_le_to_cpu32 (frag.size),
+			    data->blksz);
+      if (!e)
 	return -1;
-      err = grub_disk_read (data->disk,
-			    a >> GRUB_DISK_SECTOR_BITS,
-			    a & (GRUB_DISK_SECTOR_SIZE - 1),
-			    grub_le_to_cpu32 (frag.size), block);
-      if (err)
-	{
-	  grub_free (block);
-	  return -1;
-	}
-      if (data->decompress (block, grub_le_to_cpu32 (frag.size),
-			    b, buf, len, data)
-	  != (grub_ssize_t) len)
+      if (b > e->size || len > e->size - b)
 	{
-	  grub_free (block);
-	  if (!grub_errno)
-	    grub_error (GRUB_ERR_BAD_FS, "incorrect compressed chunk");
+	  grub_error (GRUB_ERR_BAD_FS, "incorrect compressed chunk");
 	  return -1;
 	}
-      grub_free (block);
+      grub_memcpy (buf, e->buf + b, len);
     }
   else
     {
@@ -995,5 +1117,6 @@ GRUB_MOD_INIT(squash4)
 GRUB_MOD_FINI(squash4)
 {
   grub_fs_unregister (&grub_squash_fs);
+  squash_cache_flush ();
 }
 
@@ -34,6 +34,9 @@ GRUB_MOD_LICENSE ("GPLv3+");
 #define XFS_INODE_FORMAT_EXT	2
 #define XFS_INODE_FORMAT_BTREE	3
 
+/* The number of bmap btree blocks read at once.  */
+#define XFS_BMAP_BATCH	16
+
 
 struct grub_xfs_sblock
 {
@@ -150,6 +153,14 @@ struct grub_fshelp_node
   struct grub_xfs_inode inode;
 };
 
+/* An extent of a file, with START converted to a linear block number.  */
+struct grub_xfs_mapped_extent
+{
+  grub_uint64_t offset;
+  grub_disk_addr_t start;
+  grub_uint64_t count;
+};
+
 struct grub_xfs_data
 {
   struct grub_xfs_sblock sblock;
@@ -157,6 +168,14 @@ struct grub_xfs_data
   int pos;
   int bsize;
   grub_uint32_t agsize;
+
+  /* The extents of the inode EXTENTS_INO, sorted by file offset.  */
+  struct grub_xfs_mapped_extent *extents;
+  grub_size_t nextents;
+  grub_size_t extents_alloc;
+  grub_uint64_t extents_ino;
+  int extents_valid;
+
   struct grub_fshelp_node diropen;
 };
 
@@ -275,105 +294,278 @@ grub_xfs_read_inode (struct grub_xfs_data *data, grub_uint64_t ino,
 }
 
 
-static grub_disk_addr_t
-grub_xfs_read_block (grub_fshelp_node_t node, grub_disk_addr_t fileblock)
+/* Append the NREC extents at EXTS to the extent map of DATA, merging
+   extents which are contiguous both in the file and on disk.  */
+static grub_err_t
+grub_xfs_add_extents (struct grub_xfs_data *data, grub_xfs_extent *exts,
+		      int nrec)
 {
-  struct grub_xfs_btree_node *leaf = 0;
-  int ex, nrec;
-  grub_xfs_extent *exts;
-  grub_uint64_t ret = 0;
+  int ex;
+
+  for (ex = 0; ex < nrec; ex++)
+    {
+      grub_uint64_t offset = GRUB_XFS_EXTENT_OFFSET (exts, ex);
+      grub_uint64_t size = GRUB_XFS_EXTENT_SIZE (exts, ex);
+      grub_disk_addr_t start;
+
+      if (size == 0)
+	continue;
+
+      /* Extents never cross an allocation group, so the blocks of one are
+	 contiguous after the conversion.  */
+      start = GRUB_XFS_FSB_TO_BLOCK (data, GRUB_XFS_EXTENT_BLOCK (exts, ex));
+
+      if (data->nextents)
+	{
+	  struct grub_xfs_mapped_extent *last;
+
+	  last = &data->extents[data->nextents - 1];
+	  if (offset < last->offset + last->count)
+	    return grub_error (GRUB_ERR_BAD_FS, "XFS extents out of order");
+	  if (offset == last->offset + last->count
+	      && start == last->start + last->count)
+	    {
+	      last->count += size;
+	      continue;
+	    }
+	}
+
+      if (data->nextents == data->extents_alloc)
+	{
+	  grub_size_t alloc = data->extents_alloc ? 2 * data->extents_alloc : 8;
+	  struct grub_xfs_mapped_extent *extents;
+
+	  extents = grub_realloc (data->extents, alloc * sizeof (*extents));
+	  if (!extents)
+	    return grub_errno;
+	  data->extents = extents;
+	  data->extents_alloc = alloc;
+	}
+
+      data->extents[data->nextents].offset = offset;
+      data->extents[data->nextents].start = start;
+      data->extents[data->nextents].count = size;
+      data->nextents++;
+    }
+
+  return GRUB_ERR_NONE;
+}
+
+/* Read the NBLOCKS bmap btree blocks at BLOCKS, which are on LEVEL, in
+   batches of XFS_BMAP_BATCH.  The extents in leaves are added to the
+   extent map, the pointers in other nodes are stored in *CHILDREN.  */
+static grub_err_t
+grub_xfs_read_bmap_level (struct grub_xfs_data *data, grub_uint64_t *blocks,
+			  grub_size_t nblocks, int level,
+			  grub_uint64_t **children, grub_size_t *nchildren)
+{
+  struct grub_disk_read_vec vec[XFS_BMAP_BATCH];
+  grub_size_t alloc = 0;
+  grub_size_t i;
+  char *buf;
+
+  *children = 0;
+  *nchildren = 0;
+
+  buf = grub_malloc (XFS_BMAP_BATCH * data->bsize);
+  if (!buf)
+    return grub_errno;
+
+  for (i = 0; i < nblocks; i += XFS_BMAP_BATCH)
+    {
+      unsigned n = XFS_BMAP_BATCH, j;
+
+      if (n > nblocks - i)
+	n = nblocks - i;
+
+      for (j = 0; j < n; j++)
+	{
+	  vec[j].sector = (GRUB_XFS_FSB_TO_BLOCK (data, blocks[i + j])
+			   << (data->sblock.log2_bsize - GRUB_DISK_SECTOR_BITS));
+	  vec[j].offset = 0;
+	  vec[j].size = data->bsize;
+	  vec[j].buf = buf + j * data->bsize;
+	}
+
+      if (grub_disk_read_vec (data->disk, vec, n))
+	goto fail;
+
+      for (j = 0; j < n; j++)
+	{
+	  struct grub_xfs_btree_node *bnode = vec[j].buf;
+	  int nrec = grub_be_to_cpu16 (bnode->numrecs);
+	  int maxrecs = ((data->bsize - ((char *) &bnode->keys - (char *) bnode))
+			 / (2 * sizeof (grub_uint64_t)));
+	  int k;
+
+	  if (grub_strncmp ((char *) bnode->magic, "BMAP", 4))
+	    {
+	      grub_error (GRUB_ERR_BAD_FS, "not a correct XFS BMAP node");
+	      goto fail;
+	    }
+
+	  if (grub_be_to_cpu16 (bnode->level) != level || nrec > maxrecs)
+	    {
+	      grub_error (GRUB_ERR_BAD_FS, "invalid XFS BMAP node");
+	      goto fail;
+	    }
+
+	  if (level == 0)
+	    {
+	      if (grub_xfs_add_extents (data, (grub_xfs_extent *) bnode->keys,
+					nrec))
+		goto fail;
+	      continue;
+	    }
+
+	  if (*nchildren + nrec > alloc)
+	    {
+	      grub_uint64_t *ptrs;
+
+	      alloc = 2 * alloc + nrec;
+	      ptrs = grub_realloc (*children, alloc * sizeof (*ptrs));
+	      if (!ptrs)
+		goto fail;
+	      *children = ptrs;
+	    }
+
+	  for (k = 0; k < nrec; k++)
+	    (*children)[(*nchildren)++]
+	      = grub_be_to_cpu64 (bnode->keys[maxrecs + k]);
+	}
+    }
+
+  grub_free (buf);
+  return GRUB_ERR_NONE;
+
+ fail:
+  grub_free (buf);
+  grub_free (*children);
+  *children = 0;
+  return grub_errno;
+}
+
+/* Make the extent map of DATA describe NODE.  The map is kept until an
+   inode with another number is read.  */
+static grub_err_t
+grub_xfs_load_extents (grub_fshelp_node_t node)
+{
+  struct grub_xfs_data *data = node->data;
+  int literal = ((1 << data->sblock.log2_inode)
+		 - ((char *) &node->inode.data - (char *) &node->inode));
+
+  if (data->extents_valid && data->extents_ino == node->ino)
+    return GRUB_ERR_NONE;
+
+  data->extents_valid = 0;
+  data->extents_ino = node->ino;
+  data->nextents = 0;
+
+  /* The attribute fork, if any, starts FORK_OFFSET * 8 bytes into the
+     literal area.  */
+  if (node->inode.fork_offset)
+    {
+      if ((node->inode.fork_offset << 3) > literal)
+	return grub_error (GRUB_ERR_BAD_FS, "invalid XFS fork offset");
+      literal = node->inode.fork_offset << 3;
+    }
 
   if (node->inode.format == XFS_INODE_FORMAT_BTREE)
     {
-      grub_uint64_t *keys;
-      int recoffset;
-
-      leaf = grub_malloc (node->data->bsize);
-      if (leaf == 0)
-        return 0;
-
-      nrec = grub_be_to_cpu16 (node->inode.data.btree.numrecs);
-      keys = &node->inode.data.btree.keys[0];
-      if (node->inode.fork_offset)
-	recoffset = (node->inode.fork_offset
-		     - ((char *) &node->inode.data.btree.keys - (char *) &node->inode))
-	  / (2 * sizeof (grub_uint64_t));
-      else
-	recoffset = ((1 << node->data->sblock.log2_inode)
-		     - ((char *) &node->inode.data.btree.keys
-			- (char *) &node->inode))
-	  / (2 * sizeof (grub_uint64_t));
-      do
-        {
-          int i;
-
-          for (i = 0; i < nrec; i++)
-            {
-              if (fileblock < grub_be_to_cpu64 (keys[i]))
-                break;
-            }
-
-          /* Sparse block.  */
-          if (i == 0)
-            {
-              grub_free (leaf);
-              return 0;
-            }
-          if (grub_disk_read (node->data->disk,
-                              GRUB_XFS_FSB_TO_BLOCK (node->data, grub_be_to_cpu64 (keys[i - 1 + recoffset])) << (node->data->sblock.log2_bsize - GRUB_DISK_SECTOR_BITS),
-                              0, node->data->bsize, leaf))
-            return 0;
-
-          if (grub_strncmp ((char *) leaf->magic, "BMAP", 4))
-            {
-              grub_free (leaf);
-              grub_error (GRUB_ERR_BAD_FS, "not a correct XFS BMAP node");
-              return 0;
-            }
-
-          nrec = grub_be_to_cpu16 (leaf->numrecs);
-          keys = &leaf->keys[0];
-	  recoffset = ((node->data->bsize - ((char *) &leaf->keys
-					     - (char *) leaf))
+      int level = grub_be_to_cpu16 (node->inode.data.btree.level);
+      int nrec = grub_be_to_cpu16 (node->inode.data.btree.numrecs);
+      int recoffset = ((literal - ((char *) &node->inode.data.btree.keys
+				   - (char *) &node->inode.data))
 		       / (2 * sizeof (grub_uint64_t)));
+      grub_uint64_t *blocks;
+      grub_size_t nblocks;
+      int i;
+
+      if (level == 0 || nrec > recoffset)
+	return grub_error (GRUB_ERR_BAD_FS, "invalid XFS BMAP root");
+
+      blocks = grub_malloc (nrec * sizeof (*blocks));
+      if (!blocks)
+	return grub_errno;
+      for (i = 0; i < nrec; i++)
+	blocks[i] = grub_be_to_cpu64 (node->inode.data.btree.keys[recoffset
+								   + i]);
+      nblocks = nrec;
+
+      /* Read the tree a level at a time, so that many blocks are read
+	 at once instead of walking it from the root for each leaf.  */
+      while (level--)
+	{
+	  grub_uint64_t *children;
+	  grub_size_t nchildren;
+	  grub_err_t err;
+
+	  err = grub_xfs_read_bmap_level (data, blocks, nblocks, level,
+					  &children, &nchildren);
+	  grub_free (blocks);
+	  if (err)
+	    return err;
+	  blocks = children;
+	  nblocks = nchildren;
 	}
-      while (leaf->level);
-      exts = (grub_xfs_extent *) keys;
+      grub_free (blocks);
     }
   else if (node->inode.format == XFS_INODE_FORMAT_EXT)
     {
-      nrec = grub_be_to_cpu32 (node->inode.nextents);
-      exts = &node->inode.data.extents[0];
+      int nrec = grub_be_to_cpu32 (node->inode.nextents);
+
+      if (nrec < 0 || nrec > literal / (int) sizeof (grub_xfs_extent))
+	return grub_error (GRUB_ERR_BAD_FS, "invalid XFS extent count");
+
+      if (grub_xfs_add_extents (data, &node->inode.data.extents[0], nrec))
+	return grub_errno;
     }
   else
-    {
-      grub_error (GRUB_ERR_NOT_IMPLEMENTED_YET,
-		  "XFS does not support inode format %d yet",
-		  node->inode.format);
-      return 0;
-    }
+    return grub_error (GRUB_ERR_NOT_IMPLEMENTED_YET,
+		       "XFS does not support inode format %d yet",
+		       node->inode.format);
 
-  /* Iterate over each extent to figure out which extent has
-     the block we are looking for.  */
-  for (ex = 0; ex < nrec; ex++)
+  data->extents_valid = 1;
+  return GRUB_ERR_NONE;
+}
+
+/* Return the disk block of FILEBLOCK in NODE, or 0 if it is sparse, and
+   set *COUNT to the number of blocks from FILEBLOCK on which are mapped
+   the same way.  */
+static grub_disk_addr_t
+grub_xfs_read_extent (grub_fshelp_node_t node, grub_disk_addr_t fileblock,
+		      grub_disk_addr_t *count)
+{
+  struct grub_xfs_data *data = node->data;
+  grub_size_t lo = 0, hi;
+
+  *count = 1;
+  if (grub_xfs_load_extents (node))
+    return 0;
+
+  /* Find the first extent which ends after FILEBLOCK.  */
+  hi = data->nextents;
+  while (lo < hi)
     {
-      grub_uint64_t start = GRUB_XFS_EXTENT_BLOCK (exts, ex);
-      grub_uint64_t offset = GRUB_XFS_EXTENT_OFFSET (exts, ex);
-      grub_uint64_t size = GRUB_XFS_EXTENT_SIZE (exts, ex);
+      grub_size_t mid = lo + (hi - lo) / 2;
 
-      /* Sparse block.  */
-      if (fileblock < offset)
-        break;
-      else if (fileblock < offset + size)
-        {
-          ret = (fileblock - offset + start);
-          break;
-        }
+      if (data->extents[mid].offset + data->extents[mid].count <= fileblock)
+	lo = mid + 1;
+      else
+	hi = mid;
     }
 
-  grub_free (leaf);
+  /* Sparse block, up to the next extent if there is one.  */
+  if (lo == data->nextents)
+    return 0;
+  if (fileblock < data->extents[lo].offset)
+    {
+      *count = data->extents[lo].offset - fileblock;
+      return 0;
+    }
 
-  return GRUB_XFS_FSB_TO_BLOCK(node->data, ret);
+  *count = data->extents[lo].offset + data->extents[lo].count - fileblock;
+  return data->extents[lo].start + (fileblock - data->extents[lo].offset);
 }
 
 
@@ -385,11 +577,11 @@ grub_xfs_read_file (grub_fshelp_node_t node,
 					unsigned offset, unsigned length),
 		     grub_off_t pos, grub_size_t len, char *buf)
 {
-  return grub_fshelp_read_file (node->data->disk, node, read_hook,
-				pos, len, buf, grub_xfs_read_block,
-				grub_be_to_cpu64 (node->inode.size),
-				node->data->sblock.log2_bsize
-				- GRUB_DISK_SECTOR_BITS, 0);
+  return grub_fshelp_read_file_extents (node->data->disk, node, read_hook,
+					pos, len, buf, grub_xfs_read_extent,
+					grub_be_to_cpu64 (node->inode.size),
+					node->data->sblock.log2_bsize
+					- GRUB_DISK_SECTOR_BITS, 0);
 }
 
 
@@ -703,6 +895,16 @@ grub_xfs_mount (grub_disk_t disk)
 }
 
 
+static void
+grub_xfs_unmount (struct grub_xfs_data *data)
+{
+  if (!data)
+    return;
+  grub_free (data->extents);
+  grub_free (data);
+}
+
+
 static grub_err_t
 grub_xfs_dir (grub_device_t device, const char *path,
 	      int (*hook) (const char *filename,
@@ -747,7 +949,7 @@ grub_xfs_dir (grub_device_t device, const char *path,
  fail:
   if (fdiro != &data->diropen)
     grub_free (fdiro);
-  grub_free (data);
+  grub_xfs_unmount (data);
 
  mount_fail:
 
@@ -800,7 +1002,7 @@ grub_xfs_open (struct grub_file *file, const char *name)
  fail:
   if (fdiro != &data->diropen)
     grub_free (fdiro);
-  grub_free (data);
+  grub_xfs_unmount (data);
 
  mount_fail:
   grub_dl_unref (my_mod);
@@ -823,7 +1025,7 @@ grub_xfs_read (grub_file_t file, char *buf, grub_size_t len)
 static grub_err_t
 grub_xfs_close (grub_file_t file)
 {
-  grub_free (file->data);
+  grub_xfs_unmount (file->data);
 
   grub_dl_unref (my_mod);
 
@@ -847,7 +1049,7 @@ grub_xfs_label (grub_device_t device, char **label)
 
   grub_dl_unref (my_mod);
 
-  grub_free (data);
+  grub_xfs_unmount (data);
 
   return grub_errno;
 }
@@ -878,7 +1080,7 @@ grub_xfs_uuid (grub_device_t device, char **uuid)
 
   grub_dl_unref (my_mod);
 
-  grub_free (data);
+  grub_xfs_unmount (data);
 
   return grub_errno;
 }
@@ -54,6 +54,8 @@
 #include <grub/deflate.h>
 #include <grub/crypto.h>
 #include <grub/i18n.h>
+#include <grub/env.h>
+#include <grub/gf256.h>
 
 GRUB_MOD_LICENSE ("GPLv3+");
 
@@ -157,6 +159,7 @@ ZAP_LEAF_ENTRY(zap_leaf_phys_t *l, int bs, int idx)
  */
 
 extern grub_err_t lzjb_decompress (void *, void *, grub_size_t, grub_size_t);
+extern grub_err_t lz4_decompress (void *, void *, grub_size_t, grub_size_t);
 
 typedef grub_err_t zfs_decomp_func_t (void *s_start, void *d_start,
 				      grub_size_t s_len, grub_size_t d_len);
@@ -208,6 +211,10 @@ struct grub_zfs_device_desc
   grub_disk_addr_t vdev_phys_sector;
   uberblock_t current_uberblock;
   int original;
+  /* Set once a read from the device failed.  Mirrors try it last, and
+     RAID-Z rebuilds its columns from parity without reading them while
+     it has parity to spare.  */
+  int failed;
 };
 
 struct subvolume
@@ -322,6 +329,7 @@ static decomp_entry_t decomp_table[ZIO_COMPRESS_FUNCTIONS] = {
   {"gzip-8", zlib_decompress},  /* ZIO_COMPRESS_GZIP8 */
   {"gzip-9", zlib_decompress},  /* ZIO_COMPRESS_GZIP9 */
   {"zle", zle_decompress},      /* ZIO_COMPRESS_ZLE   */
+  {"lz4", lz4_decompress},      /* ZIO_COMPRESS_LZ4   */
 };
 
 static grub_err_t zio_read_data (blkptr_t * bp, grub_zfs_endian_t endian,
@@ -482,15 +490,13 @@ uberblock_verify (uberblock_phys_t * ub, grub_uint64_t offset,
 
   if (grub_zfs_to_cpu64 (uber->ub_magic, GRUB_ZFS_LITTLE_ENDIAN)
       == UBERBLOCK_MAGIC
-      && grub_zfs_to_cpu64 (uber->ub_version, GRUB_ZFS_LITTLE_ENDIAN) > 0 
-      && grub_zfs_to_cpu64 (uber->ub_version, GRUB_ZFS_LITTLE_ENDIAN)
-      <= SPA_VERSION)
+      && SPA_VERSION_IS_SUPPORTED (grub_zfs_to_cpu64 (uber->ub_version,
+						      GRUB_ZFS_LITTLE_ENDIAN)))
     endian = GRUB_ZFS_LITTLE_ENDIAN;
 
   if (grub_zfs_to_cpu64 (uber->ub_magic, GRUB_ZFS_BIG_ENDIAN) == UBERBLOCK_MAGIC
-      && grub_zfs_to_cpu64 (uber->ub_version, GRUB_ZFS_BIG_ENDIAN) > 0 
-      && grub_zfs_to_cpu64 (uber->ub_version, GRUB_ZFS_BIG_ENDIAN)
-      <= SPA_VERSION)
+      && SPA_VERSION_IS_SUPPORTED (grub_zfs_to_cpu64 (uber->ub_version,
+						      GRUB_ZFS_BIG_ENDIAN)))
     endian = GRUB_ZFS_BIG_ENDIAN;
 
   if (endian == GRUB_ZFS_UNKNOWN_ENDIAN)
@@ -644,6 +650,7 @@ fill_vdev_info_real (struct grub_zfs_data *data,
 	  fill->vdev_phys_sector = insert->vdev_phys_sector;
 	  fill->current_uberblock = insert->current_uberblock;
 	  fill->original = insert->original;
+	  fill->failed = 0;
 	  if (!data->device_original)
 	    data->device_original = fill;
 	  insert->ashift = fill->ashift;
@@ -837,13 +844,12 @@ check_pool_label (struct grub_zfs_data *data,
     }
   grub_dprintf ("zfs", "check 8 passed\n");
 
-  if (version > SPA_VERSION)
+  if (! SPA_VERSION_IS_SUPPORTED (version))
     {
       grub_free (nvlist);
       return grub_error (GRUB_ERR_NOT_IMPLEMENTED_YET,
-			 "too new version %llu > %llu",
-			 (unsigned long long) version,
-			 (unsigned long long) SPA_VERSION);
+			 "unsupported version %llu",
+			 (unsigned long long) version);
     }
   grub_dprintf ("zfs", "check 9 passed\n");
 
@@ -1034,12 +1040,38 @@ static grub_uint8_t powx[255 * 2];
 static int powx_inv[256];
 static const grub_uint8_t poly = 0x1d;
 
+#define GF_CHUNK 512
+
+/* Replace the NBUFS buffers of S bytes in BUFS by their products with
+   the matrix whose rows are the NBUFS tables each in T.  */
+static void
+gf_mul_matrix (grub_uint8_t *bufs[4], grub_size_t s, int nbufs,
+	       const struct grub_gf256_mul_table *t)
+{
+  grub_uint8_t tmp[4][GF_CHUNK];
+  grub_size_t off, n;
+  int j, k;
+
+  for (off = 0; off < s; off += n)
+    {
+      n = s - off < GF_CHUNK ? s - off : GF_CHUNK;
+      for (k = 0; k < nbufs; k++)
+	grub_memcpy (tmp[k], bufs[k] + off, n);
+      for (j = 0; j < nbufs; j++)
+	{
+	  grub_memset (bufs[j] + off, 0, n);
+	  for (k = 0; k < nbufs; k++)
+	    grub_gf256_mul (bufs[j] + off, tmp[k], n, &t[j * nbufs + k], 1);
+	}
+    }
+}
+
 /* perform the operation a ^= b * (x ** (known_idx * recovery_pow) ) */
 static inline void
 xor_out (grub_uint8_t *a, const grub_uint8_t *b, grub_size_t s,
 	 int known_idx, int recovery_pow)
 {
-  int add;
+  struct grub_gf256_mul_table t;
 
   /* Simple xor.  */
   if (known_idx == 0 || recovery_pow == 0)
@@ -1047,10 +1079,8 @@ xor_out (grub_uint8_t *a, const grub_uint8_t *b, grub_size_t s,
       grub_crypto_xor (a, a, b, s);
       return;
     }
-  add = (known_idx * recovery_pow) % 255;
-  for (;s--; b++, a++)
-    if (*b)
-      *a ^= powx[powx_inv[*b] + add];
+  grub_gf256_mul_prepare (&t, powx[(known_idx * recovery_pow) % 255]);
+  grub_gf256_mul (a, b, s, &t, 1);
 }
 
 static inline grub_uint8_t
@@ -1075,49 +1105,40 @@ recovery (grub_uint8_t *bufs[4], grub_size_t s, const int nbufs,
       /* Easy: r_0 = bufs[0] / (x << (powers[i] * idx[j])).  */
     case 1:
       {
-	int add;
-	grub_uint8_t *a;
+	struct grub_gf256_mul_table t;
 	if (powers[0] == 0 || idx[0] == 0)
 	  return GRUB_ERR_NONE;
-	add = 255 - ((powers[0] * idx[0]) % 255);
-	for (a = bufs[0]; s--; a++)
-	  if (*a)
-	    *a = powx[powx_inv[*a] + add];
+	grub_gf256_mul_prepare (&t, powx[255 - ((powers[0] * idx[0]) % 255)]);
+	gf_mul_matrix (bufs, s, 1, &t);
 	return GRUB_ERR_NONE;
       }
       /* Case 2x2: Let's use the determinant formula.  */
     case 2:
       {
 	grub_uint8_t det, det_inv;
-	grub_uint8_t matrixinv[2][2];
-	unsigned i;
+	struct grub_gf256_mul_table t[4];
 	/* The determinant is: */
 	det = (powx[(powers[0] * idx[0] + powers[1] * idx[1]) % 255]
 	       ^ powx[(powers[0] * idx[1] + powers[1] * idx[0]) % 255]);
 	if (det == 0)
 	  return grub_error (GRUB_ERR_BAD_FS, "singular recovery matrix");
 	det_inv = powx[255 - powx_inv[det]];
-	matrixinv[0][0] = gf_mul (powx[(powers[1] * idx[1]) % 255], det_inv);
-	matrixinv[1][1] = gf_mul (powx[(powers[0] * idx[0]) % 255], det_inv);
-	matrixinv[0][1] = gf_mul (powx[(powers[0] * idx[1]) % 255], det_inv);
-	matrixinv[1][0] = gf_mul (powx[(powers[1] * idx[0]) % 255], det_inv);
-	for (i = 0; i < s; i++)
-	  {
-	    grub_uint8_t b0, b1;
-	    b0 = bufs[0][i];
-	    b1 = bufs[1][i];
-
-	    bufs[0][i] = (gf_mul (b0, matrixinv[0][0])
-			  ^ gf_mul (b1, matrixinv[0][1]));
-	    bufs[1][i] = (gf_mul (b0, matrixinv[1][0])
-			  ^ gf_mul (b1, matrixinv[1][1]));
-	  }
+	grub_gf256_mul_prepare
+	  (&t[0], gf_mul (powx[(powers[1] * idx[1]) % 255], det_inv));
+	grub_gf256_mul_prepare
+	  (&t[1], gf_mul (powx[(powers[0] * idx[1]) % 255], det_inv));
+	grub_gf256_mul_prepare
+	  (&t[2], gf_mul (powx[(powers[1] * idx[0]) % 255], det_inv));
+	grub_gf256_mul_prepare
+	  (&t[3], gf_mul (powx[(powers[0] * idx[0]) % 255], det_inv));
+	gf_mul_matrix (bufs, s, 2, t);
 	return GRUB_ERR_NONE;
       }
       /* Otherwise use Gauss.  */
     default:
       {
 	grub_uint8_t matrix1[nbufs][nbufs], matrix2[nbufs][nbufs];
+	struct grub_gf256_mul_table tables[nbufs * nbufs];
 	int i, j, k;
 
 	for (i = 0; i < nbufs; i++)
@@ -1183,23 +1204,34 @@ recovery (grub_uint8_t *bufs[4], grub_size_t s, const int nbufs,
 	      }
 	  }
 
-	for (i = 0; i < (int) s; i++)
-	  {
-	    grub_uint8_t b[nbufs];
-	    for (j = 0; j < nbufs; j++)
-	      b[j] = bufs[j][i];
-	    for (j = 0; j < nbufs; j++)
-	      {
-		bufs[j][i] = 0;
-		for (k = 0; k < nbufs; k++)
-		  bufs[j][i] ^= gf_mul (matrix2[j][k], b[k]);
-	      }
-	  }
+	for (j = 0; j < nbufs; j++)
+	  for (k = 0; k < nbufs; k++)
+	    grub_gf256_mul_prepare (&tables[j * nbufs + k], matrix2[j][k]);
+	gf_mul_matrix (bufs, s, nbufs, tables);
 	return GRUB_ERR_NONE;
       }
     }      
 }
 
+static grub_err_t
+read_device (grub_uint64_t offset, struct grub_zfs_device_desc *desc,
+	     grub_size_t len, void *buf);
+
+/* Too many columns of a RAID-Z stripe failed, counting those of devices
+   that failed before and weren't read.  Those may still have this block,
+   so read it again trying every device.  */
+static grub_err_t
+raidz_read_again (grub_uint64_t offset, struct grub_zfs_device_desc *desc,
+		  grub_size_t len, void *buf)
+{
+  unsigned i;
+
+  for (i = 0; i < desc->n_children; i++)
+    desc->children[i].failed = 0;
+  grub_errno = GRUB_ERR_NONE;
+  return read_device (offset, desc, len, buf);
+}
+
 static grub_err_t
 read_device (grub_uint64_t offset, struct grub_zfs_device_desc *desc,
 	     grub_size_t len, void *buf)
@@ -1209,6 +1241,7 @@ read_device (grub_uint64_t offset, struct grub_zfs_device_desc *desc,
     case DEVICE_LEAF:
       {
 	grub_uint64_t sector;
+	grub_err_t err;
 	sector = DVA_OFFSET_TO_PHYS_SECTOR (offset);
 	if (!desc->dev)
 	  {
@@ -1217,23 +1250,31 @@ read_device (grub_uint64_t offset, struct grub_zfs_device_desc *desc,
 				  "of multi-device filesystem"));
 	  }
 	/* read in a data block */
-	return grub_disk_read (desc->dev->disk, sector, 0, len, buf);
+	err = grub_disk_read (desc->dev->disk, sector, 0, len, buf);
+	if (err)
+	  desc->failed = 1;
+	return err;
       }
     case DEVICE_MIRROR:
       {
 	grub_err_t err = GRUB_ERR_NONE;
 	unsigned i;
+	int failed;
 	if (desc->n_children <= 0)
 	  return grub_error (GRUB_ERR_BAD_FS,
 			     "non-positive number of mirror children");
-	for (i = 0; i < desc->n_children; i++)
-	  {
-	    err = read_device (offset, &desc->children[i],
-			       len, buf);
-	    if (!err)
-	      break;
-	    grub_errno = GRUB_ERR_NONE;
-	  }
+	/* Try the children that haven't failed yet first.  */
+	for (failed = 0; failed < 2; failed++)
+	  for (i = 0; i < desc->n_children; i++)
+	    {
+	      if (desc->children[i].failed != failed)
+		continue;
+	      err = read_device (offset, &desc->children[i],
+				 len, buf);
+	      if (!err)
+		return GRUB_ERR_NONE;
+	      grub_errno = GRUB_ERR_NONE;
+	    }
 	return (grub_errno = err);
       }
     case DEVICE_RAIDZ:
@@ -1249,6 +1290,7 @@ read_device (grub_uint64_t offset, struct grub_zfs_device_desc *desc,
 	grub_size_t recovery_len[4];
 	int recovery_idx[4];
 	unsigned failed_devices = 0;
+	unsigned skipped = 0;
 	int idx, orig_idx;
 
 	if (desc->nparity < 1 || desc->nparity > 3)
@@ -1295,10 +1337,19 @@ read_device (grub_uint64_t offset, struct grub_zfs_device_desc *desc,
 			  PRIxGRUB_UINT64_T ")\n",
 			  offset >> desc->ashift, c, len, bsize, high,
 			  devn);
-	    err = read_device ((high << desc->ashift)
-			       | (offset & ((1 << desc->ashift) - 1)),
-			       &desc->children[devn],
-			       csize, buf);
+	    /* Rebuild the columns of failed devices from parity right away,
+	       as long as that leaves enough parity for the others.  */
+	    if (desc->children[devn].failed
+		&& failed_devices < desc->nparity)
+	      {
+		err = GRUB_ERR_IO;
+		skipped++;
+	      }
+	    else
+	      err = read_device ((high << desc->ashift)
+				 | (offset & ((1 << desc->ashift) - 1)),
+				 &desc->children[devn],
+				 csize, buf);
 	    if (err && failed_devices < desc->nparity)
 	      {
 		recovery_buf[failed_devices] = buf;
@@ -1307,6 +1358,8 @@ read_device (grub_uint64_t offset, struct grub_zfs_device_desc *desc,
 		failed_devices++;
 		grub_errno = err = 0;
 	      }
+	    if (err && skipped)
+	      return raidz_read_again (offset, desc, orig_len, orig_buf);
 	    if (err)
 	      return err;
 
@@ -1352,6 +1405,13 @@ read_device (grub_uint64_t offset, struct grub_zfs_device_desc *desc,
 							 - desc->max_children_ashift))
 					     & 1)),
 				      desc->n_children, &devn);
+		if (desc->children[devn].failed
+		    && n_redundancy + desc->nparity - cur_redundancy_pow - 1
+		    >= failed_devices)
+		  {
+		    skipped++;
+		    continue;
+		  }
 		err = read_device ((high << desc->ashift)
 				   | (offset & ((1 << desc->ashift) - 1)),
 				   &desc->children[devn],
@@ -1364,6 +1424,8 @@ read_device (grub_uint64_t offset, struct grub_zfs_device_desc *desc,
 		    grub_errno = GRUB_ERR_NONE;
 		    continue;
 		  }
+		if (err && skipped)
+		  return raidz_read_again (offset, desc, orig_len, orig_buf);
 		if (err)
 		  return err;
 		redundancy_pow[n_redundancy] = cur_redundancy_pow;
@@ -1551,6 +1613,219 @@ zio_read_data (blkptr_t * bp, grub_zfs_endian_t endian, void *buf,
   return err;
 }
 
+/*
+ * Cache of verified and decompressed blocks, shared by all mounts so that
+ * opening many files from one dataset doesn't read the same metadata for
+ * each of them.  Blocks are identified by the pool, their first DVA, birth
+ * txg and checksum, so a rewritten block never matches a stale entry.
+ */
+struct zfs_cache_entry
+{
+  grub_uint64_t guid;
+  grub_zfs_endian_t endian;
+  dva_t dva;
+  grub_uint64_t birth;
+  zio_cksum_t cksum;
+  grub_size_t size;
+  struct zfs_cache_entry *hash_next;
+  /* The LRU list, most recently used first.  */
+  struct zfs_cache_entry *lru_prev;
+  struct zfs_cache_entry *lru_next;
+  char buf[0];
+};
+
+#define ZFS_CACHE_HASH_SIZE	256
+#define ZFS_CACHE_DEFAULT_SIZE	(4 << 20)
+
+static struct zfs_cache_entry *zfs_cache_hash[ZFS_CACHE_HASH_SIZE];
+static struct zfs_cache_entry *zfs_cache_lru_first, *zfs_cache_lru_last;
+static grub_size_t zfs_cache_used;
+static grub_size_t zfs_cache_max = ZFS_CACHE_DEFAULT_SIZE;
+static unsigned long zfs_cache_hits, zfs_cache_misses;
+
+/* Only metadata is cached.  Plain file contents are mostly read once and
+   would just push metadata out.  */
+static int
+zfs_cache_wanted (const blkptr_t *bp, grub_zfs_endian_t endian)
+{
+  grub_uint64_t prop = grub_zfs_to_cpu64 (bp->blk_prop, endian);
+
+  /* Decrypted data depends on the keys loaded.  */
+  if (BP_IS_HOLE (bp) || ((prop >> 60) & 3))
+    return 0;
+
+  return ((prop >> 56) & 0x1f) != 0
+    || ((prop >> 48) & 0xff) != DMU_OT_PLAIN_FILE_CONTENTS;
+}
+
+static unsigned
+zfs_cache_hash_index (const dva_t *dva, grub_uint64_t birth,
+		      grub_uint64_t guid)
+{
+  grub_uint64_t h;
+
+  h = (dva->dva_word[1] ^ birth ^ guid) * 0x9e3779b97f4a7c15ULL;
+  return h >> 56;
+}
+
+static void
+zfs_cache_unlink_lru (struct zfs_cache_entry *e)
+{
+  if (e->lru_prev)
+    e->lru_prev->lru_next = e->lru_next;
+  else
+    zfs_cache_lru_first = e->lru_next;
+  if (e->lru_next)
+    e->lru_next->lru_prev = e->lru_prev;
+  else
+    zfs_cache_lru_last = e->lru_prev;
+}
+
+static void
+zfs_cache_link_lru (struct zfs_cache_entry *e)
+{
+  e->lru_prev = 0;
+  e->lru_next = zfs_cache_lru_first;
+  if (zfs_cache_lru_first)
+    zfs_cache_lru_first->lru_prev = e;
+  else
+    zfs_cache_lru_last = e;
+  zfs_cache_lru_first = e;
+}
+
+static void
+zfs_cache_remove (struct zfs_cache_entry *e)
+{
+  struct zfs_cache_entry **p;
+
+  for (p = &zfs_cache_hash[zfs_cache_hash_index (&e->dva, e->birth, e->guid)];
+       *p != e; p = &(*p)->hash_next);
+  *p = e->hash_next;
+  zfs_cache_unlink_lru (e);
+  zfs_cache_used -= e->size;
+  grub_free (e);
+}
+
+/* Evict the least recently used blocks until at most MAX bytes are
+   cached.  */
+static void
+zfs_cache_shrink (grub_size_t max)
+{
+  while (zfs_cache_lru_last && zfs_cache_used > max)
+    zfs_cache_remove (zfs_cache_lru_last);
+}
+
+static struct zfs_cache_entry *
+zfs_cache_find (const blkptr_t *bp, grub_zfs_endian_t endian,
+		struct grub_zfs_data *data)
+{
+  struct zfs_cache_entry *e;
+
+  for (e = zfs_cache_hash[zfs_cache_hash_index (&bp->blk_dva[0],
+						bp->blk_birth, data->guid)];
+       e; e = e->hash_next)
+    if (e->guid == data->guid && e->endian == endian
+	&& e->birth == bp->blk_birth
+	&& grub_memcmp (&e->dva, &bp->blk_dva[0], sizeof (e->dva)) == 0
+	&& grub_memcmp (&e->cksum, &bp->blk_cksum, sizeof (e->cksum)) == 0)
+      return e;
+
+  return 0;
+}
+
+/* Return a copy of the cached block BP in BUF if there is one.  */
+static int
+zfs_cache_get (const blkptr_t *bp, grub_zfs_endian_t endian,
+	       struct grub_zfs_data *data, void **buf, grub_size_t size)
+{
+  struct zfs_cache_entry *e;
+
+  e = zfs_cache_find (bp, endian, data);
+  if (! e || e->size != size)
+    {
+      zfs_cache_misses++;
+      return 0;
+    }
+
+  *buf = grub_malloc (size);
+  if (! *buf)
+    {
+      grub_errno = GRUB_ERR_NONE;
+      return 0;
+    }
+  grub_memcpy (*buf, e->buf, size);
+
+  zfs_cache_unlink_lru (e);
+  zfs_cache_link_lru (e);
+  zfs_cache_hits++;
+  return 1;
+}
+
+/* Add the verified and decompressed block BP.  Failing to do so isn't an
+   error.  */
+static void
+zfs_cache_put (const blkptr_t *bp, grub_zfs_endian_t endian,
+	       struct grub_zfs_data *data, const void *buf, grub_size_t size)
+{
+  struct zfs_cache_entry *e;
+  unsigned h;
+
+  /* Don't let a single block flush most of the cache.  */
+  if (size > zfs_cache_max / 4 || zfs_cache_find (bp, endian, data))
+    return;
+
+  zfs_cache_shrink (zfs_cache_max - size);
+
+  e = grub_malloc (sizeof (*e) + size);
+  if (! e)
+    {
+      grub_errno = GRUB_ERR_NONE;
+      return;
+    }
+
+  e->guid = data->guid;
+  e->endian = endian;
+  e->dva = bp->blk_dva[0];
+  e->birth = bp->blk_birth;
+  e->cksum = bp->blk_cksum;
+  e->size = size;
+  grub_memcpy (e->buf, buf, size);
+
+  h = zfs_cache_hash_index (&e->dva, e->birth, e->guid);
+  e->hash_next = zfs_cache_hash[h];
+  zfs_cache_hash[h] = e;
+  zfs_cache_link_lru (e);
+  zfs_cache_used += size;
+}
+
+/* Set the cache size in KiB from the zfs_cache_size variable.  An empty
+   value restores the default.  */
+static char *
+zfs_cache_size_write (struct grub_env_var *var __attribute__ ((unused)),
+		      const char *val)
+{
+  char *end;
+  unsigned long kib;
+
+  if (! *val)
+    zfs_cache_max = ZFS_CACHE_DEFAULT_SIZE;
+  else
+    {
+      kib = grub_strtoul (val, &end, 0);
+      if (grub_errno)
+	return NULL;
+      if (*end)
+	{
+	  grub_error (GRUB_ERR_BAD_NUMBER, N_("unrecognized number"));
+	  return NULL;
+	}
+      zfs_cache_max = (grub_size_t) kib << 10;
+    }
+
+  zfs_cache_shrink (zfs_cache_max);
+  return grub_strdup (val);
+}
+
 /*
  * Read in a block of data, verify its checksum, decompress if needed,
  * and put the uncompressed data in buf.
@@ -1565,6 +1840,7 @@ zio_read (blkptr_t *bp, grub_zfs_endian_t endian, void **buf,
   grub_err_t err;
   zio_cksum_t zc = bp->blk_cksum;
   grub_uint32_t checksum;
+  int cache;
 
   *buf = NULL;
 
@@ -1587,6 +1863,10 @@ zio_read (blkptr_t *bp, grub_zfs_endian_t endian, void **buf,
     return grub_error (GRUB_ERR_NOT_IMPLEMENTED_YET,
 		       "compression algorithm %s not supported\n", decomp_table[comp].name);
 
+  cache = zfs_cache_wanted (bp, endian);
+  if (cache && zfs_cache_get (bp, endian, data, buf, lsize))
+    return GRUB_ERR_NONE;
+
   if (comp != ZIO_COMPRESS_OFF)
     {
       /* It's not really necessary to align to 16, just for safety.  */
@@ -1683,6 +1963,9 @@ zio_read (blkptr_t *bp, grub_zfs_endian_t endian, void **buf,
 	}
     }
 
+  if (cache)
+    zfs_cache_put (bp, endian, data, *buf, lsize);
+
   return GRUB_ERR_NONE;
 }
 
@@ -3307,10 +3590,66 @@ unmount_device (struct grub_zfs_device_desc *desc)
     }
 }
 
+/* Features which GRUB can read pools with, when they are active.  */
+static const char *spa_feature_names[] = {
+  "org.illumos:lz4_compress",
+  "com.delphix:hole_birth",
+  NULL
+};
+
+/* Refuse pools which use features that GRUB doesn't know about.  */
+static grub_err_t
+check_mos_features (struct grub_zfs_data *data)
+{
+  dnode_end_t dn;
+  grub_uint64_t objnum;
+  grub_err_t err;
+
+  auto int NESTED_FUNC_ATTR check_feature (const char *name,
+					   grub_uint64_t val);
+
+  int NESTED_FUNC_ATTR check_feature (const char *name, grub_uint64_t val)
+  {
+    int i;
+
+    /* Enabled, but not in use.  */
+    if (val == 0)
+      return 0;
+
+    for (i = 0; spa_feature_names[i]; i++)
+      if (grub_strcmp (name, spa_feature_names[i]) == 0)
+	return 0;
+
+    grub_error (GRUB_ERR_NOT_IMPLEMENTED_YET,
+		"unsupported pool feature %s", name);
+    return 1;
+  }
+
+  err = dnode_get (&data->mos, DMU_POOL_DIRECTORY_OBJECT,
+		   DMU_OT_OBJECT_DIRECTORY, &dn, data);
+  if (err)
+    return err;
+
+  err = zap_lookup (&dn, DMU_POOL_FEATURES_FOR_READ, &objnum, data, 0);
+  if (err)
+    return err;
+
+  err = dnode_get (&data->mos, objnum, 0, &dn, data);
+  if (err)
+    return err;
+
+  zap_iterate_u64 (&dn, check_feature, data);
+  return grub_errno;
+}
+
 static void
 zfs_unmount (struct grub_zfs_data *data)
 {
   unsigned i;
+
+  grub_dprintf ("zfs", "block cache: %lu hits, %lu misses, %lu KiB used\n",
+		zfs_cache_hits, zfs_cache_misses,
+		(unsigned long) (zfs_cache_used >> 10));
   for (i = 0; i < data->n_devices_attached; i++)
     unmount_device (&data->devices_attached[i]);
   grub_free (data->devices_attached);
@@ -3393,6 +3732,13 @@ zfs_mount (grub_device_t dev)
 					 ub_endian) >> 63) & 1;
   grub_free (osp);
 
+  if (grub_zfs_to_cpu64 (ub->ub_version, ub_endian) == SPA_VERSION_FEATURES
+      && check_mos_features (data))
+    {
+      zfs_unmount (data);
+      return NULL;
+    }
+
   data->mounted = 1;
 
   return data;
@@ -3963,6 +4309,12 @@ GRUB_MOD_INIT (zfs)
 {
   COMPILE_TIME_ASSERT (sizeof (zap_leaf_chunk_t) == ZAP_LEAF_CHUNKSIZE);
   grub_fs_register (&grub_zfs_fs);
+  if (grub_env_get ("zfs_cache_size"))
+    {
+      zfs_cache_size_write (0, grub_env_get ("zfs_cache_size"));
+      grub_errno = GRUB_ERR_NONE;
+    }
+  grub_register_variable_hook ("zfs_cache_size", 0, zfs_cache_size_write);
 #ifndef GRUB_UTIL
   my_mod = mod;
 #endif
@@ -3970,5 +4322,7 @@ GRUB_MOD_INIT (zfs)
 
 GRUB_MOD_FINI (zfs)
 {
+  grub_register_variable_hook ("zfs_cache_size", 0, 0);
+  zfs_cache_shrink (0);
   grub_fs_unregister (&grub_zfs_fs);
 }
@@ -37,6 +37,9 @@
 #include <grub/zfs/dmu_objset.h>
 #include <grub/zfs/dsl_dir.h>
 #include <grub/zfs/dsl_dataset.h>
+#if (defined (GRUB_MACHINE_EMU) || defined (GRUB_UTIL)) && defined (__x86_64__)
+#include <grub/i386/cpuid.h>
+#endif
 
 void
 fletcher_2(const void *buf, grub_uint64_t size, grub_zfs_endian_t endian, 
@@ -60,25 +63,314 @@ fletcher_2(const void *buf, grub_uint64_t size, grub_zfs_endian_t endian,
   zcp->zc_word[3] = grub_cpu_to_zfs64 (b1, endian);
 }
 
-void
-fletcher_4 (const void *buf, grub_uint64_t size, grub_zfs_endian_t endian, 
-	    zio_cksum_t *zcp)
+/* Running fletcher-4 sums.  */
+struct fletcher_4_ctx
 {
-  const grub_uint32_t *ip = buf;
-  const grub_uint32_t *ipend = ip + (size / sizeof (grub_uint32_t));
   grub_uint64_t a, b, c, d;
-  
-  for (a = b = c = d = 0; ip < ipend; ip++) 
+};
+
+/* A fletcher-4 implementation.  SUM adds N words at IP to CTX, byte
+   swapping them if SWAP is set.  N is a multiple of STRIDE, and unless
+   STRIDE is 1, CTX is zero on entry.  */
+struct fletcher_4_impl
+{
+  const char *name;
+  int (*usable) (void);
+  void (*sum) (const grub_uint32_t *ip, grub_size_t n, int swap,
+	       struct fletcher_4_ctx *ctx);
+  grub_size_t stride;
+};
+
+static void
+fletcher_4_scalar (const grub_uint32_t *ip, grub_size_t n, int swap,
+		   struct fletcher_4_ctx *ctx)
+{
+  const grub_uint32_t *ipend = ip + n;
+  grub_uint64_t a = ctx->a, b = ctx->b, c = ctx->c, d = ctx->d;
+
+  if (swap)
+    for (; ip < ipend; ip++)
+      {
+	a += grub_swap_bytes32 (*ip);
+	b += a;
+	c += b;
+	d += c;
+      }
+  else
+    for (; ip < ipend; ip++)
+      {
+	a += *ip;
+	b += a;
+	c += b;
+	d += c;
+      }
+
+  ctx->a = a;
+  ctx->b = b;
+  ctx->c = c;
+  ctx->d = d;
+}
+
+#if defined (GRUB_MACHINE_EMU) || defined (GRUB_UTIL)
+
+/* The four-lane striped algorithm OpenZFS uses: lane I sums the words I,
+   I + 4, I + 8, ... on its own, so the lanes fit in vector registers.  The
+   lane sums are combined into the sums of the whole buffer at the end.  */
+typedef grub_uint64_t fletcher_4_vec __attribute__ ((vector_size (32)));
+
+/* Combine the lane sums.  With T words per lane, word I of lane L is
+   4T - L words from the end, and the weights of word I in the sums of
+   the whole buffer follow from those in its lane.  */
+static void
+fletcher_4_combine (const grub_uint64_t *a, const grub_uint64_t *b,
+		    const grub_uint64_t *c, const grub_uint64_t *d,
+		    struct fletcher_4_ctx *ctx)
+{
+  ctx->a = a[0] + a[1] + a[2] + a[3];
+  ctx->b = 4 * (b[0] + b[1] + b[2] + b[3]) - a[1] - 2 * a[2] - 3 * a[3];
+  ctx->c = 16 * (c[0] + c[1] + c[2] + c[3])
+    - 6 * b[0] - 10 * b[1] - 14 * b[2] - 18 * b[3] + a[2] + 3 * a[3];
+  ctx->d = 64 * (d[0] + d[1] + d[2] + d[3])
+    - 48 * c[0] - 64 * c[1] - 80 * c[2] - 96 * c[3]
+    + 4 * b[0] + 10 * b[1] + 20 * b[2] + 34 * b[3] - a[3];
+}
+
+static inline __attribute__ ((always_inline)) void
+fletcher_4_lanes (const grub_uint32_t *ip, grub_size_t n, int swap,
+		  struct fletcher_4_ctx *ctx)
+{
+  const grub_uint32_t *ipend = ip + n;
+  fletcher_4_vec a = { 0, 0, 0, 0 }, b = a, c = a, d = a;
+  grub_uint64_t la[4], lb[4], lc[4], ld[4];
+  int i;
+
+  if (swap)
+    for (; ip < ipend; ip += 4)
+      {
+	fletcher_4_vec x = { grub_swap_bytes32 (ip[0]),
+			     grub_swap_bytes32 (ip[1]),
+			     grub_swap_bytes32 (ip[2]),
+			     grub_swap_bytes32 (ip[3]) };
+	a += x;
+	b += a;
+	c += b;
+	d += c;
+      }
+  else
+    for (; ip < ipend; ip += 4)
+      {
+	fletcher_4_vec x = { ip[0], ip[1], ip[2], ip[3] };
+	a += x;
+	b += a;
+	c += b;
+	d += c;
+      }
+
+  for (i = 0; i < 4; i++)
+    {
+      la[i] = a[i];
+      lb[i] = b[i];
+      lc[i] = c[i];
+      ld[i] = d[i];
+    }
+  fletcher_4_combine (la, lb, lc, ld, ctx);
+}
+
+/* Vector code for whatever the compiler targets by default, SSE2 on
+   x86_64.  */
+static void
+fletcher_4_generic (const grub_uint32_t *ip, grub_size_t n, int swap,
+		    struct fletcher_4_ctx *ctx)
+{
+  fletcher_4_lanes (ip, n, swap, ctx);
+}
+
+#if defined (__x86_64__) && GNUC_PREREQ (4, 9)
+#define FLETCHER_4_AVX2 1
+
+static void __attribute__ ((target ("avx2")))
+fletcher_4_avx2 (const grub_uint32_t *ip, grub_size_t n, int swap,
+		 struct fletcher_4_ctx *ctx)
+{
+  fletcher_4_lanes (ip, n, swap, ctx);
+}
+
+static int
+fletcher_4_avx2_usable (void)
+{
+  grub_uint32_t eax, ebx, ecx, edx;
+
+  grub_cpuid_count (0, 0, &eax, &ebx, &ecx, &edx);
+  if (eax < 7)
+    return 0;
+
+  /* The OS must save the YMM registers.  */
+  grub_cpuid_count (1, 0, &eax, &ebx, &ecx, &edx);
+  if (! (ecx & (1 << 27)) || ! (ecx & (1 << 28))
+      || (grub_xgetbv (0) & 6) != 6)
+    return 0;
+
+  grub_cpuid_count (7, 0, &eax, &ebx, &ecx, &edx);
+  return !! (ebx & (1 << 5));
+}
+#endif
+
+#endif
+
+/* In order of preference.  The scalar code must come last.  */
+static const struct fletcher_4_impl fletcher_4_impls[] =
+  {
+#ifdef FLETCHER_4_AVX2
+    { "avx2", fletcher_4_avx2_usable, fletcher_4_avx2, 4 },
+#endif
+#if defined (GRUB_MACHINE_EMU) || defined (GRUB_UTIL)
+    { "generic", 0, fletcher_4_generic, 4 },
+#endif
+    { "scalar", 0, fletcher_4_scalar, 1 }
+  };
+
+#define FLETCHER_4_NIMPLS	ARRAY_SIZE (fletcher_4_impls)
+
+static const struct fletcher_4_impl *fletcher_4_best;
+
+static void
+fletcher_4_run (const struct fletcher_4_impl *impl, const void *buf,
+		grub_uint64_t size, grub_zfs_endian_t endian,
+		zio_cksum_t *zcp)
+{
+  const grub_uint32_t *ip = buf;
+  grub_size_t n = size / sizeof (grub_uint32_t);
+  grub_size_t bulk = n - n % impl->stride;
+  int swap = (grub_zfs_to_cpu32 (1, endian) != 1);
+  struct fletcher_4_ctx ctx = { 0, 0, 0, 0 };
+
+  if (bulk)
+    impl->sum (ip, bulk, swap, &ctx);
+  fletcher_4_scalar (ip + bulk, n - bulk, swap, &ctx);
+
+  zcp->zc_word[0] = grub_cpu_to_zfs64 (ctx.a, endian);
+  zcp->zc_word[1] = grub_cpu_to_zfs64 (ctx.b, endian);
+  zcp->zc_word[2] = grub_cpu_to_zfs64 (ctx.c, endian);
+  zcp->zc_word[3] = grub_cpu_to_zfs64 (ctx.d, endian);
+}
+
+#define FLETCHER_4_TEST_SIZE	4108
+
+/* Return nonzero if IMPL doesn't agree with the scalar code.  */
+static int
+fletcher_4_check (const struct fletcher_4_impl *impl,
+		  const grub_uint8_t *buf)
+{
+  static const grub_uint64_t sizes[] = { 0, 4, 12, 64, 4096,
+					 FLETCHER_4_TEST_SIZE };
+  const struct fletcher_4_impl *scalar
+    = &fletcher_4_impls[FLETCHER_4_NIMPLS - 1];
+  zio_cksum_t zc, ref;
+  unsigned i;
+
+  for (i = 0; i < ARRAY_SIZE (sizes); i++)
     {
-      a += grub_zfs_to_cpu32 (ip[0], endian);;
-      b += a;
-      c += b;
-      d += c;
+      fletcher_4_run (impl, buf, sizes[i], GRUB_ZFS_LITTLE_ENDIAN, &zc);
+      fletcher_4_run (scalar, buf, sizes[i], GRUB_ZFS_LITTLE_ENDIAN, &ref);
+      if (grub_memcmp (&zc, &ref, sizeof (zc)) != 0)
+	return 1;
+      fletcher_4_run (impl, buf, sizes[i], GRUB_ZFS_BIG_ENDIAN, &zc);
+      fletcher_4_run (scalar, buf, sizes[i], GRUB_ZFS_BIG_ENDIAN, &ref);
+      if (grub_memcmp (&zc, &ref, sizeof (zc)) != 0)
+	return 1;
     }
 
-  zcp->zc_word[0] = grub_cpu_to_zfs64 (a, endian);
-  zcp->zc_word[1] = grub_cpu_to_zfs64 (b, endian);
-  zcp->zc_word[2] = grub_cpu_to_zfs64 (c, endian);
-  zcp->zc_word[3] = grub_cpu_to_zfs64 (d, endian);
+  return 0;
 }
 
+static grub_uint8_t *
+fletcher_4_test_buffer (void)
+{
+  grub_uint8_t *buf;
+  grub_uint32_t x = 1;
+  unsigned i;
+
+  buf = grub_malloc (FLETCHER_4_TEST_SIZE);
+  if (! buf)
+    return NULL;
+
+  /* Start with all ones, so that the sums wrap around early.  */
+  for (i = 0; i < FLETCHER_4_TEST_SIZE; i++)
+    {
+      x = x * 1103515245 + 12345;
+      buf[i] = (i < 1024) ? 0xff : (x >> 16);
+    }
+
+  return buf;
+}
+
+/* Check that all the usable implementations agree with the scalar code.
+   Returns the number of those that don't.  */
+int
+fletcher_4_self_test (void)
+{
+  grub_uint8_t *buf;
+  int failed = 0;
+  unsigned i;
+
+  buf = fletcher_4_test_buffer ();
+  if (! buf)
+    {
+      grub_errno = GRUB_ERR_NONE;
+      return 0;
+    }
+
+  for (i = 0; i + 1 < FLETCHER_4_NIMPLS; i++)
+    if ((! fletcher_4_impls[i].usable || fletcher_4_impls[i].usable ())
+	&& fletcher_4_check (&fletcher_4_impls[i], buf))
+      {
+	grub_dprintf ("zfs", "fletcher4 %s is broken\n",
+		      fletcher_4_impls[i].name);
+	failed++;
+      }
+
+  grub_free (buf);
+  return failed;
+}
+
+/* Pick the first usable implementation that passes the self test.  */
+static const struct fletcher_4_impl *
+fletcher_4_select (void)
+{
+  const struct fletcher_4_impl *impl;
+  grub_uint8_t *buf;
+  unsigned i;
+
+  impl = &fletcher_4_impls[FLETCHER_4_NIMPLS - 1];
+  if (FLETCHER_4_NIMPLS == 1)
+    return impl;
+
+  buf = fletcher_4_test_buffer ();
+  if (! buf)
+    {
+      grub_errno = GRUB_ERR_NONE;
+      return impl;
+    }
+
+  for (i = 0; i + 1 < FLETCHER_4_NIMPLS; i++)
+    if ((! fletcher_4_impls[i].usable || fletcher_4_impls[i].usable ())
+	&& ! fletcher_4_check (&fletcher_4_impls[i], buf))
+      {
+	impl = &fletcher_4_impls[i];
+	break;
+      }
+
+  grub_free (buf);
+  grub_dprintf ("zfs", "using %s fletcher4\n", impl->name);
+  return impl;
+}
+
+void
+fletcher_4 (const void *buf, grub_uint64_t size, grub_zfs_endian_t endian, 
+	    zio_cksum_t *zcp)
+{
+  if (! fletcher_4_best)
+    fletcher_4_best = fletcher_4_select ();
+
+  fletcher_4_run (fletcher_4_best, buf, size, endian, zcp);
+}
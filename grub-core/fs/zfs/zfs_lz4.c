@@ -0,0 +1,156 @@
+/*
+ *  GRUB  --  GRand Unified Bootloader
+ *  Copyright (C) 2013  Free Software Foundation, Inc.
+ *
+ *  GRUB is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  GRUB is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with GRUB.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <grub/err.h>
+#include <grub/misc.h>
+#include <grub/types.h>
+
+/*
+ * Decompression Entry - lz4
+ *
+ * ZFS stores the size of the compressed data as a 32-bit big-endian
+ * number, followed by a raw lz4 block: a sequence of literal runs, each
+ * followed by a match in the data already decompressed, except the last.
+ */
+
+#define LZ4_HEADER_SIZE	4
+#define LZ4_MIN_MATCH	4
+#define LZ4_RUN_MASK	15
+#define LZ4_WORD	sizeof (grub_uint64_t)
+
+grub_err_t
+lz4_decompress (void *s_start, void *d_start, grub_size_t s_len,
+		grub_size_t d_len);
+
+/* Copy LEN bytes from SRC to DST a word at a time.  Up to a word minus
+   one more bytes are read and written, so the caller must make sure
+   they exist.  */
+static inline void
+lz4_copy_words (grub_uint8_t *dst, const grub_uint8_t *src, grub_size_t len)
+{
+  grub_uint8_t *end = dst + len;
+
+  do
+    {
+      grub_set_unaligned64 (dst, grub_get_unaligned64 (src));
+      dst += LZ4_WORD;
+      src += LZ4_WORD;
+    }
+  while (dst < end);
+}
+
+/* Add the length extension bytes at *SRC to LEN.  */
+static inline int
+lz4_get_length (const grub_uint8_t **src, const grub_uint8_t *s_end,
+		grub_size_t *len)
+{
+  grub_uint8_t b;
+
+  do
+    {
+      if (*src >= s_end)
+	return 0;
+      b = *(*src)++;
+      *len += b;
+    }
+  while (b == 255);
+
+  return 1;
+}
+
+grub_err_t
+lz4_decompress (void *s_start, void *d_start, grub_size_t s_len,
+		grub_size_t d_len)
+{
+  const grub_uint8_t *src = s_start;
+  const grub_uint8_t *s_end;
+  grub_uint8_t *dst = d_start;
+  grub_uint8_t *d_end = dst + d_len;
+  grub_uint32_t bufsiz;
+
+  if (s_len < LZ4_HEADER_SIZE)
+    return grub_error (GRUB_ERR_BAD_FS, "lz4 decompression failed");
+
+  bufsiz = grub_be_to_cpu32 (grub_get_unaligned32 (src));
+  if (bufsiz > s_len - LZ4_HEADER_SIZE)
+    return grub_error (GRUB_ERR_BAD_FS, "lz4 decompression failed");
+  src += LZ4_HEADER_SIZE;
+  s_end = src + bufsiz;
+
+  while (src < s_end)
+    {
+      unsigned token = *src++;
+      grub_size_t len, offset;
+      const grub_uint8_t *match;
+
+      /* Literals.  */
+      len = token >> 4;
+      if (len == LZ4_RUN_MASK && ! lz4_get_length (&src, s_end, &len))
+	break;
+      if (len > (grub_size_t) (s_end - src)
+	  || len > (grub_size_t) (d_end - dst))
+	break;
+      if ((grub_size_t) (s_end - src) >= len + LZ4_WORD
+	  && (grub_size_t) (d_end - dst) >= len + LZ4_WORD)
+	lz4_copy_words (dst, src, len);
+      else
+	grub_memcpy (dst, src, len);
+      src += len;
+      dst += len;
+
+      /* The last sequence has no match.  */
+      if (src == s_end)
+	{
+	  /* ZFS compresses whole blocks, but don't leave garbage if
+	     there is less data.  */
+	  grub_memset (dst, 0, d_end - dst);
+	  return GRUB_ERR_NONE;
+	}
+
+      /* Match.  */
+      if (s_end - src < 2)
+	break;
+      offset = src[0] | (src[1] << 8);
+      src += 2;
+      if (offset == 0 || offset > (grub_size_t) (dst - (grub_uint8_t *) d_start))
+	break;
+      match = dst - offset;
+
+      len = token & LZ4_RUN_MASK;
+      if (len == LZ4_RUN_MASK && ! lz4_get_length (&src, s_end, &len))
+	break;
+      len += LZ4_MIN_MATCH;
+      if (len > (grub_size_t) (d_end - dst))
+	break;
+
+      /* Words can be copied as long as each one is read before it's
+	 written, i.e. unless the match overlaps by less than a word.  */
+      if (offset >= LZ4_WORD && (grub_size_t) (d_end - dst) >= len + LZ4_WORD)
+	lz4_copy_words (dst, match, len);
+      else
+	{
+	  grub_size_t i;
+
+	  for (i = 0; i < len; i++)
+	    dst[i] = match[i];
+	}
+      dst += len;
+    }
+
+  return grub_error (GRUB_ERR_BAD_FS, "lz4 decompression failed");
+}
@@ -37,13 +37,17 @@
 #include <grub/zfs/dmu_objset.h>
 #include <grub/zfs/dsl_dir.h>
 #include <grub/zfs/dsl_dataset.h>
+#if (defined (GRUB_MACHINE_EMU) || defined (GRUB_UTIL)) && defined (__x86_64__)
+#include <grub/i386/cpuid.h>
+#endif
 
 /*
  * SHA-256 checksum, as specified in FIPS 180-2, available at:
  * http://csrc.nist.gov/cryptval
  *
  * This is a very compact implementation of SHA-256.
- * It is designed to be simple and portable, not to be fast.
+ * It is designed to be simple and portable, not to be fast.  The host
+ * builds use the SHA extensions instead when the CPU has them.
  */
 
 /*
@@ -107,31 +111,189 @@ SHA256Transform(grub_uint32_t *H, const grub_uint8_t *cp)
 	H[4] += e; H[5] += f; H[6] += g; H[7] += h;
 }
 
-void
-zio_checksum_SHA256(const void *buf, grub_uint64_t size,
-		    grub_zfs_endian_t endian, zio_cksum_t *zcp)
+static void
+sha256_blocks_scalar (grub_uint32_t *H, const grub_uint8_t *cp,
+		      grub_size_t nblocks)
+{
+  for (; nblocks; nblocks--, cp += 64)
+    SHA256Transform (H, cp);
+}
+
+#if (defined (GRUB_MACHINE_EMU) || defined (GRUB_UTIL)) \
+  && defined (__x86_64__) && GNUC_PREREQ (4, 9) && ! defined (__clang__)
+#define SHA256_SHANI 1
+
+/*
+ * SHA-256 with the SHA extensions.  The state is kept as ABEF and CDGH,
+ * SHA256RNDS2 does two rounds, SHA256MSG1 and SHA256MSG2 extend the
+ * message schedule four words at a time.  The intrinsics headers need
+ * the C library, so the compiler builtins are used directly.
+ */
+typedef int sha256_v4si __attribute__ ((vector_size (16)));
+typedef unsigned sha256_v4su __attribute__ ((vector_size (16)));
+typedef long long sha256_v2di __attribute__ ((vector_size (16)));
+typedef short sha256_v8hi __attribute__ ((vector_size (16)));
+typedef char sha256_v16qi __attribute__ ((vector_size (16)));
+typedef int sha256_v4si_u __attribute__ ((vector_size (16), aligned (1),
+					  may_alias));
+
+#define SHANI_ALIGNR(a, b, n) \
+  ((sha256_v4si) __builtin_ia32_palignr128 ((sha256_v2di) (a), \
+					    (sha256_v2di) (b), (n) * 8))
+#define SHANI_ADD(a, b) \
+  ((sha256_v4si) ((sha256_v4su) (a) + (sha256_v4su) (b)))
+#define SHANI_BLEND(a, b, mask) \
+  ((sha256_v4si) __builtin_ia32_pblendw128 ((sha256_v8hi) (a), \
+					    (sha256_v8hi) (b), (mask)))
+
+/* Four rounds with the message words in W.  */
+#define SHANI_ROUNDS(w, t)						\
+  do {									\
+    msg = SHANI_ADD (w, *(const sha256_v4si_u *) &SHA256_K[4 * (t)]);	\
+    state1 = __builtin_ia32_sha256rnds2 (state1, state0, msg);		\
+    msg = __builtin_ia32_pshufd (msg, 0x0e);				\
+    state0 = __builtin_ia32_sha256rnds2 (state0, state1, msg);		\
+  } while (0)
+
+/* Load message words T * 4 to T * 4 + 3.  */
+#define SHANI_LOAD(w, t)						\
+  (w) = (sha256_v4si) __builtin_ia32_pshufb128				\
+    ((sha256_v16qi) *(const sha256_v4si_u *) (cp + 16 * (t)), bswap)
+
+/* Finish the next message words in NEXT from the current ones in CUR and
+   the previous ones in PREV.  */
+#define SHANI_SCHEDULE(next, cur, prev)					\
+  (next) = __builtin_ia32_sha256msg2 (SHANI_ADD (next,			\
+						  SHANI_ALIGNR (cur, prev, 4)),	\
+				      (cur))
+
+/* Rounds T * 4 to T * 4 + 3 past the first sixteen: CUR holds their
+   message words; NEXT and PREV those after and before.  */
+#define SHANI_STEP(t, cur, next, prev)					\
+  do {									\
+    SHANI_ROUNDS (cur, t);						\
+    SHANI_SCHEDULE (next, cur, prev);					\
+    (prev) = __builtin_ia32_sha256msg1 ((prev), (cur));			\
+  } while (0)
+
+static void __attribute__ ((target ("sha,sse4.1")))
+sha256_blocks_shani (grub_uint32_t *H, const grub_uint8_t *cp,
+		     grub_size_t nblocks)
+{
+  const sha256_v16qi bswap = { 3, 2, 1, 0, 7, 6, 5, 4,
+			       11, 10, 9, 8, 15, 14, 13, 12 };
+  sha256_v4si state0, state1, save0, save1, tmp, msg;
+  sha256_v4si w0, w1, w2, w3;
+
+  tmp = __builtin_ia32_pshufd (*(sha256_v4si_u *) &H[0], 0xb1);
+  state1 = __builtin_ia32_pshufd (*(sha256_v4si_u *) &H[4], 0x1b);
+  state0 = SHANI_ALIGNR (tmp, state1, 8);
+  state1 = SHANI_BLEND (state1, tmp, 0xf0);
+
+  for (; nblocks; nblocks--, cp += 64)
+    {
+      save0 = state0;
+      save1 = state1;
+
+      SHANI_LOAD (w0, 0);
+      SHANI_ROUNDS (w0, 0);
+      SHANI_LOAD (w1, 1);
+      SHANI_ROUNDS (w1, 1);
+      w0 = __builtin_ia32_sha256msg1 (w0, w1);
+      SHANI_LOAD (w2, 2);
+      SHANI_ROUNDS (w2, 2);
+      w1 = __builtin_ia32_sha256msg1 (w1, w2);
+      SHANI_LOAD (w3, 3);
+      SHANI_STEP (3, w3, w0, w2);
+      SHANI_STEP (4, w0, w1, w3);
+      SHANI_STEP (5, w1, w2, w0);
+      SHANI_STEP (6, w2, w3, w1);
+      SHANI_STEP (7, w3, w0, w2);
+      SHANI_STEP (8, w0, w1, w3);
+      SHANI_STEP (9, w1, w2, w0);
+      SHANI_STEP (10, w2, w3, w1);
+      SHANI_STEP (11, w3, w0, w2);
+      SHANI_STEP (12, w0, w1, w3);
+      SHANI_ROUNDS (w1, 13);
+      SHANI_SCHEDULE (w2, w1, w0);
+      SHANI_ROUNDS (w2, 14);
+      SHANI_SCHEDULE (w3, w2, w1);
+      SHANI_ROUNDS (w3, 15);
+
+      state0 = SHANI_ADD (state0, save0);
+      state1 = SHANI_ADD (state1, save1);
+    }
+
+  tmp = __builtin_ia32_pshufd (state0, 0x1b);
+  state1 = __builtin_ia32_pshufd (state1, 0xb1);
+  *(sha256_v4si_u *) &H[0] = SHANI_BLEND (tmp, state1, 0xf0);
+  *(sha256_v4si_u *) &H[4] = SHANI_ALIGNR (state1, tmp, 8);
+}
+
+static int
+sha256_shani_usable (void)
+{
+  grub_uint32_t eax, ebx, ecx, edx;
+
+  grub_cpuid_count (0, 0, &eax, &ebx, &ecx, &edx);
+  if (eax < 7)
+    return 0;
+
+  grub_cpuid_count (1, 0, &eax, &ebx, &ecx, &edx);
+  if (! (ecx & (1 << 19)))
+    return 0;
+
+  grub_cpuid_count (7, 0, &eax, &ebx, &ecx, &edx);
+  return !! (ebx & (1 << 29));
+}
+#endif
+
+/* A SHA-256 implementation.  BLOCKS runs the compression function on
+   NBLOCKS 64-byte blocks at CP.  */
+struct sha256_impl
+{
+  const char *name;
+  int (*usable) (void);
+  void (*blocks) (grub_uint32_t *H, const grub_uint8_t *cp,
+		  grub_size_t nblocks);
+};
+
+/* In order of preference.  The scalar code must come last.  */
+static const struct sha256_impl sha256_impls[] =
+  {
+#ifdef SHA256_SHANI
+    { "shani", sha256_shani_usable, sha256_blocks_shani },
+#endif
+    { "scalar", 0, sha256_blocks_scalar }
+  };
+
+#define SHA256_NIMPLS	ARRAY_SIZE (sha256_impls)
+
+static const struct sha256_impl *sha256_best;
+
+static void
+sha256_run (const struct sha256_impl *impl, const void *buf,
+	    grub_uint64_t size, grub_zfs_endian_t endian, zio_cksum_t *zcp)
 {
   grub_uint32_t H[8] = { 0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a,
 			 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19 };
   grub_uint8_t pad[128];
   unsigned padsize = size & 63;
   unsigned i;
-  
-  for (i = 0; i < size - padsize; i += 64)
-    SHA256Transform(H, (grub_uint8_t *)buf + i);
-  
+
+  impl->blocks (H, buf, size / 64);
+
   for (i = 0; i < padsize; i++)
-    pad[i] = ((grub_uint8_t *)buf)[i];
-  
+    pad[i] = ((const grub_uint8_t *) buf)[size - padsize + i];
+
   for (pad[padsize++] = 0x80; (padsize & 63) != 56; padsize++)
     pad[padsize] = 0;
-  
+
   for (i = 0; i < 8; i++)
     pad[padsize++] = (size << 3) >> (56 - 8 * i);
-  
-  for (i = 0; i < padsize && i <= 64; i += 64)
-    SHA256Transform(H, pad + i);
-  
+
+  impl->blocks (H, pad, padsize / 64);
+
   zcp->zc_word[0] = grub_cpu_to_zfs64 ((grub_uint64_t)H[0] << 32 | H[1], 
 				       endian);
   zcp->zc_word[1] = grub_cpu_to_zfs64 ((grub_uint64_t)H[2] << 32 | H[3],
@@ -141,3 +303,116 @@ zio_checksum_SHA256(const void *buf, grub_uint64_t size,
   zcp->zc_word[3] = grub_cpu_to_zfs64 ((grub_uint64_t)H[6] << 32 | H[7],
 				       endian);
 }
+
+#define SHA256_TEST_SIZE	1100
+
+/* Return nonzero if IMPL doesn't agree with the scalar code.  */
+static int
+sha256_check (const struct sha256_impl *impl, const grub_uint8_t *buf)
+{
+  static const grub_uint64_t sizes[] = { 0, 3, 55, 56, 64, 119, 1024,
+					 SHA256_TEST_SIZE };
+  const struct sha256_impl *scalar = &sha256_impls[SHA256_NIMPLS - 1];
+  zio_cksum_t zc, ref;
+  unsigned i;
+
+  for (i = 0; i < ARRAY_SIZE (sizes); i++)
+    {
+      sha256_run (impl, buf, sizes[i], GRUB_ZFS_LITTLE_ENDIAN, &zc);
+      sha256_run (scalar, buf, sizes[i], GRUB_ZFS_LITTLE_ENDIAN, &ref);
+      if (grub_memcmp (&zc, &ref, sizeof (zc)) != 0)
+	return 1;
+    }
+
+  return 0;
+}
+
+static grub_uint8_t *
+sha256_test_buffer (void)
+{
+  grub_uint8_t *buf;
+  grub_uint32_t x = 1;
+  unsigned i;
+
+  buf = grub_malloc (SHA256_TEST_SIZE);
+  if (! buf)
+    return NULL;
+
+  for (i = 0; i < SHA256_TEST_SIZE; i++)
+    {
+      x = x * 1103515245 + 12345;
+      buf[i] = x >> 16;
+    }
+
+  return buf;
+}
+
+/* Check that all the usable implementations agree with the scalar code.
+   Returns the number of those that don't.  */
+int
+zio_checksum_SHA256_self_test (void)
+{
+  grub_uint8_t *buf;
+  int failed = 0;
+  unsigned i;
+
+  buf = sha256_test_buffer ();
+  if (! buf)
+    {
+      grub_errno = GRUB_ERR_NONE;
+      return 0;
+    }
+
+  for (i = 0; i + 1 < SHA256_NIMPLS; i++)
+    if ((! sha256_impls[i].usable || sha256_impls[i].usable ())
+	&& sha256_check (&sha256_impls[i], buf))
+      {
+	grub_dprintf ("zfs", "SHA256 %s is broken\n", sha256_impls[i].name);
+	failed++;
+      }
+
+  grub_free (buf);
+  return failed;
+}
+
+/* Pick the first usable implementation that passes the self test.  */
+static const struct sha256_impl *
+sha256_select (void)
+{
+  const struct sha256_impl *impl;
+  grub_uint8_t *buf;
+  unsigned i;
+
+  impl = &sha256_impls[SHA256_NIMPLS - 1];
+  if (SHA256_NIMPLS == 1)
+    return impl;
+
+  buf = sha256_test_buffer ();
+  if (! buf)
+    {
+      grub_errno = GRUB_ERR_NONE;
+      return impl;
+    }
+
+  for (i = 0; i + 1 < SHA256_NIMPLS; i++)
+    if ((! sha256_impls[i].usable || sha256_impls[i].usable ())
+	&& ! sha256_check (&sha256_impls[i], buf))
+      {
+	impl = &sha256_impls[i];
+	break;
+      }
+
+  grub_free (buf);
+  grub_dprintf ("zfs", "using %s SHA256\n", impl->name);
+  return impl;
+}
+
+void
+zio_checksum_SHA256(const void *buf, grub_uint64_t size,
+		    grub_zfs_endian_t endian, zio_cksum_t *zcp)
+{
+  if (! sha256_best)
+    sha256_best = sha256_select ();
+
+  sha256_run (sha256_best, buf, size, endian, zcp);
+}
@@ -57,6 +57,61 @@ GRUB_MOD_LICENSE ("GPLv3+");
 
 #define INBUFSIZ  0x2000
 
+/* A Huffman decoding table entry.  */
+struct gzio_code
+{
+  /* What the entry decodes to, see CODE_*.  */
+  grub_uint8_t op;
+  /* The number of bits of the code, or of the table index for links.  */
+  grub_uint8_t bits;
+  /* The literal, the length or distance base, or the subtable offset.  */
+  grub_uint16_t val;
+};
+
+#define CODE_LITERAL	0x00
+/* A length or distance base, with the number of extra bits in the low
+   bits of op.  */
+#define CODE_BASE	0x10
+#define CODE_EOB	0x20
+/* A link to a subtable indexed by the number of bits in the low bits of
+   op.  */
+#define CODE_LINK	0x40
+#define CODE_INVALID	0x80
+#define CODE_EXTRA	0x0f
+
+/* The number of bits decoded by the first lookup in the literal/length,
+   distance and code length tables.  */
+#define LBITS	9
+#define DBITS	6
+#define CBITS	7
+
+/* The largest possible tables with LBITS and DBITS, computed by zlib's
+   enough utility.  */
+#define ENOUGH_LENS	852
+#define ENOUGH_DISTS	592
+
+#define BMAX 15			/* maximum bit length of any code */
+#define N_MAX 288		/* maximum number of codes in any set */
+
+/* The distance in uncompressed data between two access points.  */
+#define GZIO_SPAN	0x100000
+
+/* A point at the start of a deflate block where decompression can resume
+   without decoding everything before it.  */
+struct grub_gzio_access
+{
+  /* The offset in uncompressed data.  */
+  grub_off_t out;
+  /* The offset of the next input byte.  */
+  grub_off_t in;
+  /* The bit buffer.  */
+  grub_uint64_t bb;
+  /* The bits in the bit buffer.  */
+  unsigned bk;
+  /* The sliding window as it was at that point.  */
+  grub_uint8_t slide[WSIZE];
+};
+
 /* The state stored in filesystem-specific data.  */
 struct grub_gzio
 {
@@ -82,8 +137,12 @@ struct grub_gzio
   /* The input buffer.  */
   grub_uint8_t inbuf[INBUFSIZ];
   int inbuf_d;
+  /* The offset of the input buffer in the underlying file.  */
+  grub_off_t inbuf_off;
+  /* The number of bytes in the input buffer.  */
+  int inbuf_len;
   /* The bit buffer.  */
-  unsigned long bb;
+  grub_uint64_t bb;
   /* The bits in the bit buffer.  */
   unsigned bk;
   /* The sliding window in uncompressed data.  */
@@ -91,15 +150,18 @@ struct grub_gzio
   /* Current position in the slide.  */
   unsigned wp;
   /* The literal/length code table.  */
-  struct huft *tl;
+  const struct gzio_code *lcode;
   /* The distance code table.  */
-  struct huft *td;
-  /* The lookup bits for the literal/length code table. */
-  int bl;
-  /* The lookup bits for the distance code table.  */
-  int bd;
+  const struct gzio_code *dcode;
+  /* The tables of the current dynamic block.  */
+  struct gzio_code lcode_buf[ENOUGH_LENS];
+  struct gzio_code dcode_buf[ENOUGH_DISTS];
   /* The original offset value.  */
   grub_off_t saved_offset;
+  /* Access points sorted by offset, built while decompressing.  */
+  struct grub_gzio_access **index;
+  unsigned index_len;
+  unsigned index_max;
 };
 typedef struct grub_gzio *grub_gzio_t;
 
@@ -166,7 +228,6 @@ eat_field (grub_file_t file, int len)
 
 typedef unsigned char uch;
 typedef unsigned short ush;
-typedef unsigned long ulg;
 
 static int
 test_gzip_header (grub_file_t file)
@@ -229,26 +290,6 @@ test_gzip_header (grub_file_t file)
 }
 
 
-/* Huffman code lookup table entry--this entry is four bytes for machines
-   that have 16-bit pointers (e.g. PC's in the small or medium model).
-   Valid extra bits are 0..13.  e == 15 is EOB (end of block), e == 16
-   means that v is a literal, 16 < e < 32 means that v is a pointer to
-   the next table, which codes e - 16 bits, and lastly e == 99 indicates
-   an unused code.  If a code with e == 99 is looked up, this implies an
-   error in the data. */
-struct huft
-{
-  uch e;			/* number of extra bits or operation */
-  uch b;			/* number of bits in this code or subcode */
-  union
-    {
-      ush n;			/* literal, length base, or distance base */
-      struct huft *t;		/* pointer to next level of table */
-    }
-  v;
-};
-
-
 /* The inflate algorithm uses a sliding 32K byte window on the uncompressed
    stream to find repeated byte strings.  This is implemented here as a
    circular buffer.  The index is updated simply by incrementing and then
@@ -283,54 +324,17 @@ static ush cpdext[] =
   7, 7, 8, 8, 9, 9, 10, 10, 11, 11,
   12, 12, 13, 13};
 
-
-/*
-   Huffman code decoding is performed using a multi-level table lookup.
-   The fastest way to decode is to simply build a lookup table whose
-   size is determined by the longest code.  However, the time it takes
-   to build this table can also be a factor if the data being decoded
-   is not very long.  The most common codes are necessarily the
-   shortest codes, so those codes dominate the decoding time, and hence
-   the speed.  The idea is you can have a shorter table that decodes the
-   shorter, more probable codes, and then point to subsidiary tables for
-   the longer codes.  The time it costs to decode the longer codes is
-   then traded against the time it takes to make longer tables.
-
-   This results of this trade are in the variables lbits and dbits
-   below.  lbits is the number of bits the first level table for literal/
-   length codes can decode in one step, and dbits is the same thing for
-   the distance codes.  Subsequent tables are also less than or equal to
-   those sizes.  These values may be adjusted either when all of the
-   codes are shorter than that, in which case the longest code length in
-   bits is used, or when the shortest code is *longer* than the requested
-   table size, in which case the length of the shortest code in bits is
-   used.
-
-   There are two different values for the two tables, since they code a
-   different number of possibilities each.  The literal/length table
-   codes 286 possible values, or in a flat code, a little over eight
-   bits.  The distance table codes 30 possible values, or a little less
-   than five bits, flat.  The optimum values for speed end up being
-   about one bit more than those, so lbits is 8+1 and dbits is 5+1.
-   The optimum values may differ though from machine to machine, and
-   possibly even between compilers.  Your mileage may vary.
- */
-
-
-static int lbits = 9;		/* bits in base literal/length lookup table */
-static int dbits = 6;		/* bits in base distance lookup table */
-
-
-/* If BMAX needs to be larger than 16, then h and x[] should be ulg. */
-#define BMAX 16			/* maximum bit length of any code (16 for explode) */
-#define N_MAX 288		/* maximum number of codes in any set */
+/* Fixed Huffman tables, built on first use.  */
+static struct gzio_code fixed_lcode[1 << LBITS];
+static struct gzio_code fixed_dcode[1 << DBITS];
+static int fixed_built;
 
 
 /* Macros for inflate() bit peeking and grabbing.
    The usage is:
 
         NEEDBITS(j)
-        x = b & mask_bits[j];
+        x = b & MASKBITS(j);
         DUMPBITS(j)
 
    where NEEDBITS makes sure that b has at least j bits in it, and
@@ -339,33 +343,16 @@ static int dbits = 6;		/* bits in base distance lookup table */
    variables for speed, and are initialized at the beginning of a
    routine that uses these macros from a global bit buffer and count.
 
-   If we assume that EOB will be the longest code, then we will never
-   ask for bits with NEEDBITS that are beyond the end of the stream.
-   So, NEEDBITS should not read any more bytes than are needed to
-   meet the request.  Then no bytes need to be "returned" to the buffer
-   at the end of the last block.
-
-   However, this assumption is not true for fixed blocks--the EOB code
-   is 7 bits, but the other literal/length codes can be 8 or 9 bits.
-   (The EOB code is shorter than other codes because fixed blocks are
-   generally short.  So, while a block always has an EOB, many other
-   literal/length codes have a significantly lower probability of
-   showing up at all.)  However, by making the first table have a
-   lookup of seven bits, the EOB code will be found in that first
-   lookup, and so will not require that too many bits be pulled from
-   the stream.
+   b is 64 bits wide and is refilled a word at a time whenever enough
+   input is buffered, so it usually holds more bits than were asked for.
+   Those bits belong to input which has already been consumed: stored
+   blocks take their first bytes from the bit buffer, and access points
+   save it along with the input offset.  NEEDBITS may not ask for more
+   than 56 bits.
  */
 
-static ush mask_bits[] =
-{
-  0x0000,
-  0x0001, 0x0003, 0x0007, 0x000f, 0x001f, 0x003f, 0x007f, 0x00ff,
-  0x01ff, 0x03ff, 0x07ff, 0x0fff, 0x1fff, 0x3fff, 0x7fff, 0xffff
-};
-
-#pragma GCC diagnostic ignored "-Wunsafe-loop-optimizations"
-
-#define NEEDBITS(n) do {while(k<(n)){b|=((ulg)get_byte(gzio))<<k;k+=8;}} while (0)
+#define MASKBITS(n)	((1U << (n)) - 1)
+#define NEEDBITS(n) do {if(k<(n)) fill_bits(gzio,&b,&k,(n));} while (0)
 #define DUMPBITS(n) do {b>>=(n);k-=(n);} while (0)
 
 static int
@@ -378,17 +365,70 @@ get_byte (grub_gzio_t gzio)
       return 0;
     }
 
-  if (gzio->file && (grub_file_tell (gzio->file)
-		     == (grub_off_t) gzio->data_offset
-		     || gzio->inbuf_d == INBUFSIZ))
+  if (gzio->inbuf_d >= gzio->inbuf_len)
     {
+      grub_ssize_t len;
+
       gzio->inbuf_d = 0;
-      grub_file_read (gzio->file, gzio->inbuf, INBUFSIZ);
+      gzio->inbuf_off = grub_file_tell (gzio->file);
+      len = grub_file_read (gzio->file, gzio->inbuf, INBUFSIZ);
+      gzio->inbuf_len = len > 0 ? len : 0;
+      if (! gzio->inbuf_len)
+	return 0;
     }
 
   return gzio->inbuf[gzio->inbuf_d++];
 }
 
+/* Return the buffered input and store its length in AVAIL.  */
+static inline const grub_uint8_t *
+get_input (grub_gzio_t gzio, grub_size_t *avail)
+{
+  if (gzio->mem_input)
+    {
+      *avail = gzio->mem_input_size - gzio->mem_input_off;
+      return gzio->mem_input + gzio->mem_input_off;
+    }
+
+  *avail = gzio->inbuf_len - gzio->inbuf_d;
+  return gzio->inbuf + gzio->inbuf_d;
+}
+
+static inline void
+skip_input (grub_gzio_t gzio, grub_size_t len)
+{
+  if (gzio->mem_input)
+    gzio->mem_input_off += len;
+  else
+    gzio->inbuf_d += len;
+}
+
+/* Refill the bit buffer B holding K bits with at least N bits.  */
+static inline void
+fill_bits (grub_gzio_t gzio, grub_uint64_t *b, unsigned *k, unsigned n)
+{
+  const grub_uint8_t *p;
+  grub_size_t avail;
+
+  p = get_input (gzio, &avail);
+  if (avail >= sizeof (grub_uint64_t))
+    {
+      unsigned bytes = (63 - *k) >> 3;
+
+      *b |= grub_le_to_cpu64 (grub_get_unaligned64 (p)) << *k;
+      *k += bytes << 3;
+      *b &= ((grub_uint64_t) 1 << *k) - 1;
+      skip_input (gzio, bytes);
+      return;
+    }
+
+  while (*k < n)
+    {
+      *b |= (grub_uint64_t) get_byte (gzio) << *k;
+      *k += 8;
+    }
+}
+
 static void
 gzio_seek (grub_gzio_t gzio, grub_off_t off)
 {
@@ -404,246 +444,202 @@ gzio_seek (grub_gzio_t gzio, grub_off_t off)
     grub_file_seek (gzio->file, off);
 }
 
-/* more function prototypes */
-static int huft_build (unsigned *, unsigned, unsigned, ush *, ush *,
-		       struct huft **, int *);
-static int huft_free (struct huft *);
-static int inflate_codes_in_window (grub_gzio_t);
-
 
-/* Given a list of code lengths and a maximum table size, make a set of
-   tables to decode that set of codes.  Return zero on success, one if
-   the given code set is incomplete (the tables are still built in this
-   case), two if the input is invalid (all zero length codes or an
-   oversubscribed set of lengths), and three if not enough memory. */
+/* What the symbols of a code set decode to.  */
+enum
+  {
+    CODES_LENGTHS,
+    CODES_LITLEN,
+    CODES_DIST
+  };
 
-static int
-huft_build (unsigned *b,	/* code lengths in bits (all assumed <= BMAX) */
-	    unsigned n,		/* number of codes (assumed <= N_MAX) */
-	    unsigned s,		/* number of simple-valued codes (0..s-1) */
-	    ush * d,		/* list of base values for non-simple codes */
-	    ush * e,		/* list of extra bits for non-simple codes */
-	    struct huft **t,	/* result: starting table */
-	    int *m)		/* maximum lookup bits, returns actual */
+static struct gzio_code
+code_entry (int kind, unsigned sym, unsigned bits)
 {
-  unsigned a;			/* counter for codes of length k */
-  unsigned c[BMAX + 1];		/* bit length count table */
-  unsigned f;			/* i repeats in table every f entries */
-  int g;			/* maximum code length */
-  int h;			/* table level */
-  register unsigned i;		/* counter, current code */
-  register unsigned j;		/* counter */
-  register int k;		/* number of bits in current code */
-  int l;			/* bits per table (returned in m) */
-  register unsigned *p;		/* pointer into c[], b[], or v[] */
-  register struct huft *q;	/* points to current table */
-  struct huft r;		/* table entry for structure assignment */
-  struct huft *u[BMAX];		/* table stack */
-  unsigned v[N_MAX];		/* values in order of bit length */
-  register int w;		/* bits before this table == (l * h) */
-  unsigned x[BMAX + 1];		/* bit offsets, then code stack */
-  unsigned *xp;			/* pointer into x */
-  int y;			/* number of dummy codes added */
-  unsigned z;			/* number of entries in current table */
-
-  /* Generate counts for each bit length */
-  grub_memset ((char *) c, 0, sizeof (c));
-  p = b;
-  i = n;
-  do
-    {
-      c[*p]++;			/* assume all entries <= BMAX */
-      p++;			/* Can't combine with above line (Solaris bug) */
-    }
-  while (--i);
-  if (c[0] == n)		/* null input--all zero length codes */
-    {
-      *t = (struct huft *) NULL;
-      *m = 0;
-      return 0;
-    }
+  struct gzio_code c = { CODE_INVALID, bits, 0 };
 
-  /* Find minimum and maximum length, bound *m by those */
-  l = *m;
-  for (j = 1; j <= BMAX; j++)
-    if (c[j])
+  switch (kind)
+    {
+    case CODES_LENGTHS:
+      c.op = CODE_LITERAL;
+      c.val = sym;
       break;
-  k = j;			/* minimum code length */
-  if ((unsigned) l < j)
-    l = j;
-  for (i = BMAX; i; i--)
-    if (c[i])
+    case CODES_LITLEN:
+      if (sym < 256)
+	{
+	  c.op = CODE_LITERAL;
+	  c.val = sym;
+	}
+      else if (sym == 256)
+	c.op = CODE_EOB;
+      else if (sym < 286)
+	{
+	  c.op = CODE_BASE | cplext[sym - 257];
+	  c.val = cplens[sym - 257];
+	}
+      break;
+    case CODES_DIST:
+      if (sym < 30)
+	{
+	  c.op = CODE_BASE | cpdext[sym];
+	  c.val = cpdist[sym];
+	}
       break;
-  g = i;			/* maximum code length */
-  if ((unsigned) l > i)
-    l = i;
-  *m = l;
-
-  /* Adjust last length count to fill out codes, if needed */
-  for (y = 1 << j; j < i; j++, y <<= 1)
-    if ((y -= c[j]) < 0)
-      return 2;			/* bad input: more codes than bits */
-  if ((y -= c[i]) < 0)
-    return 2;
-  c[i] += y;
-
-  /* Generate starting offsets into the value table for each length */
-  x[1] = j = 0;
-  p = c + 1;
-  xp = x + 2;
-  while (--i)
-    {				/* note that i == g from above */
-      *xp++ = (j += *p++);
     }
 
-  /* Make a table of values in order of bit lengths */
-  p = b;
-  i = 0;
-  do
+  return c;
+}
+
+static inline unsigned
+reverse_bits (unsigned code, unsigned len)
+{
+  unsigned r = 0;
+
+  while (len--)
     {
-      if ((j = *p++) != 0)
-	v[x[j]++] = i;
+      r = (r << 1) | (code & 1);
+      code >>= 1;
     }
-  while (++i < n);
-
-  /* Generate the Huffman codes and for each, make the table entries */
-  x[0] = i = 0;			/* first Huffman code is zero */
-  p = v;			/* grab values in bit order */
-  h = -1;			/* no tables yet--level -1 */
-  w = -l;			/* bits decoded == (l * h) */
-  u[0] = (struct huft *) NULL;	/* just to keep compilers happy */
-  q = (struct huft *) NULL;	/* ditto */
-  z = 0;			/* ditto */
-
-  /* go through the bit lengths (k already is bits in shortest code) */
-  for (; k <= g; k++)
-    {
-      a = c[k];
-      while (a--)
-	{
-	  /* here i is the Huffman code of length k bits for value *p */
-	  /* make tables up to required level */
-	  while (k > w + l)
-	    {
-	      h++;
-	      w += l;		/* previous table always l bits */
-
-	      /* compute minimum size table less than or equal to l bits */
-	      z = (z = (unsigned) (g - w)) > (unsigned) l ? (unsigned) l : z;	/* upper limit on table size */
-	      if ((f = 1 << (j = k - w)) > a + 1)	/* try a k-w bit table */
-		{		/* too few codes for k-w bit table */
-		  f -= a + 1;	/* deduct codes from patterns left */
-		  xp = c + k;
-		  while (++j < z)	/* try smaller tables up to z bits */
-		    {
-		      if ((f <<= 1) <= *++xp)
-			break;	/* enough codes to use up j bits */
-		      f -= *xp;	/* else deduct codes from patterns */
-		    }
-		}
-	      z = 1 << j;	/* table entries for j-bit table */
 
-	      /* allocate and link in new table */
-	      q = (struct huft *) grub_malloc ((z + 1) * sizeof (struct huft));
-	      if (! q)
-		{
-		  if (h)
-		    huft_free (u[0]);
-		  return 3;
-		}
+  return r;
+}
 
-	      *t = q + 1;	/* link to list for huft_free() */
-	      *(t = &(q->v.t)) = (struct huft *) NULL;
-	      u[h] = ++q;	/* table starts after link */
+/* Build the decoding table for the NUM code lengths in LENS into TABLE,
+   which has SIZE entries.  Codes of up to ROOT bits are decoded with a
+   single lookup of the low ROOT bits of input.  Longer codes point to a
+   subtable indexed with the following bits, sized so that it's just
+   large enough for the codes sharing its prefix.  Return zero on
+   success, one if the code set is incomplete (the table is still built
+   in this case), and two if it is oversubscribed or the table is too
+   small.  A code set with a single one-bit code is not considered
+   incomplete.  */
+static int
+build_table (int kind, const grub_uint8_t *lens, unsigned num, unsigned root,
+	     struct gzio_code *table, unsigned size)
+{
+  const struct gzio_code invalid = { CODE_INVALID, 0, 0 };
+  unsigned count[BMAX + 1], offs[BMAX + 1], sorted[N_MAX];
+  unsigned len, max, sym, i, n, used, low, sub, subbits, code, j;
+  int left;
 
-	      /* connect to last table, if there is one */
-	      if (h)
-		{
-		  x[h] = i;	/* save pattern for backing up */
-		  r.b = (uch) l;	/* bits to dump before this table */
-		  r.e = (uch) (16 + j);		/* bits in this table */
-		  r.v.t = q;	/* pointer to this table */
-		  j = i >> (w - l);	/* (get around Turbo C bug) */
-		  u[h - 1][j] = r;	/* connect to last table */
-		}
-	    }
+  grub_memset (count, 0, sizeof (count));
+  for (sym = 0; sym < num; sym++)
+    count[lens[sym]]++;
+  for (max = BMAX; max && ! count[max]; max--);
 
-	  /* set up table entry in r */
-	  r.b = (uch) (k - w);
-	  if (p >= v + n)
-	    r.e = 99;		/* out of values--invalid code */
-	  else if (*p < s)
-	    {
-	      r.e = (uch) (*p < 256 ? 16 : 15);		/* 256 is end-of-block code */
-	      r.v.n = (ush) (*p);	/* simple code is just the value */
-	      p++;		/* one compiler does not like *p++ */
-	    }
-	  else
-	    {
-	      r.e = (uch) e[*p - s];	/* non-simple--look up in lists */
-	      r.v.n = d[*p++ - s];
-	    }
+  for (i = 0; i < (1U << root); i++)
+    table[i] = invalid;
 
-	  /* fill code-like entries with r */
-	  f = 1 << (k - w);
-	  for (j = i >> w; j < z; j += f)
-	    q[j] = r;
+  /* No codes at all, which is fine for distances.  */
+  if (! max)
+    return 0;
 
-	  /* backwards increment the k-bit code i */
-	  for (j = 1 << (k - 1); i & j; j >>= 1)
-	    i ^= j;
-	  i ^= j;
+  left = 1;
+  for (len = 1; len <= BMAX; len++)
+    {
+      left <<= 1;
+      left -= count[len];
+      if (left < 0)
+	return 2;
+    }
 
-	  /* backup over finished tables */
-	  while ((i & ((1 << w) - 1)) != x[h])
-	    {
-	      h--;		/* don't need to update q */
-	      w -= l;
-	    }
+  /* Sort the symbols by code length.  */
+  offs[1] = 0;
+  for (len = 1; len < BMAX; len++)
+    offs[len + 1] = offs[len] + count[len];
+  for (sym = 0; sym < num; sym++)
+    if (lens[sym])
+      sorted[offs[lens[sym]]++] = sym;
+
+  n = num - count[0];
+  used = 1U << root;
+  low = (unsigned) -1;
+  sub = subbits = 0;
+  code = 0;
+  for (i = 0; i < n; i++)
+    {
+      sym = sorted[i];
+      len = lens[sym];
+
+      /* Codes are stored with their first bit in the lowest bit.  */
+      j = reverse_bits (code, len);
+      if (len <= root)
+	{
+	  struct gzio_code c = code_entry (kind, sym, len);
+
+	  for (; j < (1U << root); j += 1U << len)
+	    table[j] = c;
 	}
-    }
+      else
+	{
+	  struct gzio_code c;
 
-  /* Return true (1) if we were given an incomplete table */
-  return y != 0 && g != 1;
-}
+	  if ((j & MASKBITS (root)) != low)
+	    {
+	      /* Start a new subtable, large enough for all codes with
+		 this prefix.  The codes are canonical, so they are the
+		 next ones.  */
+	      int avail;
+
+	      low = j & MASKBITS (root);
+	      subbits = len - root;
+	      avail = 1 << subbits;
+	      while (subbits + root < max)
+		{
+		  avail -= count[subbits + root];
+		  if (avail <= 0)
+		    break;
+		  subbits++;
+		  avail <<= 1;
+		}
 
+	      if (used + (1U << subbits) > size)
+		return 2;
+
+	      table[low].op = CODE_LINK | subbits;
+	      table[low].bits = root;
+	      table[low].val = used;
+	      sub = used;
+	      used += 1U << subbits;
+	      for (j = sub; j < used; j++)
+		table[j] = invalid;
+	      j = reverse_bits (code, len);
+	    }
 
-/* Free the malloc'ed tables built by huft_build(), which makes a linked
-   list of the tables it made, with the links in a dummy first entry of
-   each table.  */
-static int
-huft_free (struct huft *t)
-{
-  register struct huft *p, *q;
+	  if (len - root > subbits)
+	    return 2;
 
+	  c = code_entry (kind, sym, len - root);
+	  for (j >>= root; j < (1U << subbits); j += 1U << (len - root))
+	    table[sub + j] = c;
+	}
 
-  /* Go through linked list, freeing from the malloced (t[-1]) address. */
-  p = t;
-  while (p != (struct huft *) NULL)
-    {
-      q = (--p)->v.t;
-      grub_free ((char *) p);
-      p = q;
+      count[len]--;
+      code++;
+      if (i + 1 < n)
+	code <<= lens[sorted[i + 1]] - len;
     }
-  return 0;
+
+  return (left && max != 1) ? 1 : 0;
 }
 
 
-/*
- *  inflate (decompress) the codes in a deflated (compressed) block.
- *  Return an error code or zero if it all goes ok.
- */
+/* inflate (decompress) the codes in a deflated (compressed) block until
+   the window is full or the block ends.  Errors are set in grub_errno. */
 
-static int
+static void
 inflate_codes_in_window (grub_gzio_t gzio)
 {
-  register unsigned e;		/* table entry flag/number of extra bits */
+  unsigned e;			/* number of extra bits or bytes to copy */
   unsigned n, d;		/* length and index for copy */
   unsigned w;			/* current window position */
-  struct huft *t;		/* pointer to table entry */
-  unsigned ml, md;		/* masks for bl and bd bits */
-  register ulg b;		/* bit buffer */
-  register unsigned k;		/* number of bits in bit buffer */
+  int copying;			/* in the middle of a copy */
+  grub_uint8_t *slide = gzio->slide;
+  struct gzio_code c;		/* table entry */
+  const struct gzio_code *lcode = gzio->lcode;
+  const struct gzio_code *dcode = gzio->dcode;
+  grub_uint64_t b;		/* bit buffer */
+  unsigned k;			/* number of bits in bit buffer */
 
   /* make local copies of globals */
   d = gzio->inflate_d;
@@ -651,97 +647,97 @@ inflate_codes_in_window (grub_gzio_t gzio)
   b = gzio->bb;			/* initialize bit buffer */
   k = gzio->bk;
   w = gzio->wp;			/* initialize window position */
+  copying = gzio->code_state;
 
   /* inflate the coded data */
-  ml = mask_bits[gzio->bl];		/* precompute masks for speed */
-  md = mask_bits[gzio->bd];
   for (;;)			/* do until end of block */
     {
-      if (! gzio->code_state)
+      if (! copying)
 	{
-	  NEEDBITS ((unsigned) gzio->bl);
-	  if ((e = (t = gzio->tl + ((unsigned) b & ml))->e) > 16)
-	    do
-	      {
-		if (e == 99)
-		  {
-		    grub_error (GRUB_ERR_BAD_COMPRESSED_DATA,
-				"an unused code found");
-		    return 1;
-		  }
-		DUMPBITS (t->b);
-		e -= 16;
-		NEEDBITS (e);
-	      }
-	    while ((e = (t = t->v.t + ((unsigned) b & mask_bits[e]))->e) > 16);
-	  DUMPBITS (t->b);
-
-	  if (e == 16)		/* then it's a literal */
+	  /* A literal/length code and its extra bits.  */
+	  NEEDBITS (BMAX + 5);
+
+	  c = lcode[b & MASKBITS (LBITS)];
+	  if (c.op & CODE_LINK)
+	    {
+	      DUMPBITS (LBITS);
+	      c = lcode[c.val + (b & MASKBITS (c.op & CODE_EXTRA))];
+	    }
+	  DUMPBITS (c.bits);
+
+	  if (c.op == CODE_LITERAL)
 	    {
-	      gzio->slide[w++] = (uch) t->v.n;
+	      slide[w++] = (uch) c.val;
 	      if (w == WSIZE)
 		break;
+	      continue;
 	    }
-	  else
-	    /* it's an EOB or a length */
+
+	  /* exit if end of block */
+	  if (c.op == CODE_EOB)
 	    {
-	      /* exit if end of block */
-	      if (e == 15)
-		{
-		  gzio->block_len = 0;
-		  break;
-		}
+	      gzio->block_len = 0;
+	      break;
+	    }
+
+	  if (c.op & CODE_INVALID)
+	    {
+	      grub_error (GRUB_ERR_BAD_COMPRESSED_DATA,
+			  "an unused code found");
+	      return;
+	    }
 
-	      /* get length of block to copy */
-	      NEEDBITS (e);
-	      n = t->v.n + ((unsigned) b & mask_bits[e]);
-	      DUMPBITS (e);
+	  /* get length of block to copy */
+	  e = c.op & CODE_EXTRA;
+	  n = c.val + (b & MASKBITS (e));
+	  DUMPBITS (e);
 
-	      /* decode distance of block to copy */
-	      NEEDBITS ((unsigned) gzio->bd);
-	      if ((e = (t = gzio->td + ((unsigned) b & md))->e) > 16)
-		do
-		  {
-		    if (e == 99)
-		      {
-			grub_error (GRUB_ERR_BAD_COMPRESSED_DATA,
-				    "an unused code found");
-			return 1;
-		      }
-		    DUMPBITS (t->b);
-		    e -= 16;
-		    NEEDBITS (e);
-		  }
-		while ((e = (t = t->v.t + ((unsigned) b & mask_bits[e]))->e)
-		       > 16);
-	      DUMPBITS (t->b);
-	      NEEDBITS (e);
-	      d = w - t->v.n - ((unsigned) b & mask_bits[e]);
-	      DUMPBITS (e);
-	      gzio->code_state++;
+	  /* decode distance of block to copy */
+	  NEEDBITS (BMAX + 13);
+	  c = dcode[b & MASKBITS (DBITS)];
+	  if (c.op & CODE_LINK)
+	    {
+	      DUMPBITS (DBITS);
+	      c = dcode[c.val + (b & MASKBITS (c.op & CODE_EXTRA))];
+	    }
+	  DUMPBITS (c.bits);
+
+	  if (c.op & CODE_INVALID)
+	    {
+	      grub_error (GRUB_ERR_BAD_COMPRESSED_DATA,
+			  "an unused code found");
+	      return;
 	    }
+
+	  e = c.op & CODE_EXTRA;
+	  d = w - c.val - (b & MASKBITS (e));
+	  DUMPBITS (e);
+	  copying = 1;
 	}
 
-      if (gzio->code_state)
+      if (copying)
 	{
 	  /* do the copy */
 	  do
 	    {
-	      n -= (e = (e = WSIZE - ((d &= WSIZE - 1) > w ? d : w)) > n ? n
-		    : e);
-
-	      if (w - d >= e)
-		{
-		  grub_memmove (gzio->slide + w, gzio->slide + d, e);
-		  w += e;
-		  d += e;
-		}
-	      else
-		/* purposefully use the overlap for extra copies here!! */
-		{
-		  while (e--)
-		    gzio->slide[w++] = gzio->slide[d++];
-		}
+	      d &= WSIZE - 1;
+	      e = WSIZE - (d > w ? d : w);
+	      if (e > n)
+		e = n;
+	      n -= e;
+
+	      /* Copy a word at a time unless the source is less than a
+		 word behind, in which case bytes must be repeated.  */
+	      if (w - d >= sizeof (grub_uint64_t))
+		for (; e >= sizeof (grub_uint64_t); e -= sizeof (grub_uint64_t))
+		  {
+		    grub_set_unaligned64 (slide + w,
+					  grub_get_unaligned64 (slide + d));
+		    w += sizeof (grub_uint64_t);
+		    d += sizeof (grub_uint64_t);
+		  }
+	      for (; e; e--)
+		slide[w++] = slide[d++];
 
 	      if (w == WSIZE)
 		break;
@@ -749,7 +745,7 @@ inflate_codes_in_window (grub_gzio_t gzio)
 	  while (n);
 
 	  if (! n)
-	    gzio->code_state--;
+	    copying = 0;
 
 	  /* did we break from the loop too soon? */
 	  if (w == WSIZE)
@@ -763,8 +759,7 @@ inflate_codes_in_window (grub_gzio_t gzio)
   gzio->wp = w;			/* restore global window pointer */
   gzio->bb = b;			/* restore global bit buffer */
   gzio->bk = k;
-
-  return ! gzio->block_len;
+  gzio->code_state = copying;
 }
 
 
@@ -773,8 +768,8 @@ inflate_codes_in_window (grub_gzio_t gzio)
 static void
 init_stored_block (grub_gzio_t gzio)
 {
-  register ulg b;		/* bit buffer */
-  register unsigned k;		/* number of bits in bit buffer */
+  grub_uint64_t b;		/* bit buffer */
+  unsigned k;			/* number of bits in bit buffer */
 
   /* make local copies of globals */
   b = gzio->bb;			/* initialize bit buffer */
@@ -798,49 +793,96 @@ init_stored_block (grub_gzio_t gzio)
   gzio->bk = k;
 }
 
+/* Copy data of a stored block into the window.  Whole bytes left in the
+   bit buffer come first, the rest is copied straight from the input.  */
+static void
+inflate_stored_in_window (grub_gzio_t gzio)
+{
+  unsigned w = gzio->wp;
+
+  while (gzio->block_len && w < WSIZE && gzio->bk >= 8)
+    {
+      gzio->slide[w++] = (uch) gzio->bb;
+      gzio->bb >>= 8;
+      gzio->bk -= 8;
+      gzio->block_len--;
+    }
 
-/* get header for an inflated type 1 (fixed Huffman codes) block.  We should
-   either replace this with a custom decoder, or at least precompute the
-   Huffman tables. */
+  while (gzio->block_len && w < WSIZE && grub_errno == GRUB_ERR_NONE)
+    {
+      const grub_uint8_t *p;
+      grub_size_t avail, len;
+
+      p = get_input (gzio, &avail);
+      if (! avail)
+	{
+	  /* Refill the input buffer.  */
+	  gzio->slide[w++] = get_byte (gzio);
+	  gzio->block_len--;
+	  continue;
+	}
+
+      len = WSIZE - w;
+      if (len > (unsigned) gzio->block_len)
+	len = gzio->block_len;
+      if (len > avail)
+	len = avail;
+
+      grub_memcpy (gzio->slide + w, p, len);
+      skip_input (gzio, len);
+      w += len;
+      gzio->block_len -= len;
+    }
+
+  gzio->wp = w;
+}
+
+
+/* get header for an inflated type 1 (fixed Huffman codes) block.  The
+   tables are the same for every block, so they are only built once. */
 
 static void
 init_fixed_block (grub_gzio_t gzio)
 {
   int i;			/* temporary variable */
-  unsigned l[288];		/* length list for huft_build */
-
-  /* set up literal table */
-  for (i = 0; i < 144; i++)
-    l[i] = 8;
-  for (; i < 256; i++)
-    l[i] = 9;
-  for (; i < 280; i++)
-    l[i] = 7;
-  for (; i < 288; i++)		/* make a complete, but wrong code set */
-    l[i] = 8;
-  gzio->bl = 7;
-  if (huft_build (l, 288, 257, cplens, cplext, &gzio->tl, &gzio->bl) != 0)
-    {
-      if (grub_errno == GRUB_ERR_NONE)
-	grub_error (GRUB_ERR_BAD_COMPRESSED_DATA,
-		    "failed in building a Huffman code table");
-      return;
-    }
+  grub_uint8_t l[288];		/* length list for build_table */
 
-  /* set up distance table */
-  for (i = 0; i < 30; i++)	/* make an incomplete code set */
-    l[i] = 5;
-  gzio->bd = 5;
-  if (huft_build (l, 30, 0, cpdist, cpdext, &gzio->td, &gzio->bd) > 1)
+  if (! fixed_built)
     {
-      if (grub_errno == GRUB_ERR_NONE)
-	grub_error (GRUB_ERR_BAD_COMPRESSED_DATA,
-		    "failed in building a Huffman code table");
-      huft_free (gzio->tl);
-      gzio->tl = 0;
-      return;
+      /* set up literal table */
+      for (i = 0; i < 144; i++)
+	l[i] = 8;
+      for (; i < 256; i++)
+	l[i] = 9;
+      for (; i < 280; i++)
+	l[i] = 7;
+      for (; i < 288; i++)	/* make a complete, but wrong code set */
+	l[i] = 8;
+      if (build_table (CODES_LITLEN, l, 288, LBITS, fixed_lcode,
+		       ARRAY_SIZE (fixed_lcode)) != 0)
+	{
+	  grub_error (GRUB_ERR_BAD_COMPRESSED_DATA,
+		      "failed in building a Huffman code table");
+	  return;
+	}
+
+      /* set up distance table */
+      for (i = 0; i < 32; i++)	/* 30 and 31 are invalid */
+	l[i] = 5;
+      if (build_table (CODES_DIST, l, 32, DBITS, fixed_dcode,
+		       ARRAY_SIZE (fixed_dcode)) != 0)
+	{
+	  grub_error (GRUB_ERR_BAD_COMPRESSED_DATA,
+		      "failed in building a Huffman code table");
+	  return;
+	}
+
+      fixed_built = 1;
     }
 
+  gzio->lcode = fixed_lcode;
+  gzio->dcode = fixed_dcode;
+
   /* indicate we're now working on a block */
   gzio->code_state = 0;
   gzio->block_len++;
@@ -852,30 +894,28 @@ init_fixed_block (grub_gzio_t gzio)
 static void
 init_dynamic_block (grub_gzio_t gzio)
 {
-  int i;			/* temporary variables */
+  unsigned i;			/* temporary variables */
   unsigned j;
   unsigned l;			/* last length */
-  unsigned m;			/* mask for bit lengths table */
   unsigned n;			/* number of lengths to get */
   unsigned nb;			/* number of bit length codes */
   unsigned nl;			/* number of literal/length codes */
   unsigned nd;			/* number of distance codes */
-  unsigned ll[286 + 30];	/* literal/length and distance code lengths */
-  register ulg b;		/* bit buffer */
-  register unsigned k;		/* number of bits in bit buffer */
+  grub_uint8_t ll[286 + 30];	/* literal/length and distance code lengths */
+  struct gzio_code c;		/* table entry */
+  grub_uint64_t b;		/* bit buffer */
+  unsigned k;			/* number of bits in bit buffer */
 
   /* make local bit buffer */
   b = gzio->bb;
   k = gzio->bk;
 
   /* read in table lengths */
-  NEEDBITS (5);
+  NEEDBITS (14);
   nl = 257 + ((unsigned) b & 0x1f);	/* number of literal/length codes */
   DUMPBITS (5);
-  NEEDBITS (5);
   nd = 1 + ((unsigned) b & 0x1f);	/* number of distance codes */
   DUMPBITS (5);
-  NEEDBITS (4);
   nb = 4 + ((unsigned) b & 0xf);	/* number of bit length codes */
   DUMPBITS (4);
   if (nl > 286 || nd > 30)
@@ -895,8 +935,8 @@ init_dynamic_block (grub_gzio_t gzio)
     ll[bitorder[j]] = 0;
 
   /* build decoding table for trees--single level, 7 bit lookup */
-  gzio->bl = 7;
-  if (huft_build (ll, 19, 19, NULL, NULL, &gzio->tl, &gzio->bl) != 0)
+  if (build_table (CODES_LENGTHS, ll, 19, CBITS, gzio->lcode_buf,
+		   ENOUGH_LENS) != 0)
     {
       grub_error (GRUB_ERR_BAD_COMPRESSED_DATA,
 		  "failed in building a Huffman code table");
@@ -905,22 +945,26 @@ init_dynamic_block (grub_gzio_t gzio)
 
   /* read in literal and distance code lengths */
   n = nl + nd;
-  m = mask_bits[gzio->bl];
   i = l = 0;
-  while ((unsigned) i < n)
+  while (i < n)
     {
-      NEEDBITS ((unsigned) gzio->bl);
-      j = (gzio->td = gzio->tl + ((unsigned) b & m))->b;
-      DUMPBITS (j);
-      j = gzio->td->v.n;
+      /* The longest code and its repeat count.  */
+      NEEDBITS (CBITS + 7);
+      c = gzio->lcode_buf[b & MASKBITS (CBITS)];
+      if (c.op & CODE_INVALID)
+	{
+	  grub_error (GRUB_ERR_BAD_COMPRESSED_DATA, "an unused code found");
+	  return;
+	}
+      DUMPBITS (c.bits);
+      j = c.val;
       if (j < 16)		/* length of code in bits (0..15) */
 	ll[i++] = l = j;	/* save last length in l */
       else if (j == 16)		/* repeat last length 3 to 6 times */
 	{
-	  NEEDBITS (2);
 	  j = 3 + ((unsigned) b & 3);
 	  DUMPBITS (2);
-	  if ((unsigned) i + j > n)
+	  if (i + j > n)
 	    {
 	      grub_error (GRUB_ERR_BAD_COMPRESSED_DATA, "too many codes found");
 	      return;
@@ -930,10 +974,9 @@ init_dynamic_block (grub_gzio_t gzio)
 	}
       else if (j == 17)		/* 3 to 10 zero length codes */
 	{
-	  NEEDBITS (3);
 	  j = 3 + ((unsigned) b & 7);
 	  DUMPBITS (3);
-	  if ((unsigned) i + j > n)
+	  if (i + j > n)
 	    {
 	      grub_error (GRUB_ERR_BAD_COMPRESSED_DATA, "too many codes found");
 	      return;
@@ -945,10 +988,9 @@ init_dynamic_block (grub_gzio_t gzio)
       else
 	/* j == 18: 11 to 138 zero length codes */
 	{
-	  NEEDBITS (7);
 	  j = 11 + ((unsigned) b & 0x7f);
 	  DUMPBITS (7);
-	  if ((unsigned) i + j > n)
+	  if (i + j > n)
 	    {
 	      grub_error (GRUB_ERR_BAD_COMPRESSED_DATA, "too many codes found");
 	      return;
@@ -959,32 +1001,23 @@ init_dynamic_block (grub_gzio_t gzio)
 	}
     }
 
-  /* free decoding table for trees */
-  huft_free (gzio->tl);
-  gzio->td = 0;
-  gzio->tl = 0;
-
   /* restore the global bit buffer */
   gzio->bb = b;
   gzio->bk = k;
 
   /* build the decoding tables for literal/length and distance codes */
-  gzio->bl = lbits;
-  if (huft_build (ll, nl, 257, cplens, cplext, &gzio->tl, &gzio->bl) != 0)
+  if (build_table (CODES_LITLEN, ll, nl, LBITS, gzio->lcode_buf,
+		   ENOUGH_LENS) != 0
+      || build_table (CODES_DIST, ll + nl, nd, DBITS, gzio->dcode_buf,
+		      ENOUGH_DISTS) != 0)
     {
       grub_error (GRUB_ERR_BAD_COMPRESSED_DATA,
 		  "failed in building a Huffman code table");
       return;
     }
-  gzio->bd = dbits;
-  if (huft_build (ll + nl, nd, 0, cpdist, cpdext, &gzio->td, &gzio->bd) != 0)
-    {
-      huft_free (gzio->tl);
-      gzio->tl = 0;
-      grub_error (GRUB_ERR_BAD_COMPRESSED_DATA,
-		  "failed in building a Huffman code table");
-      return;
-    }
+
+  gzio->lcode = gzio->lcode_buf;
+  gzio->dcode = gzio->dcode_buf;
 
   /* indicate we're now working on a block */
   gzio->code_state = 0;
@@ -995,8 +1028,8 @@ init_dynamic_block (grub_gzio_t gzio)
 static void
 get_new_block (grub_gzio_t gzio)
 {
-  register ulg b;		/* bit buffer */
-  register unsigned k;		/* number of bits in bit buffer */
+  grub_uint64_t b;		/* bit buffer */
+  unsigned k;			/* number of bits in bit buffer */
 
   /* make local bit buffer */
   b = gzio->bb;
@@ -1033,12 +1066,75 @@ get_new_block (grub_gzio_t gzio)
 }
 
 
+/* Record an access point at the current position if the last one is more
+   than GZIO_SPAN bytes behind.  It must be called at a block boundary.  */
 static void
-inflate_window (grub_gzio_t gzio)
+add_access_point (grub_gzio_t gzio)
 {
-  /* initialize window */
-  gzio->wp = 0;
+  struct grub_gzio_access *ap;
+  grub_off_t out = gzio->saved_offset + gzio->wp;
+
+  /* Data in memory is cheap to decompress again.  */
+  if (! gzio->file)
+    return;
+
+  if (out < (gzio->index_len ? gzio->index[gzio->index_len - 1]->out : 0)
+      + GZIO_SPAN)
+    return;
+
+  if (gzio->index_len == gzio->index_max)
+    {
+      struct grub_gzio_access **index;
+      unsigned max = gzio->index_max ? gzio->index_max * 2 : 16;
+
+      index = grub_realloc (gzio->index, max * sizeof (index[0]));
+      if (! index)
+	{
+	  /* The index is only an optimization.  */
+	  grub_errno = GRUB_ERR_NONE;
+	  return;
+	}
+      gzio->index = index;
+      gzio->index_max = max;
+    }
+
+  ap = grub_malloc (sizeof (*ap));
+  if (! ap)
+    {
+      grub_errno = GRUB_ERR_NONE;
+      return;
+    }
+
+  ap->out = out;
+  ap->in = gzio->inbuf_off + gzio->inbuf_d;
+  ap->bb = gzio->bb;
+  ap->bk = gzio->bk;
+  grub_memcpy (ap->slide, gzio->slide, WSIZE);
+  gzio->index[gzio->index_len++] = ap;
+}
 
+/* Return the last access point at or before OFFSET, if any.  */
+static struct grub_gzio_access *
+find_access_point (grub_gzio_t gzio, grub_off_t offset)
+{
+  unsigned lo = 0, hi = gzio->index_len;
+
+  while (lo < hi)
+    {
+      unsigned mid = (lo + hi) / 2;
+
+      if (gzio->index[mid]->out <= offset)
+	lo = mid + 1;
+      else
+	hi = mid;
+    }
+
+  return lo ? gzio->index[lo - 1] : 0;
+}
+
+static void
+inflate_window (grub_gzio_t gzio)
+{
   /*
    *  Main decompression loop.
    */
@@ -1050,6 +1146,7 @@ inflate_window (grub_gzio_t gzio)
 	  if (gzio->last_block)
 	    break;
 
+	  add_access_point (gzio);
 	  get_new_block (gzio);
 	}
 
@@ -1065,19 +1162,11 @@ inflate_window (grub_gzio_t gzio)
        */
       if (gzio->block_type == INFLATE_STORED)
 	{
-	  int w = gzio->wp;
-
 	  /*
 	   *  This is basically a glorified pass-through
 	   */
 
-	  while (gzio->block_len && w < WSIZE && grub_errno == GRUB_ERR_NONE)
-	    {
-	      gzio->slide[w++] = get_byte (gzio);
-	      gzio->block_len--;
-	    }
-
-	  gzio->wp = w;
+	  inflate_stored_in_window (gzio);
 
 	  continue;
 	}
@@ -1086,16 +1175,11 @@ inflate_window (grub_gzio_t gzio)
        *  Expand other kind of block.
        */
 
-      if (inflate_codes_in_window (gzio))
-	{
-	  huft_free (gzio->tl);
-	  huft_free (gzio->td);
-	  gzio->tl = 0;
-	  gzio->td = 0;
-	}
+      inflate_codes_in_window (gzio);
     }
 
   gzio->saved_offset += WSIZE;
+  gzio->wp = 0;
 
   /* XXX do CRC calculation here! */
 }
@@ -1105,6 +1189,7 @@ static void
 initialize_tables (grub_gzio_t gzio)
 {
   gzio->saved_offset = 0;
+  gzio->wp = 0;
   gzio_seek (gzio, gzio->data_offset);
 
   /* Initialize the bit buffer.  */
@@ -1114,10 +1199,29 @@ initialize_tables (grub_gzio_t gzio)
   /* Reset partial decompression code.  */
   gzio->last_block = 0;
   gzio->block_len = 0;
+  gzio->code_state = 0;
+
+  /* Reset the tables and the input buffer.  */
+  gzio->lcode = 0;
+  gzio->dcode = 0;
+  gzio->inbuf_d = 0;
+  gzio->inbuf_len = 0;
+}
 
-  /* Reset memory allocation stuff.  */
-  huft_free (gzio->tl);
-  huft_free (gzio->td);
+/* Resume decompression at the access point AP.  */
+static void
+resume_at_access_point (grub_gzio_t gzio, struct grub_gzio_access *ap)
+{
+  initialize_tables (gzio);
+
+  gzio->wp = ap->out & (WSIZE - 1);
+  gzio->saved_offset = ap->out - gzio->wp;
+  gzio->bb = ap->bb;
+  gzio->bk = ap->bk;
+  grub_memcpy (gzio->slide, ap->slide, WSIZE);
+
+  /* The input buffer is empty, it will be refilled from there.  */
+  gzio_seek (gzio, ap->in);
 }
 
 
@@ -1204,9 +1308,16 @@ grub_gzio_read_real (grub_gzio_t gzio, grub_off_t offset,
 		     char *buf, grub_size_t len)
 {
   grub_ssize_t ret = 0;
-
-  /* Do we reset decompression to the beginning of the file?  */
-  if (gzio->saved_offset > offset + WSIZE)
+  struct grub_gzio_access *ap;
+
+  /* Resume from the closest access point when seeking backwards out of
+     the window or when it lets us skip data ahead.  Without one, seeking
+     backwards restarts decompression at the beginning of the file.  */
+  ap = find_access_point (gzio, offset);
+  if (ap && (gzio->saved_offset > offset + WSIZE
+	     || ap->out > gzio->saved_offset))
+    resume_at_access_point (gzio, ap);
+  else if (gzio->saved_offset > offset + WSIZE)
     initialize_tables (gzio);
 
   /*
@@ -1253,10 +1364,12 @@ static grub_err_t
 grub_gzio_close (grub_file_t file)
 {
   grub_gzio_t gzio = file->data;
+  unsigned i;
 
   grub_file_close (gzio->file);
-  huft_free (gzio->tl);
-  huft_free (gzio->td);
+  for (i = 0; i < gzio->index_len; i++)
+    grub_free (gzio->index[i]);
+  grub_free (gzio->index);
   grub_free (gzio);
 
   /* No need to close the same device twice.  */
@@ -33,6 +33,15 @@ GRUB_MOD_LICENSE ("GPLv3+");
 #define VLI_MAX_DIGITS 9
 #define XZ_STREAM_FOOTER_SIZE 12
 
+/* A block as described by the stream index.  */
+struct grub_xzio_block
+{
+  /* The offset of the block header in the underlying file.  */
+  grub_off_t in;
+  /* The offset of its data in uncompressed data.  */
+  grub_off_t out;
+};
+
 struct grub_xzio
 {
   grub_file_t file;
@@ -41,6 +50,17 @@ struct grub_xzio
   grub_uint8_t inbuf[XZBUFSIZ];
   grub_uint8_t outbuf[XZBUFSIZ];
   grub_off_t saved_offset;
+  /* The stream header, fed to the decoder again when it is restarted at
+     a block.  */
+  grub_uint8_t header[STREAM_HEADER_SIZE];
+  /* The blocks of the stream, or NULL if the index couldn't be used.  */
+  struct grub_xzio_block *blocks;
+  grub_uint64_t nblocks;
+  /* The offset of the index in the underlying file.  */
+  grub_off_t index_offset;
+  /* Set when decoding didn't start at the first block.  Input then stops
+     at the index, which can't be checked against the blocks seen.  */
+  int partial;
 };
 
 typedef struct grub_xzio *grub_xzio_t;
@@ -100,6 +120,8 @@ test_header (grub_file_t file)
   if (xzio->buf.in_size != STREAM_HEADER_SIZE)
     return 0;
 
+  grub_memcpy (xzio->header, xzio->inbuf, STREAM_HEADER_SIZE);
+
   ret = xz_dec_run (xzio->dec, &xzio->buf);
 
   if (ret == XZ_FORMAT_ERROR)
@@ -122,7 +144,9 @@ test_footer (grub_file_t file)
   grub_uint8_t imarker;
   grub_uint64_t uncompressed_size_total = 0;
   grub_uint64_t uncompressed_size;
-  grub_uint64_t records;
+  grub_uint64_t unpadded_size;
+  grub_uint64_t records, i;
+  grub_off_t compressed_offset = STREAM_HEADER_SIZE;
 
   grub_file_seek (xzio->file, xzio->file->size - FOOTER_MAGIC_SIZE);
   if (grub_file_read (xzio->file, footer, FOOTER_MAGIC_SIZE)
@@ -139,8 +163,8 @@ test_footer (grub_file_t file)
   backsize = (grub_le_to_cpu32 (backsize) + 1) * 4;
 
   /* Set file to the beginning of stream index.  */
-  grub_file_seek (xzio->file,
-		  xzio->file->size - XZ_STREAM_FOOTER_SIZE - backsize);
+  xzio->index_offset = xzio->file->size - XZ_STREAM_FOOTER_SIZE - backsize;
+  grub_file_seek (xzio->file, xzio->index_offset);
 
   /* Test index marker.  */
   if (grub_file_read (xzio->file, &imarker, sizeof (imarker))
@@ -150,24 +174,102 @@ test_footer (grub_file_t file)
   if (read_vli (xzio->file, &records) <= 0)
     goto ERROR;
 
-  for (; records != 0; records--)
+  /* Every record takes at least two bytes, so larger counts are bogus.
+     The count must also not overflow the size of the block list on
+     32-bit targets.  Seeking is just slower without the block list.  */
+  if (records > 1 && records <= backsize / 2
+      && records <= GRUB_ULONG_MAX / sizeof (xzio->blocks[0]))
     {
-      if (read_vli (xzio->file, &uncompressed_size) <= 0)	/* Ignore unpadded.  */
+      xzio->blocks = grub_malloc (records * sizeof (xzio->blocks[0]));
+      if (! xzio->blocks)
+	grub_errno = GRUB_ERR_NONE;
+    }
+
+  for (i = 0; i < records; i++)
+    {
+      if (read_vli (xzio->file, &unpadded_size) <= 0)
 	goto ERROR;
       if (read_vli (xzio->file, &uncompressed_size) <= 0)	/* Uncompressed.  */
 	goto ERROR;
 
+      if (xzio->blocks)
+	{
+	  xzio->blocks[i].in = compressed_offset;
+	  xzio->blocks[i].out = uncompressed_size_total;
+	}
+      compressed_offset += ALIGN_UP (unpadded_size, 4);
       uncompressed_size_total += uncompressed_size;
     }
 
+  /* Only use the blocks if they account for everything before the index,
+     i.e. there is just one stream without stream padding.  */
+  if (xzio->blocks && compressed_offset == xzio->index_offset)
+    xzio->nblocks = records;
+  else
+    {
+      grub_free (xzio->blocks);
+      xzio->blocks = 0;
+    }
+
   file->size = uncompressed_size_total;
   grub_file_seek (xzio->file, STREAM_HEADER_SIZE);
   return 1;
 
 ERROR:
+  grub_free (xzio->blocks);
+  xzio->blocks = 0;
   return 0;
 }
 
+/* Return the block holding OFFSET, or NULL if blocks aren't known.  */
+static struct grub_xzio_block *
+find_block (grub_xzio_t xzio, grub_off_t offset)
+{
+  grub_uint64_t lo = 0, hi = xzio->nblocks;
+
+  if (! xzio->blocks)
+    return 0;
+
+  while (hi - lo > 1)
+    {
+      grub_uint64_t mid = lo + (hi - lo) / 2;
+
+      if (xzio->blocks[mid].out <= offset)
+	lo = mid;
+      else
+	hi = mid;
+    }
+
+  return &xzio->blocks[lo];
+}
+
+/* Restart decoding at BLOCK, or at the beginning of the stream if BLOCK
+   is NULL.  */
+static void
+restart_decoder (grub_xzio_t xzio, struct grub_xzio_block *block)
+{
+  xz_dec_reset (xzio->dec);
+  xzio->buf.out_pos = 0;
+  xzio->buf.in_pos = 0;
+  xzio->buf.in_size = 0;
+  xzio->partial = 0;
+
+  if (! block)
+    {
+      xzio->saved_offset = 0;
+      grub_file_seek (xzio->file, 0);
+      return;
+    }
+
+  /* Blocks can be decoded independently, so it's enough to show the
+     decoder the stream header followed by the block.  */
+  grub_memcpy (xzio->inbuf, xzio->header, STREAM_HEADER_SIZE);
+  xzio->buf.in_size = STREAM_HEADER_SIZE;
+  xzio->saved_offset = block->out;
+  xzio->partial = (block != &xzio->blocks[0]);
+  grub_file_seek (xzio->file, block->in);
+}
+
 static grub_file_t
 grub_xzio_open (grub_file_t io)
 {
@@ -222,6 +324,7 @@ grub_xzio_open (grub_file_t io)
       grub_errno = GRUB_ERR_NONE;
       grub_file_seek (io, 0);
       xz_dec_end (xzio->dec);
+      grub_free (xzio->blocks);
       grub_free (xzio);
       grub_free (file);
 
@@ -239,18 +342,15 @@ grub_xzio_read (grub_file_t file, char *buf, grub_size_t len)
   enum xz_ret xzret;
   grub_xzio_t xzio = file->data;
   grub_off_t current_offset;
+  struct grub_xzio_block *block;
 
-  /* If seek backward need to reset decoder and start from beginning of file.
-     TODO Possible improvement by jumping blocks.  */
-  if (file->offset < xzio->saved_offset)
-    {
-      xz_dec_reset (xzio->dec);
-      xzio->saved_offset = 0;
-      xzio->buf.out_pos = 0;
-      xzio->buf.in_pos = 0;
-      xzio->buf.in_size = 0;
-      grub_file_seek (xzio->file, 0);
-    }
+  /* If seek backward, or forward past the start of a block, restart the
+     decoder at the block holding the offset.  Without the block list it
+     has to start from the beginning of the file.  */
+  block = find_block (xzio, file->offset);
+  if (file->offset < xzio->saved_offset
+      || (block && block->out > xzio->saved_offset))
+    restart_decoder (xzio, block);
 
   current_offset = xzio->saved_offset;
 
@@ -262,7 +362,18 @@ grub_xzio_read (grub_file_t file, char *buf, grub_size_t len)
       /* Feed input.  */
       if (xzio->buf.in_pos == xzio->buf.in_size)
 	{
-	  readret = grub_file_read (xzio->file, xzio->inbuf, XZBUFSIZ);
+	  grub_size_t toread = XZBUFSIZ;
+
+	  if (xzio->partial)
+	    {
+	      grub_off_t pos = grub_file_tell (xzio->file);
+
+	      toread = pos < xzio->index_offset ? xzio->index_offset - pos : 0;
+	      if (toread > XZBUFSIZ)
+		toread = XZBUFSIZ;
+	    }
+
+	  readret = grub_file_read (xzio->file, xzio->inbuf, toread);
 	  if (readret < 0)
 	    return -1;
 	  xzio->buf.in_size = readret;
@@ -320,6 +431,7 @@ grub_xzio_close (grub_file_t file)
   xz_dec_end (xzio->dec);
 
   grub_file_close (xzio->file);
+  grub_free (xzio->blocks);
   grub_free (xzio);
 
   /* Device must not be closed twice.  */
@@ -32,78 +32,223 @@
 static grub_uint64_t grub_last_time = 0;
 
 
-/* Disk cache.  */
+/* Disk cache.  The cache is set-associative: a cache unit can only live
+   in one of the GRUB_DISK_CACHE_WAYS lines of the set its address hashes
+   to, and the least recently used unlocked line of that set is replaced
+   on a miss.  The data of all lines lives in a single slab which is
+   allocated on first use.  */
 struct grub_disk_cache
 {
   enum grub_disk_dev_id dev_id;
   unsigned long disk_id;
   grub_disk_addr_t sector;
   char *data;
+  unsigned long last_use;
+  int valid;
   int lock;
+  /* Set if the line was filled by read-ahead and not used yet.  */
+  int prefetched;
 };
 
-static struct grub_disk_cache grub_disk_cache_table[GRUB_DISK_CACHE_NUM];
+static struct grub_disk_cache *grub_disk_cache_table;
+static char *grub_disk_cache_slab;
+static unsigned grub_disk_cache_num_sets
+  = GRUB_DISK_CACHE_NUM / GRUB_DISK_CACHE_WAYS;
+static unsigned grub_disk_cache_allocated_sets;
+static unsigned long grub_disk_cache_clock;
 
 void (*grub_disk_firmware_fini) (void);
 int grub_disk_firmware_is_tainted;
 
-#if DISK_CACHE_STATS
 static unsigned long grub_disk_cache_hits;
 static unsigned long grub_disk_cache_misses;
+static unsigned long grub_disk_cache_evictions;
+
+static grub_uint64_t grub_disk_readahead_bytes;
+static unsigned long grub_disk_readahead_hits;
+static unsigned long grub_disk_readahead_wasted;
+
+static grub_uint64_t grub_disk_direct_bytes;
 
 void
-grub_disk_cache_get_performance (unsigned long *hits, unsigned long *misses)
+grub_disk_cache_get_performance (unsigned long *hits, unsigned long *misses,
+				 unsigned long *evictions)
 {
   *hits = grub_disk_cache_hits;
   *misses = grub_disk_cache_misses;
+  *evictions = grub_disk_cache_evictions;
+}
+
+void
+grub_disk_readahead_get_performance (grub_uint64_t *bytes,
+				     unsigned long *hits,
+				     unsigned long *wasted)
+{
+  *bytes = grub_disk_readahead_bytes;
+  *hits = grub_disk_readahead_hits;
+  *wasted = grub_disk_readahead_wasted;
+}
+
+void
+grub_disk_direct_get_performance (grub_uint64_t *bytes)
+{
+  *bytes = grub_disk_direct_bytes;
+}
+
+grub_size_t
+grub_disk_cache_get_size (void)
+{
+  unsigned sets = grub_disk_cache_num_sets;
+
+  /* The cache may have been allocated smaller than configured.  */
+  if (grub_disk_cache_table)
+    sets = grub_disk_cache_allocated_sets;
+
+  return ((grub_size_t) sets * GRUB_DISK_CACHE_WAYS)
+    << (GRUB_DISK_CACHE_BITS + GRUB_DISK_SECTOR_BITS);
+}
+
+/* Allocate the line table and the slab if not done yet.  If the requested
+   size can't be allocated, retry with half the number of sets.  Return
+   zero if the cache is disabled or no memory is available for it.  The
+   cache is optional, so running out of memory for it isn't an error.  */
+static int
+grub_disk_cache_alloc (void)
+{
+  struct grub_disk_cache *table;
+  char *slab;
+  unsigned sets, i;
+
+  if (grub_disk_cache_table)
+    return 1;
+
+  for (sets = grub_disk_cache_num_sets; sets; sets >>= 1)
+    {
+      table = grub_zalloc (sets * GRUB_DISK_CACHE_WAYS * sizeof (*table));
+      if (! table)
+	{
+	  grub_errno = GRUB_ERR_NONE;
+	  continue;
+	}
+
+      slab = grub_malloc ((grub_size_t) sets * GRUB_DISK_CACHE_WAYS
+			  << (GRUB_DISK_CACHE_BITS + GRUB_DISK_SECTOR_BITS));
+      if (! slab)
+	{
+	  grub_free (table);
+	  grub_errno = GRUB_ERR_NONE;
+	  continue;
+	}
+
+      for (i = 0; i < sets * GRUB_DISK_CACHE_WAYS; i++)
+	table[i].data = slab + ((grub_size_t) i << (GRUB_DISK_CACHE_BITS
+						     + GRUB_DISK_SECTOR_BITS));
+
+      grub_disk_cache_table = table;
+      grub_disk_cache_slab = slab;
+      grub_disk_cache_allocated_sets = sets;
+      return 1;
+    }
+
+  return 0;
 }
-#endif
 
-static unsigned
-grub_disk_cache_get_index (unsigned long dev_id, unsigned long disk_id,
-			   grub_disk_addr_t sector)
+/* Return the first line of the set SECTOR belongs to.  */
+static struct grub_disk_cache *
+grub_disk_cache_get_set (unsigned long dev_id, unsigned long disk_id,
+			 grub_disk_addr_t sector)
 {
-  return ((dev_id * 524287UL + disk_id * 2606459UL
-	   + ((unsigned) (sector >> GRUB_DISK_CACHE_BITS)))
-	  % GRUB_DISK_CACHE_NUM);
+  unsigned index;
+
+  index = ((dev_id * 524287UL + disk_id * 2606459UL
+	    + ((unsigned) (sector >> GRUB_DISK_CACHE_BITS)))
+	   % grub_disk_cache_allocated_sets);
+
+  return grub_disk_cache_table + index * GRUB_DISK_CACHE_WAYS;
+}
+
+static struct grub_disk_cache *
+grub_disk_cache_lookup (unsigned long dev_id, unsigned long disk_id,
+			grub_disk_addr_t sector)
+{
+  struct grub_disk_cache *cache;
+  unsigned i;
+
+  if (! grub_disk_cache_table)
+    return 0;
+
+  cache = grub_disk_cache_get_set (dev_id, disk_id, sector);
+  for (i = 0; i < GRUB_DISK_CACHE_WAYS; i++, cache++)
+    if (cache->valid && cache->dev_id == dev_id && cache->disk_id == disk_id
+	&& cache->sector == sector)
+      return cache;
+
+  return 0;
 }
 
 static void
 grub_disk_cache_invalidate (unsigned long dev_id, unsigned long disk_id,
 			    grub_disk_addr_t sector)
 {
-  unsigned index;
   struct grub_disk_cache *cache;
 
   sector &= ~(GRUB_DISK_CACHE_SIZE - 1);
-  index = grub_disk_cache_get_index (dev_id, disk_id, sector);
-  cache = grub_disk_cache_table + index;
-
-  if (cache->dev_id == dev_id && cache->disk_id == disk_id
-      && cache->sector == sector && cache->data)
-    {
-      cache->lock = 1;
-      grub_free (cache->data);
-      cache->data = 0;
-      cache->lock = 0;
-    }
+  cache = grub_disk_cache_lookup (dev_id, disk_id, sector);
+  if (cache)
+    cache->valid = 0;
 }
 
-void
-grub_disk_cache_invalidate_all (void)
+/* Drop the contents of all unlocked lines but keep the slab.  Return
+   non-zero if some line is still locked.  */
+static int
+grub_disk_cache_invalidate_lines (void)
 {
   unsigned i;
+  int locked = 0;
+
+  if (! grub_disk_cache_table)
+    return 0;
 
-  for (i = 0; i < GRUB_DISK_CACHE_NUM; i++)
+  for (i = 0; i < grub_disk_cache_allocated_sets * GRUB_DISK_CACHE_WAYS; i++)
     {
       struct grub_disk_cache *cache = grub_disk_cache_table + i;
 
-      if (cache->data && ! cache->lock)
-	{
-	  grub_free (cache->data);
-	  cache->data = 0;
-	}
+      if (cache->lock)
+	locked = 1;
+      else
+	cache->valid = 0;
     }
+
+  return locked;
+}
+
+void
+grub_disk_cache_invalidate_all (void)
+{
+  /* This is called when memory runs low, so give the slab back as well
+     unless somebody is still using a line.  */
+  if (grub_disk_cache_invalidate_lines ())
+    return;
+
+  grub_free (grub_disk_cache_slab);
+  grub_free (grub_disk_cache_table);
+  grub_disk_cache_slab = 0;
+  grub_disk_cache_table = 0;
+  grub_disk_cache_allocated_sets = 0;
+}
+
+void
+grub_disk_cache_set_size (grub_size_t size)
+{
+  grub_disk_cache_invalidate_all ();
+  if (grub_disk_cache_table)
+    return;
+
+  grub_disk_cache_num_sets = ((size >> (GRUB_DISK_CACHE_BITS
+					+ GRUB_DISK_SECTOR_BITS))
+			      / GRUB_DISK_CACHE_WAYS);
+  if (size && ! grub_disk_cache_num_sets)
+    grub_disk_cache_num_sets = 1;
 }
 
 static char *
@@ -111,24 +256,22 @@ grub_disk_cache_fetch (unsigned long dev_id, unsigned long disk_id,
 		       grub_disk_addr_t sector)
 {
   struct grub_disk_cache *cache;
-  unsigned index;
-
-  index = grub_disk_cache_get_index (dev_id, disk_id, sector);
-  cache = grub_disk_cache_table + index;
 
-  if (cache->dev_id == dev_id && cache->disk_id == disk_id
-      && cache->sector == sector)
+  cache = grub_disk_cache_lookup (dev_id, disk_id, sector);
+  if (cache)
     {
       cache->lock = 1;
-#if DISK_CACHE_STATS
+      cache->last_use = ++grub_disk_cache_clock;
       grub_disk_cache_hits++;
-#endif
+      if (cache->prefetched)
+	{
+	  grub_disk_readahead_hits++;
+	  cache->prefetched = 0;
+	}
       return cache->data;
     }
 
-#if DISK_CACHE_STATS
   grub_disk_cache_misses++;
-#endif
 
   return 0;
 }
@@ -138,45 +281,67 @@ grub_disk_cache_unlock (unsigned long dev_id, unsigned long disk_id,
 			grub_disk_addr_t sector)
 {
   struct grub_disk_cache *cache;
-  unsigned index;
 
-  index = grub_disk_cache_get_index (dev_id, disk_id, sector);
-  cache = grub_disk_cache_table + index;
-
-  if (cache->dev_id == dev_id && cache->disk_id == disk_id
-      && cache->sector == sector)
+  cache = grub_disk_cache_lookup (dev_id, disk_id, sector);
+  if (cache)
     cache->lock = 0;
 }
 
 static grub_err_t
 grub_disk_cache_store (unsigned long dev_id, unsigned long disk_id,
-		       grub_disk_addr_t sector, const char *data)
+		       grub_disk_addr_t sector, const char *data,
+		       int prefetched)
 {
-  unsigned index;
-  struct grub_disk_cache *cache;
+  struct grub_disk_cache *cache, *victim;
+  unsigned i;
 
-  index = grub_disk_cache_get_index (dev_id, disk_id, sector);
-  cache = grub_disk_cache_table + index;
+  if (! grub_disk_cache_alloc ())
+    return GRUB_ERR_NONE;
 
-  cache->lock = 1;
-  grub_free (cache->data);
-  cache->data = 0;
-  cache->lock = 0;
+  victim = grub_disk_cache_lookup (dev_id, disk_id, sector);
+  if (victim && victim->lock)
+    return GRUB_ERR_NONE;
 
-  cache->data = grub_malloc (GRUB_DISK_SECTOR_SIZE << GRUB_DISK_CACHE_BITS);
-  if (! cache->data)
-    return grub_errno;
+  if (! victim)
+    {
+      cache = grub_disk_cache_get_set (dev_id, disk_id, sector);
+      for (i = 0; i < GRUB_DISK_CACHE_WAYS; i++)
+	{
+	  if (cache[i].lock)
+	    continue;
+	  if (! cache[i].valid)
+	    {
+	      victim = cache + i;
+	      break;
+	    }
+	  if (! victim || cache[i].last_use < victim->last_use)
+	    victim = cache + i;
+	}
 
-  grub_memcpy (cache->data, data,
+      /* Every line of the set is in use.  */
+      if (! victim)
+	return GRUB_ERR_NONE;
+
+      if (victim->valid)
+	grub_disk_cache_evictions++;
+    }
+
+  if (victim->valid && victim->prefetched)
+    grub_disk_readahead_wasted++;
+
+  grub_memcpy (victim->data, data,
 	       GRUB_DISK_SECTOR_SIZE << GRUB_DISK_CACHE_BITS);
-  cache->dev_id = dev_id;
-  cache->disk_id = disk_id;
-  cache->sector = sector;
+  victim->dev_id = dev_id;
+  victim->disk_id = disk_id;
+  victim->sector = sector;
+  victim->last_use = ++grub_disk_cache_clock;
+  victim->valid = 1;
+  victim->prefetched = prefetched;
 
   return GRUB_ERR_NONE;
 }
 
-
+
 
 grub_disk_dev_t grub_disk_dev_list;
 
@@ -297,7 +462,7 @@ grub_disk_open (const char *name)
 
   if (current_time > (grub_last_time
 		      + GRUB_CACHE_TIMEOUT * 1000))
-    grub_disk_cache_invalidate_all ();
+    grub_disk_cache_invalidate_lines ();
 
   grub_last_time = current_time;
 
@@ -341,6 +506,24 @@ grub_disk_close (grub_disk_t disk)
   grub_free (disk);
 }
 
+void
+grub_disk_get_key (grub_disk_t disk, struct grub_disk_key *key)
+{
+  key->dev_id = disk->dev->id;
+  key->disk_id = disk->id;
+  key->part_start = grub_partition_get_start (disk->partition);
+}
+
+int
+grub_disk_cache_expired (grub_uint64_t *last_time)
+{
+  grub_uint64_t now = grub_get_time_ms ();
+  int expired = now > *last_time + GRUB_CACHE_TIMEOUT * 1000;
+
+  *last_time = now;
+  return expired;
+}
+
 /* This function performs three tasks:
    - Make sectors disk relative from partition relative.
    - Normalize offset to be less than the sector size.
@@ -388,6 +571,79 @@ transform_sector (grub_disk_t disk, grub_disk_addr_t sector)
   return sector >> (disk->log_sector_size - GRUB_DISK_SECTOR_BITS);
 }
 
+/* Read SIZE bytes at OFFSET from SECTOR without going through the cache.
+   sector is already adjusted.  Whole sectors are read straight into BUF,
+   only a partial first and last sector go through a bounce buffer.  */
+static grub_err_t
+grub_disk_read_uncached (grub_disk_t disk, grub_disk_addr_t sector,
+			 grub_off_t offset, grub_size_t size, void *buf)
+{
+  grub_size_t sector_size = (grub_size_t) 1 << disk->log_sector_size;
+  grub_size_t num;
+  grub_disk_addr_t aligned_sector;
+  char *ptr = buf;
+  char *tmp_buf = 0;
+
+  sector += (offset >> GRUB_DISK_SECTOR_BITS);
+  offset &= ((1 << GRUB_DISK_SECTOR_BITS) - 1);
+  aligned_sector = (sector & ~((1 << (disk->log_sector_size
+				      - GRUB_DISK_SECTOR_BITS))
+			       - 1));
+  offset += ((sector - aligned_sector) << GRUB_DISK_SECTOR_BITS);
+  sector = transform_sector (disk, aligned_sector);
+
+  if (offset)
+    {
+      grub_size_t len = sector_size - offset;
+
+      if (len > size)
+	len = size;
+
+      tmp_buf = grub_malloc (sector_size);
+      if (!tmp_buf)
+	return grub_errno;
+      if ((disk->dev->read) (disk, sector, 1, tmp_buf))
+	goto fail;
+      grub_memcpy (ptr, tmp_buf + offset, len);
+      ptr += len;
+      size -= len;
+      sector++;
+    }
+
+  num = size >> disk->log_sector_size;
+  if (num)
+    {
+      if ((disk->dev->read) (disk, sector, num, ptr))
+	goto fail;
+      ptr += num << disk->log_sector_size;
+      size -= num << disk->log_sector_size;
+      sector += num;
+    }
+
+  if (size)
+    {
+      if (!tmp_buf)
+	{
+	  tmp_buf = grub_malloc (sector_size);
+	  if (!tmp_buf)
+	    return grub_errno;
+	}
+      if ((disk->dev->read) (disk, sector, 1, tmp_buf))
+	goto fail;
+      grub_memcpy (ptr, tmp_buf, size);
+    }
+
+  grub_free (tmp_buf);
+  return GRUB_ERR_NONE;
+
+ fail:
+  grub_error_push ();
+  grub_dprintf ("disk", "%s read failed\n", disk->name);
+  grub_error_pop ();
+  grub_free (tmp_buf);
+  return grub_errno;
+}
+
 /* Small read (less than cache size and not pass across cache unit boundaries).
    sector is already adjusted and is divisible by cache unit size.
  */
@@ -428,7 +684,7 @@ grub_disk_read_small (grub_disk_t disk, grub_disk_addr_t sector,
 	  /* Copy it and store it in the disk cache.  */
 	  grub_memcpy (buf, tmp_buf + offset, size);
 	  grub_disk_cache_store (disk->dev->id, disk->id,
-				 sector, tmp_buf);
+				 sector, tmp_buf, 0);
 	  grub_free (tmp_buf);
 	  return GRUB_ERR_NONE;
 	}
@@ -437,37 +693,131 @@ grub_disk_read_small (grub_disk_t disk, grub_disk_addr_t sector,
   grub_free (tmp_buf);
   grub_errno = GRUB_ERR_NONE;
 
-  {
-    /* Uggh... Failed. Instead, just read necessary data.  */
-    unsigned num;
-    grub_disk_addr_t aligned_sector;
-
-    sector += (offset >> GRUB_DISK_SECTOR_BITS);
-    offset &= ((1 << GRUB_DISK_SECTOR_BITS) - 1);
-    aligned_sector = (sector & ~((1 << (disk->log_sector_size
-					- GRUB_DISK_SECTOR_BITS))
-				 - 1));
-    offset += ((sector - aligned_sector) << GRUB_DISK_SECTOR_BITS);
-    num = ((size + offset + (1 << (disk->log_sector_size))
-	    - 1) >> (disk->log_sector_size));
-
-    tmp_buf = grub_malloc (num << disk->log_sector_size);
-    if (!tmp_buf)
-      return grub_errno;
-    
-    if ((disk->dev->read) (disk, transform_sector (disk, aligned_sector),
-			   num, tmp_buf))
-      {
-	grub_error_push ();
-	grub_dprintf ("disk", "%s read failed\n", disk->name);
-	grub_error_pop ();
-	grub_free (tmp_buf);
-	return grub_errno;
-      }
-    grub_memcpy (buf, tmp_buf + offset, size);
-    grub_free (tmp_buf);
-    return GRUB_ERR_NONE;
-  }
+  /* Uggh... Failed. Instead, just read necessary data.  */
+  return grub_disk_read_uncached (disk, sector, offset, size, buf);
+}
+
+/* Detect sequential streams of reads on DISK and read ahead of them into
+   the disk cache.  FIRST and LAST are the first and the last cache units
+   touched by the read that was just served.  The read-ahead window starts
+   at GRUB_DISK_READAHEAD_MIN units and doubles every time the stream
+   consumes half of what was read ahead, up to GRUB_DISK_READAHEAD_MAX
+   units or a quarter of the cache.  */
+static void
+grub_disk_readahead (grub_disk_t disk, grub_disk_addr_t first,
+		     grub_disk_addr_t last)
+{
+  grub_disk_addr_t start, end, total;
+  unsigned max;
+  char *tmp_buf;
+
+  if (first != disk->ra_last + 1
+      && (first != disk->ra_last || ! disk->ra_window))
+    {
+      /* Not sequential, start over.  */
+      disk->ra_last = last;
+      disk->ra_end = 0;
+      disk->ra_window = 0;
+      return;
+    }
+  disk->ra_last = last;
+
+  if (disk->total_sectors == GRUB_DISK_SIZE_UNKNOWN
+      || ! grub_disk_cache_alloc ())
+    return;
+
+  /* Wait until half of the previous window was consumed.  */
+  if (disk->ra_window && last + disk->ra_window / 2 < disk->ra_end)
+    return;
+
+  max = grub_disk_cache_allocated_sets * GRUB_DISK_CACHE_WAYS / 4;
+  if (max > GRUB_DISK_READAHEAD_MAX)
+    max = GRUB_DISK_READAHEAD_MAX;
+  if (! disk->ra_window)
+    disk->ra_window = GRUB_DISK_READAHEAD_MIN;
+  else
+    disk->ra_window *= 2;
+  if (disk->ra_window > max)
+    disk->ra_window = max;
+  if (! disk->ra_window)
+    return;
+
+  start = last + 1;
+  if (start < disk->ra_end)
+    start = disk->ra_end;
+  end = last + 1 + disk->ra_window;
+  total = (disk->total_sectors << (disk->log_sector_size
+				   - GRUB_DISK_SECTOR_BITS))
+    >> GRUB_DISK_CACHE_BITS;
+  if (end > total)
+    end = total;
+  disk->ra_end = end;
+
+  /* Skip what is already cached and read the first uncached run.  */
+  while (start < end
+	 && grub_disk_cache_lookup (disk->dev->id, disk->id,
+				    start << GRUB_DISK_CACHE_BITS))
+    start++;
+  if (start >= end)
+    return;
+  for (total = start + 1; total < end; total++)
+    if (grub_disk_cache_lookup (disk->dev->id, disk->id,
+				total << GRUB_DISK_CACHE_BITS))
+      break;
+  end = total;
+
+  tmp_buf = grub_malloc ((end - start) << (GRUB_DISK_CACHE_BITS
+					   + GRUB_DISK_SECTOR_BITS));
+  if (! tmp_buf)
+    {
+      grub_errno = GRUB_ERR_NONE;
+      return;
+    }
+
+  if ((disk->dev->read) (disk, transform_sector (disk, start
+						 << GRUB_DISK_CACHE_BITS),
+			 (end - start) << (GRUB_DISK_CACHE_BITS
+					   + GRUB_DISK_SECTOR_BITS
+					   - disk->log_sector_size),
+			 tmp_buf) == GRUB_ERR_NONE)
+    {
+      grub_disk_addr_t i;
+
+      for (i = start; i < end; i++)
+	grub_disk_cache_store (disk->dev->id, disk->id,
+			       i << GRUB_DISK_CACHE_BITS,
+			       tmp_buf + ((i - start)
+					  << (GRUB_DISK_CACHE_BITS
+					      + GRUB_DISK_SECTOR_BITS)), 1);
+      grub_disk_readahead_bytes += (end - start) << (GRUB_DISK_CACHE_BITS
+						     + GRUB_DISK_SECTOR_BITS);
+    }
+  else
+    {
+      /* Read-ahead is only a hint, don't report its failures.  */
+      grub_errno = GRUB_ERR_NONE;
+      disk->ra_window = 0;
+      disk->ra_end = 0;
+    }
+
+  grub_free (tmp_buf);
+}
+
+static void
+grub_disk_call_read_hook (grub_disk_t disk, grub_disk_addr_t sector,
+			  grub_off_t offset, grub_size_t size)
+{
+  while (size)
+    {
+      grub_size_t cl;
+      cl = GRUB_DISK_SECTOR_SIZE - offset;
+      if (cl > size)
+	cl = size;
+      (disk->read_hook) (sector, offset, cl);
+      sector++;
+      size -= cl;
+      offset = 0;
+    }
 }
 
 /* Read data from the disk.  */
@@ -493,6 +843,13 @@ grub_disk_read (grub_disk_t disk, grub_disk_addr_t sector,
   real_offset = offset;
   real_size = size;
 
+  if (disk->nocache)
+    {
+      if (grub_disk_read_uncached (disk, sector, offset, size, buf))
+	return grub_errno;
+      goto done;
+    }
+
   /* First read until first cache boundary.   */
   if (offset || (sector & (GRUB_DISK_CACHE_SIZE - 1)))
     {
@@ -518,6 +875,26 @@ grub_disk_read (grub_disk_t disk, grub_disk_addr_t sector,
       offset &= ((1 << GRUB_DISK_SECTOR_BITS) - 1);
     }
 
+  /* Bulk reads into their final destination don't go through the cache:
+     it would only cost a copy and evict more useful data.  */
+  if (disk->direct && size >= (GRUB_DISK_CACHE_SIZE << GRUB_DISK_SECTOR_BITS))
+    {
+      grub_size_t len;
+      grub_err_t err;
+
+      len = size & ~((grub_size_t) (GRUB_DISK_CACHE_SIZE
+				    << GRUB_DISK_SECTOR_BITS) - 1);
+      err = (disk->dev->read) (disk, transform_sector (disk, sector),
+			       len >> disk->log_sector_size, buf);
+      if (err)
+	return err;
+      grub_disk_direct_bytes += len;
+
+      sector += len >> GRUB_DISK_SECTOR_BITS;
+      size -= len;
+      buf = (char *) buf + len;
+    }
+
   /* Until SIZE is zero...  */
   while (size >= (GRUB_DISK_CACHE_SIZE << GRUB_DISK_SECTOR_BITS))
     {
@@ -565,7 +942,7 @@ grub_disk_read (grub_disk_t disk, grub_disk_addr_t sector,
 				   sector + (i << GRUB_DISK_CACHE_BITS),
 				   (char *) buf
 				   + (i << (GRUB_DISK_CACHE_BITS
-					    + GRUB_DISK_SECTOR_BITS)));
+					    + GRUB_DISK_SECTOR_BITS)), 0);
 
 	  sector += agglomerate << GRUB_DISK_CACHE_BITS;
 	  size -= agglomerate << (GRUB_DISK_CACHE_BITS + GRUB_DISK_SECTOR_BITS);
@@ -590,26 +967,279 @@ grub_disk_read (grub_disk_t disk, grub_disk_addr_t sector,
 	return err;
     }
 
+  if (real_size && ! disk->direct)
+    grub_disk_readahead (disk, real_sector >> GRUB_DISK_CACHE_BITS,
+			 (real_sector + ((real_offset + real_size - 1)
+					 >> GRUB_DISK_SECTOR_BITS))
+			 >> GRUB_DISK_CACHE_BITS);
+
+ done:
   /* Call the read hook, if any.  */
   if (disk->read_hook)
+    grub_disk_call_read_hook (disk, real_sector, real_offset, real_size);
+
+  return grub_errno;
+}
+
+/* A range of a vectored read through the disk cache.  SECTOR and OFFSET
+   are adjusted, ENTRY is the request of the device the range is read
+   with, or one of the values below.  */
+struct grub_disk_vec_range
+{
+  grub_disk_addr_t sector;
+  grub_off_t offset;
+  int entry;
+};
+
+/* The range was copied from the disk cache.  */
+#define GRUB_DISK_VEC_CACHED	-1
+/* The range was read by grub_disk_read.  */
+#define GRUB_DISK_VEC_READ	-2
+
+/* Read the COUNT ranges in VEC through the disk cache.  The ranges are
+   widened to whole cache units, like grub_disk_read_small does.  Ranges
+   whose units are all cached are copied from the cache, the units of the
+   others are read in one request to the read_vec entry point of the
+   device, with units shared by consecutive ranges read once, and stored
+   in the cache.  IOV and SECTORS have room for COUNT requests.  */
+static grub_err_t
+grub_disk_read_vec_cached (grub_disk_t disk,
+			   const struct grub_disk_read_vec *vec,
+			   unsigned count, struct grub_disk_dev_iovec *iov,
+			   grub_disk_addr_t *sectors,
+			   struct grub_disk_vec_range *ranges)
+{
+  grub_size_t unit_size = GRUB_DISK_CACHE_SIZE << GRUB_DISK_SECTOR_BITS;
+  unsigned shift = disk->log_sector_size - GRUB_DISK_SECTOR_BITS;
+  grub_disk_addr_t disk_end = disk->total_sectors << shift;
+  grub_size_t total = 0, pos;
+  char *tmp_buf;
+  unsigned i, n = 0;
+
+  for (i = 0; i < count; i++)
+    {
+      grub_disk_addr_t sector = vec[i].sector;
+      grub_off_t offset = vec[i].offset;
+      grub_size_t size = vec[i].size;
+      grub_disk_addr_t first, last, unit, end;
+
+      if (grub_disk_adjust_range (disk, &sector, &offset, size))
+	return grub_errno;
+      ranges[i].sector = sector;
+      ranges[i].offset = offset;
+      ranges[i].entry = GRUB_DISK_VEC_CACHED;
+      if (! size)
+	continue;
+
+      first = sector & ~(GRUB_DISK_CACHE_SIZE - 1);
+      last = ((sector + ((offset + size - 1) >> GRUB_DISK_SECTOR_BITS))
+	      & ~(GRUB_DISK_CACHE_SIZE - 1));
+
+      /* The last unit of the disk may be partial.  */
+      if (disk->total_sectors == GRUB_DISK_SIZE_UNKNOWN
+	  || last + GRUB_DISK_CACHE_SIZE >= disk_end)
+	{
+	  ranges[i].entry = GRUB_DISK_VEC_READ;
+	  if (grub_disk_read (disk, vec[i].sector, vec[i].offset,
+			      vec[i].size, vec[i].buf))
+	    return grub_errno;
+	  continue;
+	}
+
+      for (unit = first; unit <= last; unit += GRUB_DISK_CACHE_SIZE)
+	if (! grub_disk_cache_lookup (disk->dev->id, disk->id, unit))
+	  break;
+
+      if (unit > last)
+	{
+	  char *buf = vec[i].buf;
+
+	  pos = ((sector - first) << GRUB_DISK_SECTOR_BITS) + offset;
+	  for (unit = first; size; unit += GRUB_DISK_CACHE_SIZE)
+	    {
+	      grub_size_t len = unit_size - pos;
+	      char *data;
+
+	      if (len > size)
+		len = size;
+	      data = grub_disk_cache_fetch (disk->dev->id, disk->id, unit);
+	      grub_memcpy (buf, data + pos, len);
+	      grub_disk_cache_unlock (disk->dev->id, disk->id, unit);
+	      buf += len;
+	      size -= len;
+	      pos = 0;
+	    }
+	  continue;
+	}
+
+      end = n ? sectors[n - 1] + (iov[n - 1].size << shift) : 0;
+      if (n && first >= sectors[n - 1] && first <= end)
+	{
+	  if (last + GRUB_DISK_CACHE_SIZE > end)
+	    iov[n - 1].size = (last + GRUB_DISK_CACHE_SIZE
+			       - sectors[n - 1]) >> shift;
+	  ranges[i].entry = n - 1;
+	  continue;
+	}
+
+      sectors[n] = first;
+      iov[n].sector = transform_sector (disk, first);
+      iov[n].size = (last + GRUB_DISK_CACHE_SIZE - first) >> shift;
+      ranges[i].entry = n;
+      n++;
+    }
+
+  if (! n)
+    goto done;
+
+  for (i = 0; i < n; i++)
+    total += iov[i].size << disk->log_sector_size;
+  tmp_buf = grub_malloc (total);
+  if (! tmp_buf)
+    return grub_errno;
+  for (i = 0, pos = 0; i < n; i++)
+    {
+      iov[i].buf = tmp_buf + pos;
+      pos += iov[i].size << disk->log_sector_size;
+    }
+
+  if ((disk->dev->read_vec) (disk, iov, n))
+    {
+      grub_error_push ();
+      grub_dprintf ("disk", "%s vectored read failed\n", disk->name);
+      grub_error_pop ();
+      grub_free (tmp_buf);
+      return grub_errno;
+    }
+
+  for (i = 0; i < n; i++)
+    for (pos = 0; pos < (iov[i].size << disk->log_sector_size);
+	 pos += unit_size)
+      {
+	grub_disk_cache_misses++;
+	grub_disk_cache_store (disk->dev->id, disk->id,
+			       sectors[i] + (pos >> GRUB_DISK_SECTOR_BITS),
+			       (char *) iov[i].buf + pos, 0);
+      }
+
+  for (i = 0; i < count; i++)
+    if (ranges[i].entry >= 0)
+      grub_memcpy (vec[i].buf,
+		   (char *) iov[ranges[i].entry].buf
+		   + ((ranges[i].sector - sectors[ranges[i].entry])
+		      << GRUB_DISK_SECTOR_BITS) + ranges[i].offset,
+		   vec[i].size);
+
+  grub_free (tmp_buf);
+
+ done:
+  for (i = 0; i < count; i++)
+    {
+      if (ranges[i].entry == GRUB_DISK_VEC_READ || ! vec[i].size)
+	continue;
+
+      grub_disk_readahead (disk, ranges[i].sector >> GRUB_DISK_CACHE_BITS,
+			   (ranges[i].sector
+			    + ((ranges[i].offset + vec[i].size - 1)
+			       >> GRUB_DISK_SECTOR_BITS))
+			   >> GRUB_DISK_CACHE_BITS);
+      if (disk->read_hook)
+	grub_disk_call_read_hook (disk, ranges[i].sector, ranges[i].offset,
+				  vec[i].size);
+    }
+
+  return GRUB_ERR_NONE;
+}
+
+/* Read the COUNT ranges in VEC from DISK in one request to the read_vec
+   entry point of the device if it has one.  Reads through the disk cache
+   are served by grub_disk_read_vec_cached.  Reads which bypass the cache
+   hand the ranges aligned to the sector size of DISK to the device and
+   read the others through grub_disk_read.  */
+grub_err_t
+grub_disk_read_vec (grub_disk_t disk, const struct grub_disk_read_vec *vec,
+		    unsigned count)
+{
+  struct grub_disk_dev_iovec *iov = 0;
+  grub_disk_addr_t *sectors = 0;
+  struct grub_disk_vec_range *ranges = 0;
+  int cached = ! disk->nocache && ! disk->direct;
+  unsigned i, n = 0;
+
+  if (disk->dev->read_vec && count > 1)
     {
-      grub_disk_addr_t s = real_sector;
-      grub_size_t l = real_size;
-      grub_off_t o = real_offset;
+      iov = grub_malloc (count * sizeof (*iov));
+      sectors = grub_malloc (count * sizeof (*sectors));
+      if (cached)
+	ranges = grub_malloc (count * sizeof (*ranges));
+      if (! iov || ! sectors || (cached && ! ranges))
+	{
+	  grub_free (iov);
+	  grub_free (sectors);
+	  grub_free (ranges);
+	  iov = 0;
+	  grub_errno = GRUB_ERR_NONE;
+	}
+    }
+
+  if (! iov)
+    {
+      for (i = 0; i < count; i++)
+	if (grub_disk_read (disk, vec[i].sector, vec[i].offset,
+			    vec[i].size, vec[i].buf))
+	  return grub_errno;
+      return GRUB_ERR_NONE;
+    }
 
-      while (l)
+  if (cached)
+    {
+      grub_disk_read_vec_cached (disk, vec, count, iov, sectors, ranges);
+      goto fail;
+    }
+
+  for (i = 0; i < count; i++)
+    {
+      grub_disk_addr_t sector = vec[i].sector;
+      grub_off_t offset = vec[i].offset;
+      grub_size_t size = vec[i].size;
+
+      if (grub_disk_adjust_range (disk, &sector, &offset, size))
+	goto fail;
+
+      if (offset || (size & ((1 << disk->log_sector_size) - 1))
+	  || (sector & ((1 << (disk->log_sector_size
+			       - GRUB_DISK_SECTOR_BITS)) - 1)))
 	{
-	  grub_size_t cl;
-	  cl = GRUB_DISK_SECTOR_SIZE - o;
-	  if (cl > l)
-	    cl = l;
-	  (disk->read_hook) (s, o, cl);
-	  s++;
-	  l -= cl;
-	  o = 0;
+	  if (grub_disk_read (disk, vec[i].sector, vec[i].offset,
+			      vec[i].size, vec[i].buf))
+	    goto fail;
+	  continue;
 	}
+
+      sectors[n] = sector;
+      iov[n].sector = transform_sector (disk, sector);
+      iov[n].size = size >> disk->log_sector_size;
+      iov[n].buf = vec[i].buf;
+      n++;
+    }
+
+  if (n && (disk->dev->read_vec) (disk, iov, n))
+    {
+      grub_error_push ();
+      grub_dprintf ("disk", "%s vectored read failed\n", disk->name);
+      grub_error_pop ();
+      goto fail;
     }
 
+  if (disk->read_hook)
+    for (i = 0; i < n; i++)
+      grub_disk_call_read_hook (disk, sectors[i], 0,
+				iov[i].size << disk->log_sector_size);
+
+ fail:
+  grub_free (iov);
+  grub_free (sectors);
+  grub_free (ranges);
   return grub_errno;
 }
 
@@ -269,7 +269,8 @@ grub_elf32_load (grub_elf_t _elf, const char *filename,
     if (phdr->p_filesz)
       {
 	grub_ssize_t read;
-	read = grub_file_read (elf->file, (void *) load_addr, phdr->p_filesz);
+	read = grub_file_read_direct (elf->file, (void *) load_addr,
+				      phdr->p_filesz);
 	if (read != (grub_ssize_t) phdr->p_filesz)
 	  {
 	    /* XXX How can we free memory from `load_hook'? */
@@ -460,7 +461,8 @@ grub_elf64_load (grub_elf_t _elf, const char *filename,
     if (phdr->p_filesz)
       {
 	grub_ssize_t read;
-	read = grub_file_read (elf->file, (void *) load_addr, phdr->p_filesz);
+	read = grub_file_read_direct (elf->file, (void *) load_addr,
+				      phdr->p_filesz);
 	if (read != (grub_ssize_t) phdr->p_filesz)
           {
 	    /* XXX How can we free memory from `load_hook'?  */
@@ -22,13 +22,20 @@
 #include <grub/i386/memory.h>
 
 #include <grub/emu/bhyve.h>
+#include <grub/emu/bhyve_extent.h>
 
 SLIST_HEAD(grub_rlc_head, grub_relocator_chunk);
 
-/* dummy struct for now */
+/*
+ * Chunks are kept on an unsorted list purely so they can be freed.
+ * Free guest memory is tracked in an extent tree, so allocations
+ * don't need to scan existing chunks.
+ */
 struct grub_relocator
 {
   struct grub_rlc_head head;
+  struct grub_bhyve_extent_map free;
+  grub_phys_addr_t end;
 };
 
 struct grub_relocator_chunk
@@ -62,49 +69,51 @@ struct grub_relocator *
 grub_relocator_new (void)
 {
   struct grub_relocator *ret;
+  int i;
 
   ret = grub_zalloc (sizeof (struct grub_relocator));
   if (!ret)
     return NULL;
   
   SLIST_INIT(&ret->head);
+  grub_bhyve_extent_init(&ret->free);
+
+  /*
+   * All guest memory segments start out free
+   */
+  for (i = 0; i < binfo->nsegs; i++) {
+    if (grub_bhyve_extent_add(&ret->free, binfo->segs[i].start,
+			      binfo->segs[i].end - binfo->segs[i].start + 1)) {
+      grub_relocator_unload(ret);
+      return NULL;
+    }
+  }
   
   return ret;
 }
 
-/* Return true if [point,point+size) is disjoint from [otarget,otarget+osize) */
-static int
-grub_relocator_disjoint(grub_phys_addr_t point, grub_size_t size,
-		       grub_phys_addr_t otarget, grub_size_t osize)
+static grub_err_t
+grub_relocator_add_chunk (struct grub_relocator *rel,
+			  grub_relocator_chunk_t *out,
+			  grub_phys_addr_t target, grub_size_t size)
 {
-  if ((point >= (otarget + osize)) || ((point + size) < otarget))
-    return 1;
-
-  return 0;
-}
-
-/* Return true if point is within [target, target+size) */
-static int
-grub_relocator_within(grub_phys_addr_t point, grub_phys_addr_t target,
-                      grub_size_t size)
-{
-  if (point >= target && point < (target + size))
-    return 1;
-
-  return 0;
-}
+  struct grub_relocator_chunk *ncp;
 
-static grub_phys_addr_t
-grub_relocator_end(struct grub_relocator *rel)
-{
-  struct grub_relocator_chunk *cp, *cp_last;
-  
-  cp_last = NULL;
-  SLIST_FOREACH(cp, &rel->head, next) {
-    cp_last = cp;
+  ncp = grub_zalloc (sizeof (struct grub_relocator_chunk));
+  if (!ncp) {
+    grub_bhyve_extent_add(&rel->free, target, size);
+    return GRUB_ERR_OUT_OF_MEMORY;
   }
+  
+  ncp->target = target;
+  ncp->size = size;
+  SLIST_INSERT_HEAD(&rel->head, ncp, next);
+
+  if (target + size > rel->end)
+    rel->end = target + size;
 
-  return (cp_last ? cp_last->target + cp_last->size : 0);
+  *out = ncp;
+  return GRUB_ERR_NONE;
 }
 
 grub_err_t
@@ -112,81 +121,19 @@ grub_relocator_alloc_chunk_addr (struct grub_relocator *rel,
                                  grub_relocator_chunk_t *out,
                                  grub_phys_addr_t target, grub_size_t size)
 {
-  struct grub_relocator_chunk *cp, *ncp, *prev;
-  grub_phys_addr_t end, ptarget;
-  grub_size_t psize;
   grub_err_t err;
-  int i;
 
-  end = target + size - 1;
   *out = NULL;
 
   /*
-   * Make sure there are no existing allocations that this request
-   * overlaps with
+   * The range has to lie entirely within free guest memory, i.e. within
+   * a physical segment and clear of existing allocations
    */
-  SLIST_FOREACH(cp, &rel->head, next) {
-    if (!grub_relocator_disjoint(target, size, cp->target, cp->size))
-      {
-	err = GRUB_ERR_BAD_ARGUMENT;
-	goto done;
-      }
-  }
+  err = grub_bhyve_extent_alloc_addr(&rel->free, target, size);
+  if (err)
+    return err;
 
-  /*
-   * See if the allocation fits within physical segments
-   */
-  for (i = 0; i < binfo->nsegs; i++) {
-    ptarget = binfo->segs[i].start;
-    psize = binfo->segs[i].end - ptarget + 1;
-    if (grub_relocator_within(target, ptarget, psize) &&
-	grub_relocator_within(end, ptarget, psize))
-      break;
-  }
-
-  if (i == binfo->nsegs) {
-    err = GRUB_ERR_OUT_OF_RANGE;
-    goto done;
-  }
-
-  /*
-   * Located a memory segment: allocate a chunk and insert it into
-   * the list
-   */
-  ncp = grub_zalloc (sizeof (struct grub_relocator_chunk));
-  if (!ncp) {
-    err = GRUB_ERR_OUT_OF_MEMORY;
-    goto done;
-  }
-  
-  ncp->target = target;
-  ncp->size = size;
-
-  /*
-   * Insert at the head if the list is empty or the first element is
-   * at a higher address
-   */
-  if (SLIST_EMPTY(&rel->head) || (SLIST_FIRST(&rel->head))->target > target) {
-    SLIST_INSERT_HEAD(&rel->head, ncp, next);
-  } else {
-    /*
-     * At least one element in the list that is less than target, so prev
-     * is guaranteed to exist for the list insertion.
-     */
-    SLIST_FOREACH(cp, &rel->head, next) {
-      if (cp->target > target) {
-	break;
-      }
-      prev = cp;
-    }
-    SLIST_INSERT_AFTER(prev, ncp, next);
-  }
-  
-  *out = ncp;
-  err = 0;
-
- done:
-  return err;
+  return grub_relocator_add_chunk(rel, out, target, size);
 }
 
 grub_err_t
@@ -195,12 +142,14 @@ grub_relocator_alloc_chunk_align (struct grub_relocator *rel,
                                   grub_phys_addr_t min_addr,
                                   grub_phys_addr_t max_addr,
                                   grub_size_t size, grub_size_t align,
-                                  int preference __attribute__ ((unused)),
+                                  int preference,
                                   int avoid_efi_boot_services __attribute__ ((unused)))
 {
   grub_err_t err;
   grub_uint64_t addr;
 
+  *out = NULL;
+
   /*
    * Filter/modify allocations that specify a min address <= 1MB.
    * This is really a no-go area on x86, but loader code is often
@@ -217,19 +166,15 @@ grub_relocator_alloc_chunk_align (struct grub_relocator *rel,
   }
 
   /*
-   * Extremely simplistic - run through the given address space and
-   * attempt allocations at the specified alignment until successful,
-   * or no allocations could be found
-   * XXX only deal with preferences of LOW and NONE
+   * Pick the lowest (or highest, for PREFERENCE_HIGH) suitably aligned
+   * free range
    */
-  addr = min_addr;
-  for (addr = ALIGN_UP(addr, align); addr <= max_addr; addr += align) {
-    err = grub_relocator_alloc_chunk_addr(rel, out, addr, size);
-    if (err == 0)
-      break;
-  }
+  err = grub_bhyve_extent_alloc_align(&rel->free, min_addr, max_addr,
+				      size, align, preference, &addr);
+  if (err)
+    return err;
 
-  return err;
+  return grub_relocator_add_chunk(rel, out, addr, size);
 }
 
 void
@@ -246,6 +191,7 @@ grub_relocator_unload (struct grub_relocator *rel)
     grub_free(cp);
   }
 
+  grub_bhyve_extent_fini(&rel->free);
   grub_free (rel);
 }
 
@@ -291,7 +237,8 @@ grub_relocator32_boot (struct grub_relocator *rel,
   if (err) {
     grub_phys_addr_t target;
 
-    target = ALIGN_UP(grub_relocator_end(rel), 8);
+    grub_errno = GRUB_ERR_NONE;
+    target = ALIGN_UP(rel->end, 8);
     err = grub_relocator_alloc_chunk_addr (rel, &ch, target, binfo->bootsz);
   }
   
@@ -0,0 +1,436 @@
+/*
+ *  GRUB  --  GRand Unified Bootloader
+ *  Copyright (C) 2013  Free Software Foundation, Inc.
+ *
+ *  GRUB is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  GRUB is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with GRUB.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Free extent map for the bhyve relocator.  It doesn't depend on bhyve
+ * itself so that it can be tested on any host.
+ */
+
+#include <grub/err.h>
+#include <grub/misc.h>
+#include <grub/mm.h>
+#include <grub/relocator.h>
+#include <grub/emu/bhyve_extent.h>
+
+/* An AVL tree node describing the free range [start, start + len).  */
+struct grub_bhyve_extent
+{
+  grub_uint64_t start;
+  grub_uint64_t len;
+  /* The largest len in this subtree.  */
+  grub_uint64_t maxlen;
+  int height;
+  struct grub_bhyve_extent *left;
+  struct grub_bhyve_extent *right;
+};
+
+static inline int
+extent_height (struct grub_bhyve_extent *n)
+{
+  return n ? n->height : 0;
+}
+
+static inline grub_uint64_t
+extent_maxlen (struct grub_bhyve_extent *n)
+{
+  return n ? n->maxlen : 0;
+}
+
+static void
+extent_update (struct grub_bhyve_extent *n)
+{
+  int hl = extent_height (n->left), hr = extent_height (n->right);
+
+  n->height = 1 + (hl > hr ? hl : hr);
+  n->maxlen = n->len;
+  if (extent_maxlen (n->left) > n->maxlen)
+    n->maxlen = extent_maxlen (n->left);
+  if (extent_maxlen (n->right) > n->maxlen)
+    n->maxlen = extent_maxlen (n->right);
+}
+
+static struct grub_bhyve_extent *
+extent_rotate_right (struct grub_bhyve_extent *n)
+{
+  struct grub_bhyve_extent *l = n->left;
+
+  n->left = l->right;
+  l->right = n;
+  extent_update (n);
+  extent_update (l);
+  return l;
+}
+
+static struct grub_bhyve_extent *
+extent_rotate_left (struct grub_bhyve_extent *n)
+{
+  struct grub_bhyve_extent *r = n->right;
+
+  n->right = r->left;
+  r->left = n;
+  extent_update (n);
+  extent_update (r);
+  return r;
+}
+
+static struct grub_bhyve_extent *
+extent_balance (struct grub_bhyve_extent *n)
+{
+  int balance;
+
+  extent_update (n);
+  balance = extent_height (n->left) - extent_height (n->right);
+
+  if (balance > 1)
+    {
+      if (extent_height (n->left->left) < extent_height (n->left->right))
+	n->left = extent_rotate_left (n->left);
+      return extent_rotate_right (n);
+    }
+
+  if (balance < -1)
+    {
+      if (extent_height (n->right->right) < extent_height (n->right->left))
+	n->right = extent_rotate_right (n->right);
+      return extent_rotate_left (n);
+    }
+
+  return n;
+}
+
+static struct grub_bhyve_extent *
+extent_insert (struct grub_bhyve_extent *n, struct grub_bhyve_extent *e)
+{
+  if (! n)
+    {
+      e->left = e->right = 0;
+      extent_update (e);
+      return e;
+    }
+
+  if (e->start < n->start)
+    n->left = extent_insert (n->left, e);
+  else
+    n->right = extent_insert (n->right, e);
+
+  return extent_balance (n);
+}
+
+static struct grub_bhyve_extent *
+extent_remove_min (struct grub_bhyve_extent *n, struct grub_bhyve_extent **min)
+{
+  if (! n->left)
+    {
+      *min = n;
+      return n->right;
+    }
+
+  n->left = extent_remove_min (n->left, min);
+  return extent_balance (n);
+}
+
+/* Unlink the node E from the tree N.  */
+static struct grub_bhyve_extent *
+extent_remove (struct grub_bhyve_extent *n, struct grub_bhyve_extent *e)
+{
+  struct grub_bhyve_extent *min;
+
+  if (! n)
+    return 0;
+
+  if (e->start < n->start)
+    n->left = extent_remove (n->left, e);
+  else if (e->start > n->start)
+    n->right = extent_remove (n->right, e);
+  else
+    {
+      if (! n->right)
+	return n->left;
+
+      n->right = extent_remove_min (n->right, &min);
+      min->left = n->left;
+      min->right = n->right;
+      n = min;
+    }
+
+  return extent_balance (n);
+}
+
+/* Return the extent with the highest start not above ADDR.  */
+static struct grub_bhyve_extent *
+extent_lookup (struct grub_bhyve_extent *n, grub_uint64_t addr)
+{
+  struct grub_bhyve_extent *found = 0;
+
+  while (n)
+    {
+      if (n->start <= addr)
+	{
+	  found = n;
+	  n = n->right;
+	}
+      else
+	n = n->left;
+    }
+
+  return found;
+}
+
+static grub_err_t
+extent_insert_range (struct grub_bhyve_extent_map *map,
+		     grub_uint64_t start, grub_uint64_t len)
+{
+  struct grub_bhyve_extent *e;
+
+  if (! len)
+    return GRUB_ERR_NONE;
+
+  e = grub_malloc (sizeof (*e));
+  if (! e)
+    return grub_errno;
+
+  e->start = start;
+  e->len = len;
+  map->root = extent_insert (map->root, e);
+
+  return GRUB_ERR_NONE;
+}
+
+void
+grub_bhyve_extent_init (struct grub_bhyve_extent_map *map)
+{
+  map->root = 0;
+}
+
+static void
+extent_free (struct grub_bhyve_extent *n)
+{
+  if (! n)
+    return;
+
+  extent_free (n->left);
+  extent_free (n->right);
+  grub_free (n);
+}
+
+void
+grub_bhyve_extent_fini (struct grub_bhyve_extent_map *map)
+{
+  extent_free (map->root);
+  map->root = 0;
+}
+
+grub_err_t
+grub_bhyve_extent_add (struct grub_bhyve_extent_map *map,
+		       grub_uint64_t start, grub_uint64_t len)
+{
+  struct grub_bhyve_extent *prev, *next;
+
+  if (start + len < start)
+    return grub_error (GRUB_ERR_BAD_ARGUMENT, "invalid memory range");
+
+  if (! len)
+    return GRUB_ERR_NONE;
+
+  /* Refuse overlaps with memory which is already free.  */
+  prev = extent_lookup (map->root, start + len - 1);
+  if (prev && prev->start + prev->len > start)
+    return grub_error (GRUB_ERR_BAD_ARGUMENT, "overlapping memory range");
+
+  /* Merge with adjacent extents so that allocations may span them.  */
+  prev = start ? extent_lookup (map->root, start - 1) : 0;
+  if (prev && prev->start + prev->len != start)
+    prev = 0;
+  next = extent_lookup (map->root, start + len);
+  if (next && next->start != start + len)
+    next = 0;
+
+  if (! prev && ! next)
+    return extent_insert_range (map, start, len);
+
+  if (next)
+    {
+      map->root = extent_remove (map->root, next);
+      len += next->len;
+      if (prev)
+	grub_free (next);
+      else
+	{
+	  next->start = start;
+	  next->len = len;
+	  map->root = extent_insert (map->root, next);
+	}
+    }
+
+  if (prev)
+    {
+      /* Re-insert it so that maxlen is updated on the way up.  */
+      prev->len += len;
+      map->root = extent_remove (map->root, prev);
+      map->root = extent_insert (map->root, prev);
+    }
+
+  return GRUB_ERR_NONE;
+}
+
+grub_err_t
+grub_bhyve_extent_alloc_addr (struct grub_bhyve_extent_map *map,
+			      grub_uint64_t target, grub_uint64_t size)
+{
+  struct grub_bhyve_extent *e, *upper = 0;
+  grub_uint64_t start, end;
+
+  if (! size || target + size < target)
+    return grub_error (GRUB_ERR_BAD_ARGUMENT, "invalid allocation");
+
+  e = extent_lookup (map->root, target);
+  if (! e || e->start + e->len < target + size)
+    return grub_error (GRUB_ERR_OUT_OF_RANGE, "memory is not free");
+
+  start = e->start;
+  end = e->start + e->len;
+
+  /* Allocate the node for the upper remainder first so that failure leaves
+     the map untouched.  */
+  if (target > start && end > target + size)
+    {
+      upper = grub_malloc (sizeof (*upper));
+      if (! upper)
+	return grub_errno;
+    }
+
+  /* Split the extent around the allocation.  The existing node is reused
+     for whichever remainder needs no new one.  */
+  map->root = extent_remove (map->root, e);
+
+  if (target > start)
+    {
+      e->len = target - start;
+      map->root = extent_insert (map->root, e);
+      e = upper;
+    }
+
+  if (end > target + size)
+    {
+      e->start = target + size;
+      e->len = end - (target + size);
+      map->root = extent_insert (map->root, e);
+    }
+  else
+    grub_free (e);
+
+  return GRUB_ERR_NONE;
+}
+
+/* Find the lowest ALIGN-aligned address between MIN_ADDR and MAX_ADDR
+   where SIZE bytes are free in the subtree N.  */
+static int
+extent_find_low (struct grub_bhyve_extent *n, grub_uint64_t min_addr,
+		 grub_uint64_t max_addr, grub_uint64_t size,
+		 grub_uint64_t align, grub_uint64_t *target)
+{
+  grub_uint64_t addr;
+
+  if (! n || n->maxlen < size)
+    return 0;
+
+  /* Extents to the left lie entirely below this one, so they can only be
+     usable if this one ends above MIN_ADDR.  */
+  if (n->start + n->len > min_addr
+      && extent_find_low (n->left, min_addr, max_addr, size, align, target))
+    return 1;
+
+  if (n->start > max_addr)
+    return 0;
+
+  addr = n->start > min_addr ? n->start : min_addr;
+  addr = ALIGN_UP (addr, align);
+  if (n->len >= size && addr >= n->start && addr <= max_addr
+      && addr <= n->start + n->len - size)
+    {
+      *target = addr;
+      return 1;
+    }
+
+  return extent_find_low (n->right, min_addr, max_addr, size, align, target);
+}
+
+/* Same as extent_find_low, but find the highest address.  */
+static int
+extent_find_high (struct grub_bhyve_extent *n, grub_uint64_t min_addr,
+		  grub_uint64_t max_addr, grub_uint64_t size,
+		  grub_uint64_t align, grub_uint64_t *target)
+{
+  grub_uint64_t addr;
+
+  if (! n || n->maxlen < size)
+    return 0;
+
+  if (n->start <= max_addr
+      && extent_find_high (n->right, min_addr, max_addr, size, align, target))
+    return 1;
+
+  if (n->start > max_addr)
+    return extent_find_high (n->left, min_addr, max_addr, size, align,
+			     target);
+
+  if (n->start + n->len <= min_addr)
+    return 0;
+
+  if (n->len >= size)
+    {
+      addr = n->start + n->len - size;
+      if (addr > max_addr)
+	addr = max_addr;
+      addr = ALIGN_DOWN (addr, align);
+      if (addr >= n->start && addr >= min_addr)
+	{
+	  *target = addr;
+	  return 1;
+	}
+    }
+
+  return extent_find_high (n->left, min_addr, max_addr, size, align, target);
+}
+
+grub_err_t
+grub_bhyve_extent_alloc_align (struct grub_bhyve_extent_map *map,
+			       grub_uint64_t min_addr, grub_uint64_t max_addr,
+			       grub_uint64_t size, grub_uint64_t align,
+			       int preference, grub_uint64_t *target)
+{
+  int found;
+
+  if (! align)
+    align = 1;
+
+  if (! size || min_addr > max_addr || ALIGN_UP (min_addr, align) < min_addr)
+    return grub_error (GRUB_ERR_OUT_OF_RANGE, "no suitable memory");
+
+  if (preference == GRUB_RELOCATOR_PREFERENCE_HIGH)
+    found = extent_find_high (map->root, min_addr, max_addr, size, align,
+			      target);
+  else
+    found = extent_find_low (map->root, min_addr, max_addr, size, align,
+			     target);
+
+  if (! found)
+    return grub_error (GRUB_ERR_OUT_OF_RANGE, "no suitable memory");
+
+  return grub_bhyve_extent_alloc_addr (map, *target, size);
+}
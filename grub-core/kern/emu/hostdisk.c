@@ -40,15 +40,12 @@
 #include <fcntl.h>
 #include <errno.h>
 #include <limits.h>
+#include <sys/uio.h>
+#include <sys/mman.h>
 
 #ifdef __linux__
 # include <sys/ioctl.h>         /* ioctl */
 # include <sys/mount.h>
-# if !defined(__GLIBC__) || \
-        ((__GLIBC__ < 2) || ((__GLIBC__ == 2) && (__GLIBC_MINOR__ < 1)))
-/* Maybe libc doesn't have large file support.  */
-#  include <linux/unistd.h>     /* _llseek */
-# endif /* (GLIBC < 2) || ((__GLIBC__ == 2) && (__GLIBC_MINOR < 1)) */
 # ifndef BLKFLSBUF
 #  define BLKFLSBUF     _IO (0x12,97)   /* flush buffer cache */
 # endif /* ! BLKFLSBUF */
@@ -82,6 +79,15 @@ struct hd_geometry
 # include <sys/sysctl.h>
 # include <sys/mount.h>
 #include <libgeom.h>
+#include <aio.h>
+#endif
+
+/* Submit the ranges of a vectored read as POSIX asynchronous I/O requests
+   so that the host can keep all of them in flight.  Only done where a
+   disk is always accessed through the same descriptor.  */
+#if (defined(__FreeBSD__) || defined(__FreeBSD_kernel__)) \
+  && defined(_POSIX_ASYNCHRONOUS_IO) && _POSIX_ASYNCHRONOUS_IO > 0
+# define HOSTDISK_USE_AIO 1
 #endif
 
 #if defined (__sun__)
@@ -123,8 +129,16 @@ static struct
 #ifdef BHYVE
   int diskfd;
 #endif
+  /* Read-only mapping of the whole device, if it is a regular file.  */
+  char *mapping;
+  grub_uint64_t mapping_size;
 } map[256];
 
+/* Host I/O statistics, reported with --verbose.  */
+static unsigned long hostdisk_read_calls;
+static unsigned long hostdisk_aio_batches;
+static grub_uint64_t hostdisk_read_bytes;
+
 struct grub_util_biosdisk_data
 {
   char *dev;
@@ -392,6 +406,9 @@ grub_util_biosdisk_open (const char *name, grub_disk_t disk)
 						 &disk->log_sector_size);
     disk->total_sectors >>= disk->log_sector_size;
 
+    /* Reading from the mapping is as fast as from the disk cache.  */
+    disk->nocache = (map[drive].mapping != NULL);
+
 # if defined(__FreeBSD__) || defined(__FreeBSD_kernel__) || defined(__APPLE__) || defined(__NetBSD__)
     if (fstat (fd, &st) < 0 || ! S_ISCHR (st.st_mode))
 # else
@@ -772,25 +789,6 @@ linux_find_partition (char *dev, grub_disk_addr_t sector)
 }
 #endif /* __linux__ */
 
-#if defined(__linux__) && (!defined(__GLIBC__) || \
-        ((__GLIBC__ < 2) || ((__GLIBC__ == 2) && (__GLIBC_MINOR__ < 1))))
-  /* Maybe libc doesn't have large file support.  */
-grub_err_t
-grub_util_fd_seek (int fd, const char *name, grub_uint64_t off)
-{
-  loff_t offset, result;
-  static int _llseek (uint filedes, ulong hi, ulong lo,
-		      loff_t *res, uint wh);
-  _syscall5 (int, _llseek, uint, filedes, ulong, hi, ulong, lo,
-	     loff_t *, res, uint, wh);
-
-  offset = (loff_t) off;
-  if (_llseek (fd, offset >> 32, offset & 0xffffffff, &result, SEEK_SET))
-    return grub_error (GRUB_ERR_BAD_DEVICE, N_("cannot seek `%s': %s"),
-		       name, strerror (errno));
-  return GRUB_ERR_NONE;
-}
-#else
 grub_err_t
 grub_util_fd_seek (int fd, const char *name, grub_uint64_t off)
 {
@@ -801,7 +799,6 @@ grub_util_fd_seek (int fd, const char *name, grub_uint64_t off)
 		       name, strerror (errno));
   return 0;
 }
-#endif
 
 static void
 flush_initial_buffer (const char *os_dev __attribute__ ((unused)))
@@ -847,9 +844,11 @@ grub_hostdisk_os_dev_to_grub_drive (const char *os_disk, int add)
   return map[i].drive;
 }
 
+/* Open the device backing DISK for accessing SECTOR.  The offset of SECTOR
+   in the returned descriptor is stored in OFF, if not NULL.  */
 static int
 open_device (const grub_disk_t disk, grub_disk_addr_t sector, int flags,
-	     grub_disk_addr_t *max)
+	     grub_disk_addr_t *max, grub_uint64_t *off)
 {
   int fd;
   struct grub_util_biosdisk_data *data = disk->data;
@@ -1040,12 +1039,8 @@ open_device (const grub_disk_t disk, grub_disk_addr_t sector, int flags,
   configure_device_driver (fd);
 #endif /* defined(__NetBSD__) */
 
-  if (grub_util_fd_seek (fd, map[disk->id].device,
-			 sector << disk->log_sector_size))
-    {
-      close (fd);
-      return -1;
-    }
+  if (off)
+    *off = sector << disk->log_sector_size;
 
   return fd;
 }
@@ -1102,15 +1097,88 @@ grub_util_fd_write (int fd, const char *buf, size_t len)
   return size;
 }
 
+/* Read LEN bytes at offset OFF of FD in BUF. Return less than zero if an
+   error occurs, the number of bytes read if the end of the file is reached
+   first, otherwise LEN.  */
+ssize_t
+grub_util_fd_pread (int fd, char *buf, size_t len, grub_uint64_t off)
+{
+  ssize_t size = len;
+
+  while (len)
+    {
+      ssize_t ret = pread (fd, buf, len, off);
+
+      hostdisk_read_calls++;
+      if (ret < 0 && errno == EINTR)
+	continue;
+      /* An error, or the end of the file.  */
+      if (ret <= 0)
+	return ret < 0 ? ret : size - (ssize_t) len;
+
+      hostdisk_read_bytes += ret;
+      len -= ret;
+      buf += ret;
+      off += ret;
+    }
+
+  return size;
+}
+
+/* Write LEN bytes from BUF at offset OFF of FD. Return less than or equal
+   to zero if an error occurs, otherwise return LEN.  */
+ssize_t
+grub_util_fd_pwrite (int fd, const char *buf, size_t len, grub_uint64_t off)
+{
+  ssize_t size = len;
+
+  while (len)
+    {
+      ssize_t ret = pwrite (fd, buf, len, off);
+
+      if (ret < 0 && errno == EINTR)
+	continue;
+      if (ret <= 0)
+	return ret;
+
+      len -= ret;
+      buf += ret;
+      off += ret;
+    }
+
+  return size;
+}
+
+/* Copy SIZE sectors at SECTOR of DISK from its mapping to BUF.  Return
+   zero if DISK isn't mapped or the range is outside of the mapping.  */
+static int
+hostdisk_read_mapped (grub_disk_t disk, grub_disk_addr_t sector,
+		      grub_size_t size, char *buf)
+{
+  grub_uint64_t off = sector << disk->log_sector_size;
+  grub_uint64_t len = (grub_uint64_t) size << disk->log_sector_size;
+
+  if (! map[disk->id].mapping || off > map[disk->id].mapping_size
+      || len > map[disk->id].mapping_size - off)
+    return 0;
+
+  memcpy (buf, map[disk->id].mapping + off, len);
+  return 1;
+}
+
 static grub_err_t
 grub_util_biosdisk_read (grub_disk_t disk, grub_disk_addr_t sector,
 			 grub_size_t size, char *buf)
 {
+  if (hostdisk_read_mapped (disk, sector, size, buf))
+    return GRUB_ERR_NONE;
+
   while (size)
     {
       int fd;
       grub_disk_addr_t max = ~0ULL;
-      fd = open_device (disk, sector, O_RDONLY, &max);
+      grub_uint64_t off;
+      fd = open_device (disk, sector, O_RDONLY, &max, &off);
       if (fd < 0)
 	return grub_errno;
 
@@ -1126,7 +1194,7 @@ grub_util_biosdisk_read (grub_disk_t disk, grub_disk_addr_t sector,
       if (max > size)
 	max = size;
 
-      if (grub_util_fd_read (fd, buf, max << disk->log_sector_size)
+      if (grub_util_fd_pread (fd, buf, max << disk->log_sector_size, off)
 	  != (ssize_t) (max << disk->log_sector_size))
 	return grub_error (GRUB_ERR_READ_ERROR, N_("cannot read `%s': %s"),
 			   map[disk->id].device, strerror (errno));
@@ -1137,6 +1205,203 @@ grub_util_biosdisk_read (grub_disk_t disk, grub_disk_addr_t sector,
   return GRUB_ERR_NONE;
 }
 
+/* Read the buffers of IOV at offset OFF of FD, restarting after short
+   reads.  Return the number of bytes read or less than zero on error.  */
+static ssize_t
+grub_util_fd_preadv (int fd, struct iovec *iov, int iovcnt, grub_uint64_t off)
+{
+  ssize_t size = 0;
+
+  while (iovcnt)
+    {
+      ssize_t ret = preadv (fd, iov, iovcnt, off + size);
+
+      hostdisk_read_calls++;
+      if (ret <= 0)
+        {
+          if (ret < 0 && errno == EINTR)
+            continue;
+          else
+            return ret < 0 ? ret : size;
+        }
+
+      hostdisk_read_bytes += ret;
+      size += ret;
+      while (iovcnt && (size_t) ret >= iov->iov_len)
+	{
+	  ret -= iov->iov_len;
+	  iov++;
+	  iovcnt--;
+	}
+      if (iovcnt)
+	{
+	  iov->iov_base = (char *) iov->iov_base + ret;
+	  iov->iov_len -= ret;
+	}
+    }
+
+  return size;
+}
+
+/* The maximum number of buffers handed to a single preadv or lio_listio.  */
+#define HOSTDISK_IOV_MAX 64
+
+#ifdef HOSTDISK_USE_AIO
+/* Cleared if the host doesn't support asynchronous I/O on our devices.  */
+static int hostdisk_aio_usable = 1;
+
+/* Read up to HOSTDISK_IOV_MAX ranges of VEC from FD with a single
+   lio_listio.  Return the number of ranges read, or zero if the caller
+   should fall back to synchronous reads.  */
+static unsigned
+grub_util_biosdisk_read_vec_aio (grub_disk_t disk, int fd,
+				 const struct grub_disk_dev_iovec *vec,
+				 unsigned count)
+{
+  struct aiocb cbs[HOSTDISK_IOV_MAX];
+  struct aiocb *list[HOSTDISK_IOV_MAX];
+  unsigned i;
+
+  if (count > HOSTDISK_IOV_MAX)
+    count = HOSTDISK_IOV_MAX;
+#if defined(AIO_LISTIO_MAX) && AIO_LISTIO_MAX < HOSTDISK_IOV_MAX
+  if (count > AIO_LISTIO_MAX)
+    count = AIO_LISTIO_MAX;
+#endif
+
+  memset (cbs, 0, count * sizeof (cbs[0]));
+  for (i = 0; i < count; i++)
+    {
+      cbs[i].aio_fildes = fd;
+      cbs[i].aio_offset = vec[i].sector << disk->log_sector_size;
+      cbs[i].aio_buf = vec[i].buf;
+      cbs[i].aio_nbytes = vec[i].size << disk->log_sector_size;
+      cbs[i].aio_lio_opcode = LIO_READ;
+      list[i] = &cbs[i];
+    }
+
+  if (lio_listio (LIO_WAIT, list, count, NULL) < 0
+      && (errno == ENOSYS || errno == EOPNOTSUPP || errno == EINVAL))
+    {
+      grub_dprintf ("hostdisk", "lio_listio failed: %s\n", strerror (errno));
+      hostdisk_aio_usable = 0;
+      return 0;
+    }
+  /* On other errors some of the requests may still have been queued,
+     the loop below waits for them and redoes the others.  */
+  hostdisk_aio_batches++;
+
+  for (i = 0; i < count; i++)
+    {
+      ssize_t ret;
+      size_t len = vec[i].size << disk->log_sector_size;
+
+      while (aio_error (&cbs[i]) == EINPROGRESS)
+	{
+	  const struct aiocb *wait[1] = { &cbs[i] };
+	  aio_suspend (wait, 1, NULL);
+	}
+
+      ret = aio_return (&cbs[i]);
+      hostdisk_read_calls++;
+      if (ret > 0)
+	hostdisk_read_bytes += ret;
+      if (ret < 0)
+	ret = 0;
+
+      /* Finish short or failed requests synchronously.  */
+      if ((size_t) ret < len
+	  && grub_util_fd_pread (fd, vec[i].buf + ret, len - ret,
+				 cbs[i].aio_offset + ret) != (ssize_t) (len - ret))
+	{
+	  grub_error (GRUB_ERR_READ_ERROR, N_("cannot read `%s': %s"),
+		      map[disk->id].device, strerror (errno));
+	  return 0;
+	}
+    }
+
+  return count;
+}
+#endif
+
+static grub_err_t
+grub_util_biosdisk_read_vec (grub_disk_t disk,
+			     const struct grub_disk_dev_iovec *vec,
+			     unsigned count)
+{
+  struct iovec iov[HOSTDISK_IOV_MAX];
+  unsigned i, j, k;
+
+  if (map[disk->id].mapping)
+    {
+      for (i = 0; i < count; i++)
+	if (grub_util_biosdisk_read (disk, vec[i].sector, vec[i].size,
+				     vec[i].buf))
+	  return grub_errno;
+      return GRUB_ERR_NONE;
+    }
+
+  for (i = 0; i < count; i = j)
+    {
+      int fd;
+      grub_disk_addr_t max = ~0ULL;
+      grub_uint64_t off;
+      grub_size_t total = vec[i].size;
+
+      /* Gather the following ranges which are contiguous on disk.  */
+      for (j = i + 1; j < count && j - i < HOSTDISK_IOV_MAX
+	     && vec[j].sector == vec[i].sector + total; j++)
+	total += vec[j].size;
+
+      fd = open_device (disk, vec[i].sector, O_RDONLY, &max, &off);
+      if (fd < 0)
+	return grub_errno;
+
+#ifdef HOSTDISK_USE_AIO
+      /* The ranges don't all follow each other, let the host work on
+	 several of them at once.  */
+      if (j < count && hostdisk_aio_usable)
+	{
+	  k = grub_util_biosdisk_read_vec_aio (disk, fd, vec + i, count - i);
+	  if (grub_errno)
+	    return grub_errno;
+	  if (k)
+	    {
+	      j = i + k;
+	      continue;
+	    }
+	}
+#endif
+
+#ifdef __linux__
+      if (vec[i].sector == 0)
+	max = 1;
+#endif /* __linux__ */
+
+      if (max < total)
+	{
+	  /* Let the ordinary path deal with partition boundaries.  */
+	  for (; i < j; i++)
+	    if (grub_util_biosdisk_read (disk, vec[i].sector, vec[i].size,
+					 vec[i].buf))
+	      return grub_errno;
+	  continue;
+	}
+
+      for (k = 0; k < j - i; k++)
+	{
+	  iov[k].iov_base = vec[i + k].buf;
+	  iov[k].iov_len = vec[i + k].size << disk->log_sector_size;
+	}
+
+      if (grub_util_fd_preadv (fd, iov, j - i, off)
+	  != (ssize_t) (total << disk->log_sector_size))
+	return grub_error (GRUB_ERR_READ_ERROR, N_("cannot read `%s': %s"),
+			   map[disk->id].device, strerror (errno));
+    }
+  return GRUB_ERR_NONE;
+}
+
 static grub_err_t
 grub_util_biosdisk_write (grub_disk_t disk, grub_disk_addr_t sector,
 			  grub_size_t size, const char *buf)
@@ -1145,7 +1410,8 @@ grub_util_biosdisk_write (grub_disk_t disk, grub_disk_addr_t sector,
     {
       int fd;
       grub_disk_addr_t max = ~0ULL;
-      fd = open_device (disk, sector, O_WRONLY, &max);
+      grub_uint64_t off;
+      fd = open_device (disk, sector, O_WRONLY, &max, &off);
       if (fd < 0)
 	return grub_errno;
 
@@ -1161,12 +1427,13 @@ grub_util_biosdisk_write (grub_disk_t disk, grub_disk_addr_t sector,
       if (max > size)
 	max = size;
 
-      if (grub_util_fd_write (fd, buf, max << disk->log_sector_size)
+      if (grub_util_fd_pwrite (fd, buf, max << disk->log_sector_size, off)
 	  != (ssize_t) (max << disk->log_sector_size))
 	return grub_error (GRUB_ERR_WRITE_ERROR, N_("cannot write to `%s': %s"),
 			   map[disk->id].device, strerror (errno));
       size -= max;
       buf += (max << disk->log_sector_size);
+      sector += max;
     }
   return GRUB_ERR_NONE;
 }
@@ -1181,7 +1448,7 @@ grub_util_biosdisk_flush (struct grub_disk *disk)
   if (data->fd == -1)
     {
       grub_disk_addr_t max;
-      data->fd = open_device (disk, 0, O_RDONLY, &max);
+      data->fd = open_device (disk, 0, O_RDONLY, &max, 0);
       if (data->fd < 0)
 	return grub_errno;
     }
@@ -1217,9 +1484,33 @@ static struct grub_disk_dev grub_util_biosdisk_dev =
     .close = grub_util_biosdisk_close,
     .read = grub_util_biosdisk_read,
     .write = grub_util_biosdisk_write,
+    .read_vec = grub_util_biosdisk_read_vec,
     .next = 0
   };
 
+/* Map the regular file FD backing DRIVE into memory so that reads are
+   served without syscalls.  Devices keep using read.  */
+static void
+hostdisk_map_file (int drive, int fd, const struct stat *st)
+{
+  void *mapping;
+
+  if (! S_ISREG (st->st_mode) || st->st_size <= 0
+      || (grub_uint64_t) st->st_size != (size_t) st->st_size)
+    return;
+
+  mapping = mmap (NULL, st->st_size, PROT_READ, MAP_SHARED, fd, 0);
+  if (mapping == MAP_FAILED)
+    {
+      grub_util_info ("cannot map `%s': %s", map[drive].device,
+		      strerror (errno));
+      return;
+    }
+
+  map[drive].mapping = mapping;
+  map[drive].mapping_size = st->st_size;
+}
+
 static void
 read_device_map (const char *dev_map)
 {
@@ -1384,6 +1675,22 @@ read_device_map (const char *dev_map)
       else
 #endif
       map[drive].device = xstrdup (p);
+
+      map[drive].mapping = NULL;
+#ifdef BHYVE
+      hostdisk_map_file (drive, diskfd, &st);
+#elif !defined(__MINGW32__)
+      {
+	int fd;
+
+	fd = open (map[drive].device, O_RDONLY);
+	if (fd >= 0)
+	  {
+	    hostdisk_map_file (drive, fd, &st);
+	    close (fd);
+	  }
+      }
+#endif
       if (!map[drive].drive)
 	{
 	  char c;
@@ -1423,10 +1730,17 @@ grub_util_biosdisk_fini (void)
 {
   unsigned i;
 
+  grub_util_info ("hostdisk: %lu read calls, %lu asynchronous batches, "
+		  "%llu bytes read", hostdisk_read_calls, hostdisk_aio_batches,
+		  (unsigned long long) hostdisk_read_bytes);
+
   for (i = 0; i < sizeof (map) / sizeof (map[0]); i++)
     {
       if (map[i].drive)
 	free (map[i].drive);
+      if (map[i].mapping)
+	munmap (map[i].mapping, map[i].mapping_size);
+      map[i].mapping = NULL;
       if (map[i].device)
         {
 	  free (map[i].device);
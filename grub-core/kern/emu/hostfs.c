@@ -212,19 +212,17 @@ grub_hostfs_read (grub_file_t file, char *buf, grub_size_t len)
   struct grub_hostfs_data *data;
 
   data = file->data;
-  if (fseeko (data->f, file->offset, SEEK_SET) != 0)
+
+  /* Read straight into BUF rather than through the stdio buffer.  */
+  if (grub_util_fd_pread (fileno (data->f), buf, len, file->offset)
+      != (ssize_t) len)
     {
-      grub_error (GRUB_ERR_OUT_OF_RANGE, N_("cannot seek `%s': %s"),
+      grub_error (GRUB_ERR_FILE_READ_ERROR, N_("cannot read `%s': %s"),
 		  data->filename, strerror (errno));
       return -1;
     }
 
-  unsigned int s = fread (buf, 1, len, data->f);
-  if (s != len)
-    grub_error (GRUB_ERR_FILE_READ_ERROR, N_("cannot read `%s': %s"),
-		data->filename, strerror (errno));
-
-  return (signed) s;
+  return len;
 }
 
 static grub_err_t
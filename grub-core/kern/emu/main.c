@@ -30,6 +30,7 @@
 #include <grub/mm.h>
 #include <grub/setjmp.h>
 #include <grub/fs.h>
+#include <grub/disk.h>
 #include <grub/emu/hostdisk.h>
 #include <grub/time.h>
 #include <grub/emu/console.h>
@@ -108,6 +109,8 @@ static struct argp_option options[] = {
    N_("use GRUB files in the directory DIR [default=%s]"), 0},
   {"verbose",     'v', 0,      0, N_("print verbose messages."), 0},
   {"hold",     'H', N_("SECS"),      OPTION_ARG_OPTIONAL, N_("wait until a debugger will attach"), 0},
+  {"disk-cache", 'C', N_("MBYTES"), 0,
+   N_("size of the disk cache in MB, 0 disables it [default=%d]"), 0},
 #ifdef BHYVE
   {"cons-dev", 'c', N_("cons-dev"), 0, N_("a tty(4) device to use for terminal I/O"), 0},
   {"evga",  'e', 0,            0, N_("exclude VGA rows/cols from bootinfo"), 0},
@@ -127,6 +130,8 @@ help_filter (int key, const char *text, void *input __attribute__ ((unused)))
       return xasprintf (text, DEFAULT_DIRECTORY);
     case 'm':
       return xasprintf (text, DEFAULT_DEVICE_MAP);
+    case 'C':
+      return xasprintf (text, (int) (grub_disk_cache_get_size () >> 20));
 #ifdef BHYVE
     case 'g':
       return xasprintf (text, DEFAULT_GRUB_CFG);
@@ -173,6 +178,21 @@ argp_parser (int key, char *arg, struct argp_state *state)
     case 'v':
       verbosity++;
       break;
+    case 'C':
+      {
+	char *end;
+	unsigned long mb;
+
+	mb = strtoul (arg, &end, 0);
+	if (*arg == '\0' || *end != '\0')
+	  {
+	    fprintf (stderr, _("Invalid disk cache size `%s'."), arg);
+	    fprintf (stderr, "\n");
+	    return EINVAL;
+	  }
+	grub_disk_cache_set_size ((grub_size_t) mb << 20);
+      }
+      break;
 #ifdef BHYVE
     case 'c':
       grub_emu_bhyve_set_console_dev(xstrdup(arg));
@@ -391,6 +411,7 @@ main (int argc, char *argv[])
   grub_fini_all ();
   grub_hostfs_fini ();
   grub_host_fini ();
+  grub_util_biosdisk_fini ();
 
   grub_machine_fini ();
 
@@ -24,6 +24,7 @@
 #include <grub/mm.h>
 #include <grub/fs.h>
 #include <grub/device.h>
+#include <grub/disk.h>
 #include <grub/i18n.h>
 
 void (*EXPORT_VAR (grub_grubnet_fini)) (void);
@@ -162,6 +163,30 @@ grub_file_read (grub_file_t file, void *buf, grub_size_t len)
   return res;
 }
 
+grub_ssize_t
+grub_file_read_direct (grub_file_t file, void *buf, grub_size_t len)
+{
+  grub_disk_t disk = 0;
+  grub_ssize_t res;
+  int direct = 0;
+
+  if (file->device)
+    disk = file->device->disk;
+
+  if (disk)
+    {
+      direct = disk->direct;
+      disk->direct = 1;
+    }
+
+  res = grub_file_read (file, buf, len);
+
+  if (disk)
+    disk->direct = direct;
+
+  return res;
+}
+
 grub_err_t
 grub_file_close (grub_file_t file)
 {
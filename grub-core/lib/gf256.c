@@ -0,0 +1,127 @@
+/* gf256.c - multiplication of buffers in GF(2^8)  */
+/*
+ *  GRUB  --  GRand Unified Bootloader
+ *  Copyright (C) 2013  Free Software Foundation, Inc.
+ *
+ *  GRUB is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  GRUB is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with GRUB.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <grub/gf256.h>
+#include <grub/misc.h>
+#include <grub/dl.h>
+
+/* Firmware builds don't set up the vector unit, so the SSSE3 code below
+   is only used in the host builds, and only if the CPU has it.  */
+#if (defined (GRUB_MACHINE_EMU) || defined (GRUB_UTIL)) \
+  && defined (__x86_64__) && GNUC_PREREQ (4, 9) && ! defined (__clang__)
+#include <grub/i386/cpuid.h>
+#define GF256_SSSE3 1
+#endif
+
+GRUB_MOD_LICENSE ("GPLv3+");
+
+static const grub_uint8_t poly = 0x1d;
+
+void
+grub_gf256_mul_prepare (struct grub_gf256_mul_table *t, grub_uint8_t c)
+{
+  unsigned i;
+
+  t->row[0] = 0;
+  t->row[1] = c;
+  for (i = 1; i < 128; i++)
+    {
+      t->row[2 * i] = (t->row[i] << 1) ^ ((t->row[i] & 0x80) ? poly : 0);
+      t->row[2 * i + 1] = t->row[2 * i] ^ c;
+    }
+  for (i = 0; i < 16; i++)
+    {
+      t->lo[i] = t->row[i];
+      t->hi[i] = t->row[i << 4];
+    }
+}
+
+/* One lookup per byte.  */
+static void
+gf256_mul_scalar (grub_uint8_t *dst, const grub_uint8_t *src,
+		  grub_size_t size, const struct grub_gf256_mul_table *t,
+		  int add)
+{
+  grub_size_t i;
+
+  if (add)
+    for (i = 0; i < size; i++)
+      dst[i] ^= t->row[src[i]];
+  else
+    for (i = 0; i < size; i++)
+      dst[i] = t->row[src[i]];
+}
+
+#ifdef GF256_SSSE3
+
+typedef char gf256_v16qi __attribute__ ((vector_size (16)));
+typedef unsigned char gf256_v16qu __attribute__ ((vector_size (16)));
+typedef unsigned char gf256_v16qu_u __attribute__ ((vector_size (16),
+						    aligned (1), may_alias));
+
+/* 16 bytes at a time: PSHUFB looks up the products of the low and high
+   nibbles of every byte at once.  */
+static void __attribute__ ((target ("ssse3")))
+gf256_mul_ssse3 (grub_uint8_t *dst, const grub_uint8_t *src,
+		 grub_size_t size, const struct grub_gf256_mul_table *t,
+		 int add)
+{
+  const gf256_v16qu mask = { 15, 15, 15, 15, 15, 15, 15, 15,
+			     15, 15, 15, 15, 15, 15, 15, 15 };
+  gf256_v16qi lo = (gf256_v16qi) *(const gf256_v16qu_u *) t->lo;
+  gf256_v16qi hi = (gf256_v16qi) *(const gf256_v16qu_u *) t->hi;
+
+  for (; size >= 16; size -= 16, dst += 16, src += 16)
+    {
+      gf256_v16qu v = *(const gf256_v16qu_u *) src;
+      gf256_v16qi l = (gf256_v16qi) (v & mask);
+      gf256_v16qi h = (gf256_v16qi) ((v >> 4) & mask);
+
+      v = ((gf256_v16qu) __builtin_ia32_pshufb128 (lo, l)
+	   ^ (gf256_v16qu) __builtin_ia32_pshufb128 (hi, h));
+      if (add)
+	v ^= *(const gf256_v16qu_u *) dst;
+      *(gf256_v16qu_u *) dst = v;
+    }
+  gf256_mul_scalar (dst, src, size, t, add);
+}
+
+static int gf256_ssse3 = -1;
+#endif
+
+void
+grub_gf256_mul (grub_uint8_t *dst, const grub_uint8_t *src, grub_size_t size,
+		const struct grub_gf256_mul_table *t, int add)
+{
+#ifdef GF256_SSSE3
+  if (gf256_ssse3 < 0)
+    {
+      grub_uint32_t eax, ebx, ecx, edx;
+
+      grub_cpuid_count (1, 0, &eax, &ebx, &ecx, &edx);
+      gf256_ssse3 = !! (ecx & (1 << 9));
+    }
+  if (gf256_ssse3)
+    {
+      gf256_mul_ssse3 (dst, src, size, t, add);
+      return;
+    }
+#endif
+  gf256_mul_scalar (dst, src, size, t, add);
+}
@@ -25,6 +25,60 @@
 
 GRUB_MOD_LICENSE ("GPLv2+");
 
+/* Hash the inner and outer HMAC pads of key P into ICTX and OCTX.  Every
+   HMAC of the PBKDF2 loop then starts from a copy of them instead of
+   hashing the key again.  */
+static void
+hmac_prepare (const struct gcry_md_spec *md,
+	      const grub_uint8_t *P, grub_size_t Plen,
+	      void *ictx, void *octx)
+{
+  grub_uint8_t pad[md->blocksize];
+  grub_uint8_t hkey[md->mdlen];
+  grub_size_t i;
+
+  if (Plen > md->blocksize)
+    {
+      grub_crypto_hash (md, hkey, P, Plen);
+      P = hkey;
+      Plen = md->mdlen;
+    }
+
+  grub_memset (pad, 0, md->blocksize);
+  grub_memcpy (pad, P, Plen);
+
+  for (i = 0; i < md->blocksize; i++)
+    pad[i] ^= 0x36;
+  md->init (ictx);
+  md->write (ictx, pad, md->blocksize);
+
+  for (i = 0; i < md->blocksize; i++)
+    pad[i] ^= 0x36 ^ 0x5c;
+  md->init (octx);
+  md->write (octx, pad, md->blocksize);
+
+  grub_memset (pad, 0, md->blocksize);
+  grub_memset (hkey, 0, md->mdlen);
+}
+
+/* Compute the HMAC of IN into OUT, which may be the same, with the pads
+   prepared by hmac_prepare.  CTX is scratch space.  */
+static void
+hmac_run (const struct gcry_md_spec *md, const void *ictx, const void *octx,
+	  void *ctx, const grub_uint8_t *in, grub_size_t inlen,
+	  grub_uint8_t *out)
+{
+  grub_memcpy (ctx, ictx, md->contextsize);
+  md->write (ctx, in, inlen);
+  md->final (ctx);
+  grub_memcpy (out, md->read (ctx), md->mdlen);
+
+  grub_memcpy (ctx, octx, md->contextsize);
+  md->write (ctx, out, md->mdlen);
+  md->final (ctx);
+  grub_memcpy (out, md->read (ctx), md->mdlen);
+}
+
 /* Implement PKCS#5 PBKDF2 as per RFC 2898.  The PRF to use is HMAC variant
    of digest supplied by MD.  Inputs are the password P of length PLEN,
    the salt S of length SLEN, the iteration counter C (> 0), and the
@@ -48,9 +102,10 @@ grub_crypto_pbkdf2 (const struct gcry_md_spec *md,
   unsigned int r;
   unsigned int i;
   unsigned int k;
-  gcry_err_code_t rc;
   grub_uint8_t *tmp;
   grub_size_t tmplen = Slen + 4;
+  grub_size_t ctxlen = ALIGN_UP (md->contextsize, 16);
+  grub_uint8_t *ctxs;
 
   if (c == 0)
     return GPG_ERR_INV_ARG;
@@ -61,6 +116,9 @@ grub_crypto_pbkdf2 (const struct gcry_md_spec *md,
   if (dkLen > 4294967295U)
     return GPG_ERR_INV_ARG;
 
+  if (hLen > md->blocksize)
+    return GPG_ERR_INV_ARG;
+
   l = ((dkLen - 1) / hLen) + 1;
   r = dkLen - (l - 1) * hLen;
 
@@ -68,31 +126,33 @@ grub_crypto_pbkdf2 (const struct gcry_md_spec *md,
   if (tmp == NULL)
     return GPG_ERR_OUT_OF_MEMORY;
 
+  /* The inner and outer pad states and the working context.  */
+  ctxs = grub_malloc (3 * ctxlen);
+  if (ctxs == NULL)
+    {
+      grub_free (tmp);
+      return GPG_ERR_OUT_OF_MEMORY;
+    }
+
+  hmac_prepare (md, P, Plen, ctxs, ctxs + ctxlen);
+
   grub_memcpy (tmp, S, Slen);
 
   for (i = 1; i - 1 < l; i++)
     {
-      grub_memset (T, 0, hLen);
+      tmp[Slen + 0] = (i & 0xff000000) >> 24;
+      tmp[Slen + 1] = (i & 0x00ff0000) >> 16;
+      tmp[Slen + 2] = (i & 0x0000ff00) >> 8;
+      tmp[Slen + 3] = (i & 0x000000ff) >> 0;
+
+      hmac_run (md, ctxs, ctxs + ctxlen, ctxs + 2 * ctxlen,
+		tmp, tmplen, U);
+      grub_memcpy (T, U, hLen);
 
-      for (u = 0; u < c; u++)
+      for (u = 1; u < c; u++)
 	{
-	  if (u == 0)
-	    {
-	      tmp[Slen + 0] = (i & 0xff000000) >> 24;
-	      tmp[Slen + 1] = (i & 0x00ff0000) >> 16;
-	      tmp[Slen + 2] = (i & 0x0000ff00) >> 8;
-	      tmp[Slen + 3] = (i & 0x000000ff) >> 0;
-
-	      rc = grub_crypto_hmac_buffer (md, P, Plen, tmp, tmplen, U);
-	    }
-	  else
-	    rc = grub_crypto_hmac_buffer (md, P, Plen, U, hLen, U);
-
-	  if (rc != GPG_ERR_NO_ERROR)
-	    {
-	      grub_free (tmp);
-	      return rc;
-	    }
+	  hmac_run (md, ctxs, ctxs + ctxlen, ctxs + 2 * ctxlen,
+		    U, hLen, U);
 
 	  for (k = 0; k < hLen; k++)
 	    T[k] ^= U[k];
@@ -101,6 +161,10 @@ grub_crypto_pbkdf2 (const struct gcry_md_spec *md,
       grub_memcpy (DK + (i - 1) * hLen, T, i == l ? r : hLen);
     }
 
+  grub_memset (ctxs, 0, 3 * ctxlen);
+  grub_memset (U, 0, hLen);
+  grub_memset (T, 0, hLen);
+  grub_free (ctxs);
   grub_free (tmp);
 
   return GPG_ERR_NO_ERROR;
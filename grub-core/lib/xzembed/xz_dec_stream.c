@@ -438,6 +438,25 @@ static const struct
 	[0x0A] = { "SHA256", 32},
 };
 
+#ifndef GRUB_EMBED_DECOMPRESSOR
+/*
+ * Free the hash contexts allocated by dec_stream_header(). The Stream
+ * Header is decoded again every time the decoder is reset.
+ */
+static void free_hash_contexts(struct xz_dec *s)
+{
+	kfree(s->index.hash.hash_context);
+	kfree(s->block.hash.hash_context);
+	kfree(s->hash_context);
+	kfree(s->crc32_context);
+	s->index.hash.hash_context = NULL;
+	s->block.hash.hash_context = NULL;
+	s->hash_context = NULL;
+	s->crc32_context = NULL;
+	s->hash = NULL;
+}
+#endif
+
 /* Decode the Stream Header field (the first 12 bytes of the .xz Stream). */
 static enum xz_ret dec_stream_header(struct xz_dec *s)
 {
@@ -445,6 +464,8 @@ static enum xz_ret dec_stream_header(struct xz_dec *s)
 		return XZ_FORMAT_ERROR;
 
 #ifndef GRUB_EMBED_DECOMPRESSOR
+	free_hash_contexts(s);
+
 	s->crc32 = grub_crypto_lookup_md_by_name ("CRC32");
 
 	if (s->crc32)
@@ -501,27 +522,14 @@ static enum xz_ret dec_stream_header(struct xz_dec *s)
 			if (s->hash->mdlen != s->hash_size)
 				return XZ_OPTIONS_ERROR;
 			s->hash_context = kmalloc(s->hash->contextsize, GFP_KERNEL);
-			if (s->hash_context == NULL)
-			{
-				kfree(s->crc32_context);
-				return XZ_MEMLIMIT_ERROR;
-			}
-			
 			s->index.hash.hash_context = kmalloc(s->hash->contextsize,
 							     GFP_KERNEL);
-			if (s->index.hash.hash_context == NULL)
-			{
-				kfree(s->hash_context);
-				kfree(s->crc32_context);
-				return XZ_MEMLIMIT_ERROR;
-			}
-			
 			s->block.hash.hash_context = kmalloc(s->hash->contextsize, GFP_KERNEL);
-			if (s->block.hash.hash_context == NULL)
+			if (s->hash_context == NULL
+			    || s->index.hash.hash_context == NULL
+			    || s->block.hash.hash_context == NULL)
 			{
-				kfree(s->index.hash.hash_context);
-				kfree(s->hash_context);
-				kfree(s->crc32_context);
+				free_hash_contexts(s);
 				return XZ_MEMLIMIT_ERROR;
 			}
 
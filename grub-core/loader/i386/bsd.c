@@ -1962,7 +1962,7 @@ grub_cmd_freebsd_module (grub_command_t cmd __attribute__ ((unused)),
   }
 
 
-  grub_file_read (file, src, file->size);
+  grub_file_read_direct (file, src, file->size);
   if (grub_errno)
     goto fail;
 
@@ -2013,7 +2013,7 @@ grub_netbsd_module_load (char *filename, grub_uint32_t type)
     src = get_virtual_current_address (ch);
   }
 
-  grub_file_read (file, src, file->size);
+  grub_file_read_direct (file, src, file->size);
   if (grub_errno)
     goto fail;
 
@@ -2135,7 +2135,7 @@ grub_cmd_openbsd_ramdisk (grub_command_t cmd __attribute__ ((unused)),
 			 openbsd_ramdisk.max_size, size);
     }
 
-  if (grub_file_read (file, openbsd_ramdisk.target, size)
+  if (grub_file_read_direct (file, openbsd_ramdisk.target, size)
       != (grub_ssize_t) (size))
     {
       grub_file_close (file);
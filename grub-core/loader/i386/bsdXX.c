@@ -13,7 +13,7 @@ load (grub_file_t file, const char *filename, void *where, grub_off_t off, grub_
 {
   if (grub_file_seek (file, off) == (grub_off_t) -1)
     return grub_errno;
-  if (grub_file_read (file, where, size) != (grub_ssize_t) size)
+  if (grub_file_read_direct (file, where, size) != (grub_ssize_t) size)
     {
       if (grub_errno)
 	return grub_errno;
@@ -339,7 +339,7 @@ SUFFIX (grub_freebsd_load_elf_meta) (struct grub_relocator *relocator,
   if (grub_file_seek (file, symoff) == (grub_off_t) -1)
     return grub_errno;
   sym = (Elf_Sym *) curload;
-  if (grub_file_read (file, curload, symsize) != (grub_ssize_t) symsize)
+  if (grub_file_read_direct (file, curload, symsize) != (grub_ssize_t) symsize)
     {
       if (! grub_errno)
 	return grub_error (GRUB_ERR_BAD_OS, N_("premature end of file %s"),
@@ -353,7 +353,7 @@ SUFFIX (grub_freebsd_load_elf_meta) (struct grub_relocator *relocator,
   if (grub_file_seek (file, stroff) == (grub_off_t) -1)
     return grub_errno;
   str = (char *) curload;
-  if (grub_file_read (file, curload, strsize) != (grub_ssize_t) strsize)
+  if (grub_file_read_direct (file, curload, strsize) != (grub_ssize_t) strsize)
     {
       if (! grub_errno)
 	return grub_error (GRUB_ERR_BAD_OS, N_("premature end of file %s"),
@@ -483,7 +483,7 @@ SUFFIX (grub_netbsd_load_elf_meta) (struct grub_relocator *relocator,
 
   if (grub_file_seek (file, symsh->sh_offset) == (grub_off_t) -1)
     return grub_errno;
-  if (grub_file_read (file, curload, symsize) != (grub_ssize_t) symsize)
+  if (grub_file_read_direct (file, curload, symsize) != (grub_ssize_t) symsize)
     {
       if (! grub_errno)
 	return grub_error (GRUB_ERR_BAD_OS, N_("premature end of file %s"),
@@ -494,7 +494,7 @@ SUFFIX (grub_netbsd_load_elf_meta) (struct grub_relocator *relocator,
 
   if (grub_file_seek (file, strsh->sh_offset) == (grub_off_t) -1)
     return grub_errno;
-  if (grub_file_read (file, curload, strsize) != (grub_ssize_t) strsize)
+  if (grub_file_read_direct (file, curload, strsize) != (grub_ssize_t) strsize)
     {
       if (! grub_errno)
 	return grub_error (GRUB_ERR_BAD_OS, N_("premature end of file %s"),
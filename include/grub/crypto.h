@@ -203,6 +203,26 @@ grub_crypto_xor (void *out, const void *in1, const void *in2, grub_size_t size)
 {
   const grub_uint8_t *in1ptr = in1, *in2ptr = in2;
   grub_uint8_t *outptr = out;
+#if (defined (GRUB_MACHINE_EMU) || defined (GRUB_UTIL)) && defined (__x86_64__)
+  /* Every x86_64 host has SSE2, which handles unaligned buffers too.  */
+  typedef grub_uint64_t grub_crypto_xor_vec
+    __attribute__ ((vector_size (16), aligned (1), may_alias));
+
+  while (size >= 2 * sizeof (grub_crypto_xor_vec))
+    {
+      const grub_crypto_xor_vec *a = (const grub_crypto_xor_vec *) in1ptr;
+      const grub_crypto_xor_vec *b = (const grub_crypto_xor_vec *) in2ptr;
+      grub_crypto_xor_vec *o = (grub_crypto_xor_vec *) outptr;
+      grub_crypto_xor_vec v0 = a[0] ^ b[0], v1 = a[1] ^ b[1];
+
+      o[0] = v0;
+      o[1] = v1;
+      in1ptr += 2 * sizeof (grub_crypto_xor_vec);
+      in2ptr += 2 * sizeof (grub_crypto_xor_vec);
+      outptr += 2 * sizeof (grub_crypto_xor_vec);
+      size -= 2 * sizeof (grub_crypto_xor_vec);
+    }
+#endif
   while (size && (((grub_addr_t) in1ptr & (sizeof (grub_uint64_t) - 1))
 		  || ((grub_addr_t) in2ptr & (sizeof (grub_uint64_t) - 1))
 		  || ((grub_addr_t) outptr & (sizeof (grub_uint64_t) - 1))))
@@ -51,6 +51,7 @@ typedef enum
 #define GRUB_CRYPTODISK_GF_BYTES (1U << GRUB_CRYPTODISK_GF_LOG_BYTES)
 
 struct grub_cryptodisk;
+struct grub_cryptodisk_aesni;
 
 typedef gcry_err_code_t
 (*grub_cryptodisk_rekey_func_t) (struct grub_cryptodisk *dev,
@@ -91,6 +92,9 @@ struct grub_cryptodisk
   grub_uint8_t rekey_key[64];
   grub_uint64_t last_rekey;
   int rekey_derived_size;
+  /* The expanded AES keys if the CPU has AES-NI and the mode can use it,
+     otherwise NULL.  */
+  struct grub_cryptodisk_aesni *aesni;
 };
 typedef struct grub_cryptodisk *grub_cryptodisk_t;
 
@@ -44,6 +44,16 @@ enum grub_disk_dev_id
   };
 
 struct grub_disk;
+
+/* A range of sectors for the vectored read entry point of a disk device.
+   SECTOR and SIZE are in device sectors.  */
+struct grub_disk_dev_iovec
+{
+  grub_disk_addr_t sector;
+  grub_size_t size;
+  char *buf;
+};
+
 #ifdef GRUB_UTIL
 struct grub_disk_memberlist;
 #endif
@@ -83,6 +93,12 @@ struct grub_disk_dev
   grub_err_t (*write) (struct grub_disk *disk, grub_disk_addr_t sector,
 		       grub_size_t size, const char *buf);
 
+  /* Read the COUNT ranges described by VEC from the disk DISK at once.
+     This is optional; if it is NULL, read is called for each range.  */
+  grub_err_t (*read_vec) (struct grub_disk *disk,
+			  const struct grub_disk_dev_iovec *vec,
+			  unsigned count);
+
 #ifdef GRUB_UTIL
   struct grub_disk_memberlist *(*memberlist) (struct grub_disk *disk);
   const char * (*raidname) (struct grub_disk *disk);
@@ -118,6 +134,22 @@ struct grub_disk
   /* The partition information. This is machine-specific.  */
   struct grub_partition *partition;
 
+  /* Set by the device when reading from it is as cheap as reading from
+     the disk cache, for instance because it is mapped in memory.  Reads
+     then bypass the disk cache.  */
+  int nocache;
+
+  /* Set while data is read straight into its final destination, for
+     instance by grub_file_read_direct.  Whole cache units are then read
+     directly into the caller's buffer and aren't cached.  */
+  int direct;
+
+  /* Read-ahead state: the last cache unit read, the end of the
+     read-ahead region and the current read-ahead window in cache units.  */
+  grub_disk_addr_t ra_last;
+  grub_disk_addr_t ra_end;
+  unsigned ra_window;
+
   /* Called when a sector was read. OFFSET is between 0 and
      the sector size minus 1, and LENGTH is between 0 and the sector size.  */
   void NESTED_FUNC_ATTR (*read_hook) (grub_disk_addr_t sector,
@@ -137,24 +169,65 @@ struct grub_disk_memberlist
 typedef struct grub_disk_memberlist *grub_disk_memberlist_t;
 #endif
 
+/* A range for grub_disk_read_vec.  The fields have the same meaning as
+   the arguments of grub_disk_read.  */
+struct grub_disk_read_vec
+{
+  grub_disk_addr_t sector;
+  grub_off_t offset;
+  grub_size_t size;
+  void *buf;
+};
+
+/* The partition a cache entry of a file system was read from.  File
+   systems which are mounted again for every open use it to keep caches
+   across mounts.  */
+struct grub_disk_key
+{
+  unsigned long dev_id;
+  unsigned long disk_id;
+  grub_disk_addr_t part_start;
+};
+
+static inline int
+grub_disk_key_equal (const struct grub_disk_key *a,
+		     const struct grub_disk_key *b)
+{
+  return (a->dev_id == b->dev_id && a->disk_id == b->disk_id
+	  && a->part_start == b->part_start);
+}
+
 /* The sector size.  */
 #define GRUB_DISK_SECTOR_SIZE	0x200
 #define GRUB_DISK_SECTOR_BITS	9
 
-/* The maximum number of disk caches.  */
-#define GRUB_DISK_CACHE_NUM	1021
+/* The default number of disk cache lines.  */
+#define GRUB_DISK_CACHE_NUM	1024
+
+/* The number of lines in each set of the disk cache.  */
+#define GRUB_DISK_CACHE_WAYS	8
 
 /* The size of a disk cache in 512B units. Must be at least as big as the
    largest supported sector size, currently 16K.  */
 #define GRUB_DISK_CACHE_BITS	6
 #define GRUB_DISK_CACHE_SIZE	(1 << GRUB_DISK_CACHE_BITS)
 
+/* The initial and the maximum read-ahead window in cache units.  */
+#define GRUB_DISK_READAHEAD_MIN	4
+#define GRUB_DISK_READAHEAD_MAX	64
+
 /* Return value of grub_disk_get_size() in case disk size is unknown. */
 #define GRUB_DISK_SIZE_UNKNOWN	 0xffffffffffffffffULL
 
 /* This is called from the memory manager.  */
 void grub_disk_cache_invalidate_all (void);
 
+/* Resize the disk cache to SIZE bytes. Zero disables the cache.  */
+void EXPORT_FUNC(grub_disk_cache_set_size) (grub_size_t size);
+/* Return the size of the disk cache, which is smaller than the one set
+   if not enough memory was available for it.  */
+grub_size_t EXPORT_FUNC(grub_disk_cache_get_size) (void);
+
 void EXPORT_FUNC(grub_disk_dev_register) (grub_disk_dev_t dev);
 void EXPORT_FUNC(grub_disk_dev_unregister) (grub_disk_dev_t dev);
 static inline int
@@ -178,6 +251,9 @@ grub_err_t EXPORT_FUNC(grub_disk_read) (grub_disk_t disk,
 					grub_off_t offset,
 					grub_size_t size,
 					void *buf);
+grub_err_t EXPORT_FUNC(grub_disk_read_vec) (grub_disk_t disk,
+					    const struct grub_disk_read_vec *vec,
+					    unsigned count);
 grub_err_t EXPORT_FUNC(grub_disk_write) (grub_disk_t disk,
 					 grub_disk_addr_t sector,
 					 grub_off_t offset,
@@ -186,10 +262,26 @@ grub_err_t EXPORT_FUNC(grub_disk_write) (grub_disk_t disk,
 
 grub_uint64_t EXPORT_FUNC(grub_disk_get_size) (grub_disk_t disk);
 
-#if DISK_CACHE_STATS
+/* Set KEY to the partition DISK refers to.  */
+void EXPORT_FUNC(grub_disk_get_key) (grub_disk_t disk,
+				     struct grub_disk_key *key);
+
+/* Return non-zero if a file system cache last used at *LAST_TIME must be
+   dropped, and set *LAST_TIME to now.  Like the disk cache, such caches
+   expire when they weren't used for a while, so that devices which were
+   replaced in the meantime aren't trusted.  */
+int EXPORT_FUNC(grub_disk_cache_expired) (grub_uint64_t *last_time);
+
 void
-EXPORT_FUNC(grub_disk_cache_get_performance) (unsigned long *hits, unsigned long *misses);
-#endif
+EXPORT_FUNC(grub_disk_cache_get_performance) (unsigned long *hits,
+					      unsigned long *misses,
+					      unsigned long *evictions);
+void
+EXPORT_FUNC(grub_disk_readahead_get_performance) (grub_uint64_t *bytes,
+						  unsigned long *hits,
+						  unsigned long *wasted);
+void
+EXPORT_FUNC(grub_disk_direct_get_performance) (grub_uint64_t *bytes);
 
 extern void (* EXPORT_VAR(grub_disk_firmware_fini)) (void);
 extern int EXPORT_VAR(grub_disk_firmware_is_tainted);
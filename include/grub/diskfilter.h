@@ -75,6 +75,9 @@ struct grub_diskfilter_pv {
 #ifdef GRUB_UTIL
   char **partmaps;
 #endif
+  /* Read requests issued to DISK and the bytes they asked for.  */
+  unsigned long read_requests;
+  grub_uint64_t read_bytes;
 };
 
 struct grub_diskfilter_lv {
@@ -0,0 +1,60 @@
+/*
+ *  GRUB  --  GRand Unified Bootloader
+ *  Copyright (C) 2013  Free Software Foundation, Inc.
+ *
+ *  GRUB is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  GRUB is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with GRUB.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef GRUB_EMU_BHYVE_EXTENT_H
+#define GRUB_EMU_BHYVE_EXTENT_H 1
+
+#include <grub/types.h>
+#include <grub/err.h>
+
+/*
+ * Free guest memory, kept as a balanced tree of free extents sorted by
+ * address.  Every node also records the largest extent in its subtree so
+ * that searches can skip subtrees which can't satisfy a request.
+ */
+struct grub_bhyve_extent;
+
+struct grub_bhyve_extent_map
+{
+  struct grub_bhyve_extent *root;
+};
+
+void grub_bhyve_extent_init (struct grub_bhyve_extent_map *map);
+void grub_bhyve_extent_fini (struct grub_bhyve_extent_map *map);
+
+/* Add [START, START + LEN) to the free memory.  */
+grub_err_t grub_bhyve_extent_add (struct grub_bhyve_extent_map *map,
+				  grub_uint64_t start, grub_uint64_t len);
+
+/* Allocate exactly [TARGET, TARGET + SIZE).  */
+grub_err_t grub_bhyve_extent_alloc_addr (struct grub_bhyve_extent_map *map,
+					 grub_uint64_t target,
+					 grub_uint64_t size);
+
+/* Allocate SIZE bytes starting at a multiple of ALIGN between MIN_ADDR
+   and MAX_ADDR.  The lowest such address is used unless PREFERENCE is
+   GRUB_RELOCATOR_PREFERENCE_HIGH, in which case the highest one is.  */
+grub_err_t grub_bhyve_extent_alloc_align (struct grub_bhyve_extent_map *map,
+					  grub_uint64_t min_addr,
+					  grub_uint64_t max_addr,
+					  grub_uint64_t size,
+					  grub_uint64_t align,
+					  int preference,
+					  grub_uint64_t *target);
+
+#endif /* GRUB_EMU_BHYVE_EXTENT_H */
@@ -38,6 +38,9 @@ grub_err_t
 grub_util_fd_seek (int fd, const char *name, grub_uint64_t sector);
 ssize_t grub_util_fd_read (int fd, char *buf, size_t len);
 ssize_t grub_util_fd_write (int fd, const char *buf, size_t len);
+ssize_t grub_util_fd_pread (int fd, char *buf, size_t len, grub_uint64_t off);
+ssize_t grub_util_fd_pwrite (int fd, const char *buf, size_t len,
+			     grub_uint64_t off);
 grub_err_t
 grub_cryptodisk_cheat_mount (const char *sourcedev, const char *cheat);
 void grub_util_cryptodisk_print_uuid (grub_disk_t disk);
@@ -103,6 +103,11 @@ char *EXPORT_FUNC(grub_file_get_device_name) (const char *name);
 grub_file_t EXPORT_FUNC(grub_file_open) (const char *name);
 grub_ssize_t EXPORT_FUNC(grub_file_read) (grub_file_t file, void *buf,
 					  grub_size_t len);
+/* Same as grub_file_read, but BUF is the final destination of the data,
+   e.g. loaded kernel or module, so bulk disk reads go straight into it
+   and bypass the disk cache.  */
+grub_ssize_t EXPORT_FUNC(grub_file_read_direct) (grub_file_t file, void *buf,
+						 grub_size_t len);
 grub_off_t EXPORT_FUNC(grub_file_seek) (grub_file_t file, grub_off_t offset);
 grub_err_t EXPORT_FUNC(grub_file_close) (grub_file_t file);
 
@@ -60,6 +60,42 @@ EXPORT_FUNC(grub_fshelp_find_file) (const char *path,
 				    enum grub_fshelp_filetype expect);
 
 
+/* Callbacks that let grub_fshelp_find_file_cached remember directory
+   entries after the filesystem was unmounted.  */
+struct grub_fshelp_cache_ops
+{
+  /* Return a number that identifies NODE on the filesystem, for
+     instance its inode number.  */
+  grub_uint64_t (*node_id) (grub_fshelp_node_t node);
+
+  /* Return a new malloc'ed node for the file identified by ID, which
+     was found in the directory DIR.  */
+  grub_fshelp_node_t (*get_node) (grub_fshelp_node_t dir, grub_uint64_t id);
+};
+
+/* Like grub_fshelp_find_file, but look the path components up in the
+   path lookup cache first.  The entries of the filesystem on DISK are
+   told apart by OPS.  */
+grub_err_t
+EXPORT_FUNC(grub_fshelp_find_file_cached) (const char *path,
+					   grub_fshelp_node_t rootnode,
+					   grub_fshelp_node_t *foundnode,
+					   int (*iterate_dir) (grub_fshelp_node_t dir,
+							       int NESTED_FUNC_ATTR
+							       (*hook) (const char *filename,
+									enum grub_fshelp_filetype filetype,
+									grub_fshelp_node_t node)),
+					   char *(*read_symlink) (grub_fshelp_node_t node),
+					   enum grub_fshelp_filetype expect,
+					   grub_disk_t disk,
+					   const struct grub_fshelp_cache_ops *ops);
+
+void
+EXPORT_FUNC(grub_fshelp_cache_get_performance) (unsigned long *lookups,
+						unsigned long *hits,
+						unsigned long *negative,
+						unsigned long *scans);
+
 /* Read LEN bytes from the file NODE on disk DISK into the buffer BUF,
    beginning with the block POS.  READ_HOOK should be set before
    reading a block from the file.  GET_BLOCK is used to translate file
@@ -76,6 +112,22 @@ EXPORT_FUNC(grub_fshelp_read_file) (grub_disk_t disk, grub_fshelp_node_t node,
 				    grub_off_t filesize, int log2blocksize,
 				    grub_disk_addr_t blocks_start);
 
+/* Like grub_fshelp_read_file, but GET_EXTENT returns the disk block of
+   the file block BLOCK and sets *COUNT to the number of blocks from
+   BLOCK on that are contiguous on disk (or all holes if the returned
+   block is 0).  */
+grub_ssize_t
+EXPORT_FUNC(grub_fshelp_read_file_extents) (grub_disk_t disk, grub_fshelp_node_t node,
+					    void NESTED_FUNC_ATTR (*read_hook) (grub_disk_addr_t sector,
+										unsigned offset,
+										unsigned length),
+					    grub_off_t pos, grub_size_t len, char *buf,
+					    grub_disk_addr_t (*get_extent) (grub_fshelp_node_t node,
+									    grub_disk_addr_t block,
+									    grub_disk_addr_t *count),
+					    grub_off_t filesize, int log2blocksize,
+					    grub_disk_addr_t blocks_start);
+
 unsigned int
 EXPORT_FUNC(grub_fshelp_log2blksize) (unsigned int blksize,
 				      unsigned int *pow);
@@ -0,0 +1,45 @@
+/*
+ *  GRUB  --  GRand Unified Bootloader
+ *  Copyright (C) 2013  Free Software Foundation, Inc.
+ *
+ *  GRUB is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  GRUB is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with GRUB.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef GRUB_GF256_HEADER
+#define GRUB_GF256_HEADER 1
+
+#include <grub/types.h>
+
+/* Multiplication of buffers by a constant in GF(2^8) with the polynomial
+   x^8 + x^4 + x^3 + x^2 + 1, which RAID-6 and RAID-Z parity use.  */
+
+/* Multiplication by a constant C: ROW holds the products of C and every
+   byte, LO and HI those of C and every low and high nibble.  */
+struct grub_gf256_mul_table
+{
+  grub_uint8_t row[256];
+  grub_uint8_t lo[16];
+  grub_uint8_t hi[16];
+};
+
+/* Set up T for multiplying by C.  */
+void grub_gf256_mul_prepare (struct grub_gf256_mul_table *t, grub_uint8_t c);
+
+/* DST = SRC * c, or DST ^= SRC * c if ADD, with T set up for C.  DST and
+   SRC may be the same buffer.  */
+void grub_gf256_mul (grub_uint8_t *dst, const grub_uint8_t *src,
+		     grub_size_t size, const struct grub_gf256_mul_table *t,
+		     int add);
+
+#endif
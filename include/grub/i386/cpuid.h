@@ -19,6 +19,32 @@
 #ifndef GRUB_CPU_CPUID_HEADER
 #define GRUB_CPU_CPUID_HEADER 1
 
+#include <grub/types.h>
+
 extern unsigned char grub_cpuid_has_longmode;
 
+#ifdef __x86_64__
+/* Execute CPUID for LEAF and SUBLEAF.  */
+static inline void
+grub_cpuid_count (grub_uint32_t leaf, grub_uint32_t subleaf,
+		  grub_uint32_t *eax, grub_uint32_t *ebx,
+		  grub_uint32_t *ecx, grub_uint32_t *edx)
+{
+  asm volatile ("cpuid"
+		: "=a" (*eax), "=b" (*ebx), "=c" (*ecx), "=d" (*edx)
+		: "0" (leaf), "2" (subleaf));
+}
+
+/* Return the OS-enabled state components reported by XGETBV.  Only valid
+   if CPUID reports OSXSAVE.  */
+static inline grub_uint64_t
+grub_xgetbv (grub_uint32_t index)
+{
+  grub_uint32_t lo, hi;
+
+  asm volatile ("xgetbv" : "=a" (lo), "=d" (hi) : "c" (index));
+  return ((grub_uint64_t) hi << 32) | lo;
+}
+#endif
+
 #endif
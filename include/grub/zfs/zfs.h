@@ -38,6 +38,15 @@ typedef enum grub_zfs_endian
  */
 #define	SPA_VERSION			33ULL
 
+/*
+ * Pools with feature flags have this version.  Which features are in use
+ * is recorded in the MOS.
+ */
+#define	SPA_VERSION_FEATURES		5000ULL
+
+#define	SPA_VERSION_IS_SUPPORTED(v) \
+	(((v) > 0 && (v) <= SPA_VERSION) || (v) == SPA_VERSION_FEATURES)
+
 /*
  * The following are configuration names used in the nvlist describing a pool's
  * configuration.
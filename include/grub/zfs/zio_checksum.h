@@ -29,5 +29,7 @@ extern void fletcher_2 (const void *, grub_uint64_t, grub_zfs_endian_t endian,
 			zio_cksum_t *);
 extern void fletcher_4 (const void *, grub_uint64_t, grub_zfs_endian_t endian,
 			zio_cksum_t *);
+extern int zio_checksum_SHA256_self_test (void);
+extern int fletcher_4_self_test (void);
 
 #endif	/* _SYS_ZIO_CHECKSUM_H */
@@ -0,0 +1,115 @@
+/*
+ *  GRUB  --  GRand Unified Bootloader
+ *  Copyright (C) 2013 Free Software Foundation, Inc.
+ *
+ *  GRUB is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  GRUB is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with GRUB.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <grub/test.h>
+#include <grub/misc.h>
+#include <grub/relocator.h>
+#include <grub/emu/bhyve_extent.h>
+
+GRUB_MOD_LICENSE ("GPLv3+");
+
+#define MSG "bhyve extent test failed"
+
+#define KB(x) ((grub_uint64_t) (x) << 10)
+#define MB(x) ((grub_uint64_t) (x) << 20)
+#define GB(x) ((grub_uint64_t) (x) << 30)
+
+/* Functional test main method.  */
+static void
+bhyve_extent_test (void)
+{
+  struct grub_bhyve_extent_map map;
+  grub_uint64_t addr;
+  int i;
+
+  /* Same layout as bhyve guest memory: 640K, 1M - 2G and 4G - 6G.  */
+  grub_bhyve_extent_init (&map);
+  grub_test_assert (grub_bhyve_extent_add (&map, 0, KB (640)) == 0, MSG);
+  grub_test_assert (grub_bhyve_extent_add (&map, MB (1), GB (2) - MB (1))
+		    == 0, MSG);
+  grub_test_assert (grub_bhyve_extent_add (&map, GB (4), GB (2)) == 0, MSG);
+  grub_test_assert (grub_bhyve_extent_add (&map, MB (2), MB (1)) != 0, MSG);
+  grub_errno = GRUB_ERR_NONE;
+
+  /* Fixed addresses.  */
+  grub_test_assert (grub_bhyve_extent_alloc_addr (&map, MB (1), MB (4))
+		    == 0, MSG);
+  grub_test_assert (grub_bhyve_extent_alloc_addr (&map, MB (4), 0x1000)
+		    != 0, MSG);
+  grub_test_assert (grub_bhyve_extent_alloc_addr (&map, KB (600), KB (64))
+		    != 0, MSG);
+  grub_test_assert (grub_bhyve_extent_alloc_addr (&map, GB (3), 0x1000)
+		    != 0, MSG);
+  grub_test_assert (grub_bhyve_extent_alloc_addr (&map, MB (5), 0x1000)
+		    == 0, MSG);
+  grub_errno = GRUB_ERR_NONE;
+
+  /* Lowest fit, skipping the hole left below 5M.  */
+  grub_test_assert (grub_bhyve_extent_alloc_align (&map, MB (1), GB (4),
+						   0x2000, 0x1000,
+						   GRUB_RELOCATOR_PREFERENCE_NONE,
+						   &addr) == 0, MSG);
+  grub_test_assert (addr == MB (5) + 0x1000, MSG);
+
+  grub_test_assert (grub_bhyve_extent_alloc_align (&map, MB (1), GB (4),
+						   0x1000, MB (2),
+						   GRUB_RELOCATOR_PREFERENCE_LOW,
+						   &addr) == 0, MSG);
+  grub_test_assert (addr == MB (6), MSG);
+
+  /* Highest fit below MAX_ADDR.  */
+  grub_test_assert (grub_bhyve_extent_alloc_align (&map, MB (1), GB (5),
+						   MB (1), MB (1),
+						   GRUB_RELOCATOR_PREFERENCE_HIGH,
+						   &addr) == 0, MSG);
+  grub_test_assert (addr == GB (5), MSG);
+
+  grub_test_assert (grub_bhyve_extent_alloc_align (&map, MB (1), GB (3),
+						   MB (1), MB (1),
+						   GRUB_RELOCATOR_PREFERENCE_HIGH,
+						   &addr) == 0, MSG);
+  grub_test_assert (addr == GB (2) - MB (1), MSG);
+
+  /* Only the low 640K can satisfy this.  */
+  grub_test_assert (grub_bhyve_extent_alloc_align (&map, 0x200, 0xf000,
+						   0x100, 8,
+						   GRUB_RELOCATOR_PREFERENCE_NONE,
+						   &addr) == 0, MSG);
+  grub_test_assert (addr == 0x200, MSG);
+
+  /* Too large for any extent.  */
+  grub_test_assert (grub_bhyve_extent_alloc_align (&map, 0, GB (8), GB (3),
+						   1, GRUB_RELOCATOR_PREFERENCE_NONE,
+						   &addr) != 0, MSG);
+  grub_errno = GRUB_ERR_NONE;
+
+  /* Many small allocations land back to back.  */
+  for (i = 0; i < 1000; i++)
+    {
+      grub_test_assert (grub_bhyve_extent_alloc_align (&map, GB (4), GB (6),
+						       0x1000, 0x1000,
+						       GRUB_RELOCATOR_PREFERENCE_LOW,
+						       &addr) == 0, MSG);
+      grub_test_assert (addr == GB (4) + (grub_uint64_t) i * 0x1000, MSG);
+    }
+
+  grub_bhyve_extent_fini (&map);
+}
+
+/* Register bhyve_extent_test method as a functional test.  */
+GRUB_UNIT_TEST ("bhyve_extent_test", bhyve_extent_test);
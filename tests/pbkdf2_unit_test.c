@@ -0,0 +1,87 @@
+/*
+ *  GRUB  --  GRand Unified Bootloader
+ *  Copyright (C) 2013 Free Software Foundation, Inc.
+ *
+ *  GRUB is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  GRUB is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with GRUB.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <grub/test.h>
+#include <grub/misc.h>
+#include <grub/crypto.h>
+
+GRUB_MOD_LICENSE ("GPLv3+");
+
+#define MSG "pbkdf2 test failed"
+
+struct pbkdf2_vector
+{
+  const gcry_md_spec_t *md;
+  const char *P;
+  const char *S;
+  unsigned int c;
+  grub_size_t dkLen;
+  const char *DK;
+};
+
+static const char long_password[] =
+  "xxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxx"
+  "xxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxx";
+
+static int
+pbkdf2_is (const struct pbkdf2_vector *v)
+{
+  grub_uint8_t dk[64];
+  char hex[2 * sizeof (dk) + 1];
+  grub_size_t i;
+
+  if (grub_crypto_pbkdf2 (v->md, (const grub_uint8_t *) v->P,
+			  grub_strlen (v->P), (const grub_uint8_t *) v->S,
+			  grub_strlen (v->S), v->c, dk, v->dkLen)
+      != GPG_ERR_NO_ERROR)
+    return 0;
+
+  for (i = 0; i < v->dkLen; i++)
+    grub_snprintf (hex + 2 * i, 3, "%02x", dk[i]);
+  return grub_strcmp (hex, v->DK) == 0;
+}
+
+/* Functional test main method.  */
+static void
+pbkdf2_test (void)
+{
+  const struct pbkdf2_vector vectors[] =
+    {
+      /* RFC 6070.  */
+      { GRUB_MD_SHA1, "password", "salt", 1, 20,
+	"0c60c80f961f0e71f3a9b524af6012062fe037a6" },
+      { GRUB_MD_SHA1, "password", "salt", 4096, 20,
+	"4b007901b765489abead49d926f721d065a429c1" },
+      { GRUB_MD_SHA1, "passwordPASSWORDpassword",
+	"saltSALTsaltSALTsaltSALTsaltSALTsalt", 4096, 25,
+	"3d2eec4fe41c849b80c8d83662c0e44a8b291a964cf2f07038" },
+      { GRUB_MD_SHA256, "password", "salt", 2, 32,
+	"ae4d0c95af6b46d32d0adff928f06dd02a303f8ef3c251dfd6e2d85a95474c43" },
+      /* A key longer than the hash block is hashed first.  */
+      { GRUB_MD_SHA256, long_password, "saltSALT", 1000, 40,
+	"f48b1c3f326099780b1a35ee3fb174aae805cfea7684c3b02b6a6bcb2298a549"
+	"3a201bdab5bb8626" },
+    };
+  unsigned i;
+
+  for (i = 0; i < ARRAY_SIZE (vectors); i++)
+    grub_test_assert (pbkdf2_is (&vectors[i]), MSG);
+}
+
+/* Register pbkdf2_test method as a functional test.  */
+GRUB_UNIT_TEST ("pbkdf2_test", pbkdf2_test);
@@ -0,0 +1,120 @@
+/*
+ *  GRUB  --  GRand Unified Bootloader
+ *  Copyright (C) 2013 Free Software Foundation, Inc.
+ *
+ *  GRUB is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  GRUB is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with GRUB.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <grub/test.h>
+#include <grub/misc.h>
+#include <grub/mm.h>
+#include <grub/zfs/zfs.h>
+#include <grub/zfs/zio.h>
+#include <grub/zfs/zio_checksum.h>
+
+GRUB_MOD_LICENSE ("GPLv3+");
+
+#define MSG "zfs checksum test failed"
+
+#define BUF_SIZE 8192
+
+/* The definition of fletcher-4, one word at a time.  */
+static void
+fletcher_4_ref (const grub_uint8_t *buf, grub_size_t size,
+		grub_zfs_endian_t endian, grub_uint64_t *sums)
+{
+  grub_uint64_t a = 0, b = 0, c = 0, d = 0;
+  grub_size_t i;
+
+  for (i = 0; i + 4 <= size; i += 4)
+    {
+      if (endian == GRUB_ZFS_BIG_ENDIAN)
+	a += grub_be_to_cpu32 (grub_get_unaligned32 (buf + i));
+      else
+	a += grub_le_to_cpu32 (grub_get_unaligned32 (buf + i));
+      b += a;
+      c += b;
+      d += c;
+    }
+
+  sums[0] = a;
+  sums[1] = b;
+  sums[2] = c;
+  sums[3] = d;
+}
+
+static int
+sha256_is (const char *s, grub_uint64_t w0, grub_uint64_t w3)
+{
+  zio_cksum_t zc;
+
+  zio_checksum_SHA256 (s, grub_strlen (s), GRUB_ZFS_BIG_ENDIAN, &zc);
+  return (grub_be_to_cpu64 (zc.zc_word[0]) == w0
+	  && grub_be_to_cpu64 (zc.zc_word[3]) == w3);
+}
+
+/* Functional test main method.  */
+static void
+zfs_checksum_test (void)
+{
+  static const grub_size_t sizes[] = { 0, 4, 8, 12, 60, 512, 516, 4096,
+				       BUF_SIZE };
+  grub_uint8_t *buf;
+  grub_uint32_t x = 1;
+  unsigned i, j;
+
+  /* All the optimized variants agree with the plain C code.  */
+  grub_test_assert (fletcher_4_self_test () == 0, MSG);
+  grub_test_assert (zio_checksum_SHA256_self_test () == 0, MSG);
+
+  /* FIPS 180-2 examples.  */
+  grub_test_assert (sha256_is ("abc", 0xba7816bf8f01cfeaULL,
+			       0xb410ff61f20015adULL), MSG);
+  grub_test_assert (sha256_is ("abcdbcdecdefdefgefghfghighijhijkijkl"
+			       "jklmklmnlmnomnopnopq", 0x248d6a61d20638b8ULL,
+			       0xf6ecedd419db06c1ULL), MSG);
+
+  buf = grub_malloc (BUF_SIZE);
+  grub_test_assert (buf != NULL, MSG);
+  if (! buf)
+    return;
+
+  for (i = 0; i < BUF_SIZE; i++)
+    {
+      x = x * 1103515245 + 12345;
+      buf[i] = x >> 16;
+    }
+
+  for (i = 0; i < ARRAY_SIZE (sizes); i++)
+    for (j = 0; j < 2; j++)
+      {
+	grub_zfs_endian_t endian = j ? GRUB_ZFS_BIG_ENDIAN
+	  : GRUB_ZFS_LITTLE_ENDIAN;
+	grub_uint64_t sums[4];
+	zio_cksum_t zc;
+
+	fletcher_4_ref (buf, sizes[i], endian, sums);
+	fletcher_4 (buf, sizes[i], endian, &zc);
+	grub_test_assert (grub_zfs_to_cpu64 (zc.zc_word[0], endian) == sums[0]
+			  && grub_zfs_to_cpu64 (zc.zc_word[1], endian) == sums[1]
+			  && grub_zfs_to_cpu64 (zc.zc_word[2], endian) == sums[2]
+			  && grub_zfs_to_cpu64 (zc.zc_word[3], endian) == sums[3],
+			  MSG);
+      }
+
+  grub_free (buf);
+}
+
+/* Register zfs_checksum_test method as a functional test.  */
+GRUB_UNIT_TEST ("zfs_checksum_test", zfs_checksum_test);